@@ -1,6 +1,7 @@
 #include "adc.h"
 
 #include "log.h"
+#include "snapshot.h"
 #include "timing.h"
 #include "util.h"
 #include "via.h"
@@ -74,7 +75,10 @@ adc_create(int is_externally_clocked,
   p_adc->p_timing = p_timing;
   p_adc->p_system_via = p_system_via;
 
-  p_adc->timer_id = timing_register_timer(p_timing, adc_timer_callback, p_adc);
+  p_adc->timer_id = timing_register_timer(p_timing,
+                                          "adc",
+                                          adc_timer_callback,
+                                          p_adc);
 
   return p_adc;
 }
@@ -223,3 +227,9 @@ adc_set_channel_value(struct adc_struct* p_adc,
   assert(channel < k_adc_num_channels);
   p_adc->state.channel_value[channel] = value;
 }
+
+void
+adc_snapshot(struct adc_struct* p_adc, struct snapshot_struct* p_snapshot) {
+  SNAPSHOT_FIELD(p_snapshot, p_adc->state);
+  (void) timing_snapshot_timer(p_adc->p_timing, p_adc->timer_id, p_snapshot);
+}
@@ -3,6 +3,7 @@
 
 #include <stdint.h>
 
+struct snapshot_struct;
 struct timing_struct;
 struct via_struct;
 
@@ -23,4 +24,7 @@ void adc_set_channel_value(struct adc_struct* p_adc,
                            uint32_t channel,
                            uint16_t value);
 
+void adc_snapshot(struct adc_struct* p_adc,
+                  struct snapshot_struct* p_snapshot);
+
 #endif /* BEEBJIT_ADC_H */
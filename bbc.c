@@ -20,6 +20,7 @@
 #include "os_time.h"
 #include "render.h"
 #include "serial_ula.h"
+#include "snapshot.h"
 #include "sound.h"
 #include "state_6502.h"
 #include "tape.h"
@@ -47,6 +48,8 @@ static const size_t k_bbc_andy_size = 0x1000;
 
 static const size_t k_bbc_tick_rate = 2000000; /* 2Mhz. */
 static const size_t k_bbc_default_wakeup_rate = 500; /* 2ms / 500Hz. */
+static const uint32_t k_bbc_default_snapshot_cycles = 2000000; /* 1s. */
+static const uint32_t k_bbc_default_snapshot_count = 30;
 
 /* This data is from b-em, thanks b-em! */
 static const int k_FE_1mhz_array[8] = { 1, 0, 1, 1, 0, 0, 1, 0 };
@@ -106,6 +109,15 @@ struct bbc_struct {
   intptr_t mem_handle;
   int is_64k_mappings;
   uint64_t rewind_to_cycles;
+  /* Ring of periodic snapshots, used to rewind without replaying from power
+   * on.
+   */
+  struct snapshot_struct** p_snapshots;
+  uint64_t* p_snapshot_cycles;
+  uint32_t snapshot_count;
+  uint32_t snapshot_next;
+  uint32_t snapshot_used;
+  uint32_t snapshot_restore_index;
   uint32_t log_count_shadow_speed;
   uint32_t log_count_misc_unimplemented;
 
@@ -180,11 +192,14 @@ struct bbc_struct {
   uint32_t timer_id_cycles;
   uint32_t timer_id_stop_cycles;
   int32_t timer_id_autoboot;
+  uint32_t timer_id_snapshot;
+  uint32_t snapshot_cycles;
   uint32_t wakeup_rate;
   uint64_t cycles_per_run_fast;
   uint64_t cycles_per_run_normal;
   uint64_t last_time_us;
   uint64_t last_time_us_perf;
+  uint64_t run_start_time_us;
   uint64_t last_cycles;
   uint64_t last_frames;
   uint64_t last_crtc_advances;
@@ -196,6 +211,7 @@ struct bbc_struct {
   uint64_t num_hw_reg_hits;
   int log_speed;
   int log_timestamp;
+  int log_timers;
 };
 
 static int
@@ -651,6 +667,11 @@ bbc_get_effective_bank(struct bbc_struct* p_bbc, uint8_t romsel) {
   return romsel;
 }
 
+uint8_t
+bbc_get_current_bank(struct bbc_struct* p_bbc) {
+  return bbc_get_effective_bank(p_bbc, p_bbc->romsel);
+}
+
 static void
 bbc_page_rom(struct bbc_struct* p_bbc,
              uint8_t effective_curr_bank,
@@ -1171,13 +1192,20 @@ bbc_framebuffer_ready_callback(void* p,
   struct bbc_message message;
 
   struct bbc_struct* p_bbc = (struct bbc_struct*) p;
-  int do_wait_for_render = !p_bbc->fast_flag;
+  /* A full render works from a copy of the frame taken at paint time, so
+   * there's nothing to wait for. Otherwise, the render buffer is shared.
+   */
+  int do_wait_for_render = (!p_bbc->fast_flag && !do_full_render);
 
   message.data[0] = k_message_vsync;
   message.data[1] = do_full_render;
   message.data[2] = framing_changed;
   message.data[3] = timing_get_total_timer_ticks(p_bbc->p_timing);
   message.data[4] = do_wait_for_render;
+  message.data[5] = 0;
+  if (do_full_render) {
+    message.data[5] = video_get_frame_hash(p_bbc->p_video);
+  }
   bbc_cpu_send_message(p_bbc, &message);
   if (do_wait_for_render) {
     struct bbc_message message;
@@ -1218,6 +1246,235 @@ bbc_virtual_keyboard_updated_callback(void* p) {
   }
 }
 
+static void
+bbc_autoboot_timer_callback(void* p) {
+  struct bbc_struct* p_bbc = (struct bbc_struct*) p;
+  struct keyboard_struct* p_keyboard = p_bbc->p_keyboard;
+
+  (void) timing_stop_timer(p_bbc->p_timing, p_bbc->timer_id_autoboot);
+
+  keyboard_system_key_released(p_keyboard, k_keyboard_key_shift_left);
+}
+
+static void
+bbc_register_autoboot_timer(struct bbc_struct* p_bbc) {
+  if (p_bbc->timer_id_autoboot != -1) {
+    return;
+  }
+  p_bbc->timer_id_autoboot = timing_register_timer(p_bbc->p_timing,
+                                                   "bbc_autoboot",
+                                                   bbc_autoboot_timer_callback,
+                                                   p_bbc);
+}
+
+static void
+bbc_snapshot_memory(struct bbc_struct* p_bbc,
+                    struct snapshot_struct* p_snapshot) {
+  uint32_t i;
+  uint8_t romsel = p_bbc->romsel;
+  uint8_t acccon = p_bbc->acccon;
+  uint8_t is_extended_rom_addressing = p_bbc->is_extended_rom_addressing;
+  uint16_t sideways_ram_mask = 0;
+  struct cpu_driver* p_cpu_driver = p_bbc->p_cpu_driver;
+
+  for (i = 0; i < k_bbc_num_roms; ++i) {
+    if (p_bbc->is_sideways_ram_bank[i]) {
+      sideways_ram_mask |= (1 << i);
+    }
+  }
+
+  SNAPSHOT_FIELD(p_snapshot, romsel);
+  SNAPSHOT_FIELD(p_snapshot, acccon);
+  SNAPSHOT_FIELD(p_snapshot, is_extended_rom_addressing);
+  SNAPSHOT_FIELD(p_snapshot, sideways_ram_mask);
+
+  /* A state file may come from a run with more sideways RAM set up. ROM
+   * contents aren't saved, so the same ROMs are assumed.
+   */
+  if (snapshot_is_load(p_snapshot)) {
+    if (is_extended_rom_addressing) {
+      bbc_enable_extended_rom_addressing(p_bbc);
+    }
+    for (i = 0; i < k_bbc_num_roms; ++i) {
+      if ((sideways_ram_mask & (1 << i)) && !p_bbc->is_sideways_ram_bank[i]) {
+        bbc_make_sideways_ram(p_bbc, i);
+      }
+    }
+  }
+
+  /* On load, go through the normal paging paths first so that the memory
+   * mappings and callback ranges are right. The paged contents are then
+   * overwritten below.
+   */
+  if (snapshot_is_load(p_snapshot)) {
+    p_bbc->is_romsel_invalidated = 1;
+    bbc_sideways_select(p_bbc, romsel);
+    if (p_bbc->is_master) {
+      (void) bbc_set_acccon(p_bbc, acccon);
+    }
+  }
+
+  snapshot_io(p_snapshot, p_bbc->p_mem_raw, k_6502_addr_space_size);
+  for (i = 0; i < k_bbc_num_roms; ++i) {
+    if (!(sideways_ram_mask & (1 << i))) {
+      continue;
+    }
+    snapshot_io(p_snapshot,
+                (p_bbc->p_mem_sideways + (i * k_bbc_rom_size)),
+                k_bbc_rom_size);
+  }
+  if (p_bbc->is_master) {
+    snapshot_io(p_snapshot, p_bbc->p_mem_lynne, k_bbc_lynne_size);
+    snapshot_io(p_snapshot, p_bbc->p_mem_hazel, k_bbc_hazel_size);
+    snapshot_io(p_snapshot, p_bbc->p_mem_andy, k_bbc_andy_size);
+  }
+
+  if (snapshot_is_load(p_snapshot)) {
+    p_cpu_driver->p_funcs->memory_range_invalidate(p_cpu_driver,
+                                                   0,
+                                                   k_6502_addr_space_size);
+  }
+}
+
+static void
+bbc_snapshot_machine(struct bbc_struct* p_bbc,
+                     struct snapshot_struct* p_snapshot) {
+  uint8_t config[3];
+  uint8_t saved_config[3];
+  uint8_t has_autoboot_timer = (p_bbc->timer_id_autoboot != -1);
+  struct timing_struct* p_timing = p_bbc->p_timing;
+
+  /* The layout of everything else depends on the machine model. */
+  config[0] = p_bbc->is_master;
+  config[1] = (p_bbc->p_intel_fdc != NULL);
+  config[2] = (p_bbc->p_wd_fdc != NULL);
+  (void) memcpy(saved_config, config, sizeof(config));
+  SNAPSHOT_FIELD(p_snapshot, saved_config);
+  if (memcmp(saved_config, config, sizeof(config))) {
+    util_bail("snapshot is for a different machine model");
+  }
+
+  SNAPSHOT_FIELD(p_snapshot, p_bbc->IC32);
+
+  SNAPSHOT_FIELD(p_snapshot, has_autoboot_timer);
+  if (snapshot_is_load(p_snapshot)) {
+    if (has_autoboot_timer) {
+      bbc_register_autoboot_timer(p_bbc);
+    } else if ((p_bbc->timer_id_autoboot != -1) &&
+               timing_timer_is_running(p_timing, p_bbc->timer_id_autoboot)) {
+      (void) timing_stop_timer(p_timing, p_bbc->timer_id_autoboot);
+    }
+  }
+  if (has_autoboot_timer) {
+    (void) timing_snapshot_timer(p_timing,
+                                 p_bbc->timer_id_autoboot,
+                                 p_snapshot);
+  }
+}
+
+void
+bbc_snapshot(struct bbc_struct* p_bbc, struct snapshot_struct* p_snapshot) {
+  /* Teletext and render aren't included, for the same reason they aren't
+   * power on reset.
+   */
+  snapshot_begin_chunk(p_snapshot, "BBC ");
+  bbc_snapshot_machine(p_bbc, p_snapshot);
+  snapshot_end_chunk(p_snapshot);
+  snapshot_begin_chunk(p_snapshot, "TIME");
+  timing_snapshot(p_bbc->p_timing, p_snapshot);
+  snapshot_end_chunk(p_snapshot);
+  snapshot_begin_chunk(p_snapshot, "MEM ");
+  bbc_snapshot_memory(p_bbc, p_snapshot);
+  snapshot_end_chunk(p_snapshot);
+  snapshot_begin_chunk(p_snapshot, "6502");
+  state_6502_snapshot(p_bbc->p_state_6502, p_snapshot);
+  snapshot_end_chunk(p_snapshot);
+  snapshot_begin_chunk(p_snapshot, "SVIA");
+  via_snapshot(p_bbc->p_system_via, p_snapshot);
+  snapshot_end_chunk(p_snapshot);
+  snapshot_begin_chunk(p_snapshot, "UVIA");
+  via_snapshot(p_bbc->p_user_via, p_snapshot);
+  snapshot_end_chunk(p_snapshot);
+  snapshot_begin_chunk(p_snapshot, "SND ");
+  sound_snapshot(p_bbc->p_sound, p_snapshot);
+  snapshot_end_chunk(p_snapshot);
+  snapshot_begin_chunk(p_snapshot, "ACIA");
+  mc6850_snapshot(p_bbc->p_serial, p_snapshot);
+  snapshot_end_chunk(p_snapshot);
+  snapshot_begin_chunk(p_snapshot, "SULA");
+  serial_ula_snapshot(p_bbc->p_serial_ula, p_snapshot);
+  snapshot_end_chunk(p_snapshot);
+  snapshot_begin_chunk(p_snapshot, "TAPE");
+  tape_snapshot(p_bbc->p_tape, p_snapshot);
+  snapshot_end_chunk(p_snapshot);
+  snapshot_begin_chunk(p_snapshot, "FDC ");
+  if (p_bbc->p_intel_fdc != NULL) {
+    intel_fdc_snapshot(p_bbc->p_intel_fdc, p_snapshot);
+  }
+  if (p_bbc->p_wd_fdc != NULL) {
+    wd_fdc_snapshot(p_bbc->p_wd_fdc, p_snapshot);
+  }
+  snapshot_end_chunk(p_snapshot);
+  snapshot_begin_chunk(p_snapshot, "DRV0");
+  disc_drive_snapshot(p_bbc->p_drive_0, p_snapshot);
+  snapshot_end_chunk(p_snapshot);
+  snapshot_begin_chunk(p_snapshot, "DRV1");
+  disc_drive_snapshot(p_bbc->p_drive_1, p_snapshot);
+  snapshot_end_chunk(p_snapshot);
+  snapshot_begin_chunk(p_snapshot, "KEYB");
+  keyboard_snapshot(p_bbc->p_keyboard, p_snapshot);
+  snapshot_end_chunk(p_snapshot);
+  snapshot_begin_chunk(p_snapshot, "VIDE");
+  video_snapshot(p_bbc->p_video, p_snapshot);
+  snapshot_end_chunk(p_snapshot);
+  snapshot_begin_chunk(p_snapshot, "ADC ");
+  adc_snapshot(p_bbc->p_adc, p_snapshot);
+  snapshot_end_chunk(p_snapshot);
+  if (p_bbc->p_cmos != NULL) {
+    snapshot_begin_chunk(p_snapshot, "CMOS");
+    cmos_snapshot(p_bbc->p_cmos, p_snapshot);
+    snapshot_end_chunk(p_snapshot);
+  }
+}
+
+static void
+bbc_take_snapshot(struct bbc_struct* p_bbc) {
+  struct snapshot_struct* p_snapshot;
+  uint32_t index = p_bbc->snapshot_next;
+
+  /* The capture or replay may have moved on to rewinding. */
+  if (!keyboard_can_rewind(p_bbc->p_keyboard)) {
+    return;
+  }
+
+  p_snapshot = p_bbc->p_snapshots[index];
+  if (p_snapshot == NULL) {
+    p_snapshot = snapshot_create();
+    p_bbc->p_snapshots[index] = p_snapshot;
+  }
+
+  snapshot_start_save(p_snapshot);
+  bbc_snapshot(p_bbc, p_snapshot);
+  snapshot_finish(p_snapshot);
+  p_bbc->p_snapshot_cycles[index] =
+      timing_get_total_timer_ticks(p_bbc->p_timing);
+
+  p_bbc->snapshot_next = ((index + 1) % p_bbc->snapshot_count);
+  if (p_bbc->snapshot_used < p_bbc->snapshot_count) {
+    p_bbc->snapshot_used++;
+  }
+}
+
+static void
+bbc_restore_snapshot(struct bbc_struct* p_bbc) {
+  struct snapshot_struct* p_snapshot =
+      p_bbc->p_snapshots[p_bbc->snapshot_restore_index];
+
+  snapshot_start_load(p_snapshot);
+  bbc_snapshot(p_bbc, p_snapshot);
+  snapshot_finish(p_snapshot);
+}
+
 static void
 bbc_do_reset_callback(void* p, uint32_t flags) {
   struct bbc_struct* p_bbc = (struct bbc_struct*) p;
@@ -1229,14 +1486,30 @@ bbc_do_reset_callback(void* p, uint32_t flags) {
   if (flags & k_cpu_flag_hard_reset) {
     bbc_power_on_reset(p_bbc);
   }
+  if (flags & k_cpu_flag_restore) {
+    bbc_restore_snapshot(p_bbc);
+  }
   if (flags & k_cpu_flag_replay) {
-    keyboard_rewind(p_bbc->p_keyboard, p_bbc->rewind_to_cycles);
+    uint64_t ticks = timing_get_total_timer_ticks(p_bbc->p_timing);
+    uint64_t stop_cycles = 0;
+    if (p_bbc->rewind_to_cycles > ticks) {
+      stop_cycles = (p_bbc->rewind_to_cycles - ticks);
+    }
+    keyboard_rewind(p_bbc->p_keyboard, stop_cycles);
+    debug_rewound(p_bbc->p_debug);
+  }
+  if (flags & k_cpu_flag_snapshot) {
+    bbc_take_snapshot(p_bbc);
   }
 
   p_cpu_driver->p_funcs->apply_flags(
       p_cpu_driver,
       0,
-      (k_cpu_flag_soft_reset | k_cpu_flag_hard_reset | k_cpu_flag_replay));
+      (flags & (k_cpu_flag_soft_reset |
+                k_cpu_flag_hard_reset |
+                k_cpu_flag_replay |
+                k_cpu_flag_snapshot |
+                k_cpu_flag_restore)));
 }
 
 static void
@@ -1276,6 +1549,12 @@ bbc_set_fast_flag(struct bbc_struct* p_bbc, int is_fast) {
   bbc_set_fast_mode_callback((void*) p_bbc, is_fast);
 }
 
+void
+bbc_reset_host_load(struct bbc_struct* p_bbc) {
+  /* The next slow mode wakeup starts measuring afresh. */
+  p_bbc->run_start_time_us = 0;
+}
+
 static void
 bbc_reset_callback_baselines(struct bbc_struct* p_bbc) {
   /* Selects 0xFC00 - 0xFFFF which is broader than the needed 0xFC00 - 0xFEFF
@@ -1401,6 +1680,18 @@ bbc_create(int mode,
   p_bbc->handle_channel_write_client = -1;
   p_bbc->timer_id_autoboot = -1;
 
+  p_bbc->snapshot_cycles = k_bbc_default_snapshot_cycles;
+  (void) util_get_u32_option(&p_bbc->snapshot_cycles,
+                             p_opt_flags,
+                             "bbc:snapshot-cycles=");
+  p_bbc->snapshot_count = k_bbc_default_snapshot_count;
+  (void) util_get_u32_option(&p_bbc->snapshot_count,
+                             p_opt_flags,
+                             "bbc:snapshot-count=");
+  if (p_bbc->snapshot_count == 0) {
+    p_bbc->snapshot_cycles = 0;
+  }
+
   p_bbc->do_video_memory_sync = 1;
   if (util_has_option(p_opt_flags, "video:no-memory-sync")) {
     p_bbc->do_video_memory_sync = 0;
@@ -1409,6 +1700,7 @@ bbc_create(int mode,
   p_bbc->p_sleeper = os_time_create_sleeper();
   p_bbc->last_time_us = 0;
   p_bbc->last_time_us_perf = 0;
+  p_bbc->run_start_time_us = 0;
   p_bbc->last_cycles = 0;
   p_bbc->last_frames = 0;
   p_bbc->last_crtc_advances = 0;
@@ -1416,6 +1708,11 @@ bbc_create(int mode,
   p_bbc->num_hw_reg_hits = 0;
   p_bbc->log_speed = util_has_option(p_log_flags, "perf:speed");
   p_bbc->log_timestamp = util_has_option(p_log_flags, "perf:timestamp");
+  /* Per-timer stats are reported alongside the speed line. */
+  p_bbc->log_timers = util_has_option(p_log_flags, "perf:timers");
+  if (p_bbc->log_timers) {
+    p_bbc->log_speed = 1;
+  }
 
   bbc_reset_callback_baselines(p_bbc);
 
@@ -1543,6 +1840,7 @@ bbc_create(int mode,
 
   p_timing = timing_create(cpu_scale_factor);
   p_bbc->p_timing = p_timing;
+  timing_set_instrumented(p_timing, p_bbc->log_timers);
 
   p_state_6502 = state_6502_create(p_timing, p_bbc->p_mem_read);
   p_bbc->p_state_6502 = p_state_6502;
@@ -1664,6 +1962,17 @@ bbc_destroy(struct bbc_struct* p_bbc) {
 
   p_cpu_driver->p_funcs->destroy(p_cpu_driver);
 
+  if (p_bbc->p_snapshots != NULL) {
+    uint32_t i;
+    for (i = 0; i < p_bbc->snapshot_count; ++i) {
+      if (p_bbc->p_snapshots[i] != NULL) {
+        snapshot_destroy(p_bbc->p_snapshots[i]);
+      }
+    }
+    util_free(p_bbc->p_snapshots);
+    util_free(p_bbc->p_snapshot_cycles);
+  }
+
   debug_destroy(p_bbc->p_debug);
   serial_ula_destroy(p_bbc->p_serial_ula);
   mc6850_destroy(p_bbc->p_serial);
@@ -1689,6 +1998,9 @@ bbc_destroy(struct bbc_struct* p_bbc) {
   disc_drive_destroy(p_bbc->p_drive_0);
   disc_drive_destroy(p_bbc->p_drive_1);
   state_6502_destroy(p_bbc->p_state_6502);
+  if (p_bbc->log_timers) {
+    timing_log_timer_totals(p_bbc->p_timing);
+  }
   timing_destroy(p_bbc->p_timing);
   os_alloc_free_mapping(p_bbc->p_mapping_raw);
   os_alloc_free_mapping(p_bbc->p_mapping_read);
@@ -1805,6 +2117,7 @@ bbc_power_on_memory_reset(struct bbc_struct* p_bbc) {
   p_cpu_driver->p_funcs->memory_range_invalidate(p_cpu_driver,
                                                  0,
                                                  k_6502_addr_space_size);
+  p_cpu_driver->p_funcs->power_on_reset(p_cpu_driver);
 }
 
 static void
@@ -1828,6 +2141,9 @@ bbc_power_on_reset(struct bbc_struct* p_bbc) {
     }
   }
 
+  /* Any snapshots are from a different timeline now. */
+  p_bbc->snapshot_used = 0;
+
   timing_reset_total_timer_ticks(p_timing);
   bbc_power_on_memory_reset(p_bbc);
   bbc_power_on_other_reset(p_bbc);
@@ -2159,13 +2475,18 @@ bbc_do_log_speed(struct bbc_struct* p_bbc, uint64_t curr_time_us) {
 
   log_do_log(k_log_perf,
              k_log_info,
-             " %.1f fps, %.1f Mhz, %.1f crtc/s %.1f hw/s %.1f c1/s %.1f c2/s",
+             " %.1f fps, %.1f Mhz, %.1f crtc/s %.1f hw/s %.1f c1/s %.1f c2/s"
+             " skip %"PRIu32,
              fps,
              mhz,
              crtc_ps,
              hw_reg_ps,
              c1_ps,
-             c2_ps);
+             c2_ps,
+             video_get_frames_skip(p_video));
+  if (p_bbc->log_timers) {
+    timing_log_timer_rates(p_bbc->p_timing, delta_s);
+  }
 
   p_bbc->last_cycles = curr_cycles;
   p_bbc->last_frames = curr_frames;
@@ -2178,7 +2499,9 @@ bbc_do_log_speed(struct bbc_struct* p_bbc, uint64_t curr_time_us) {
 
 int
 bbc_replay_seek(struct bbc_struct* p_bbc, uint64_t seek_target) {
+  uint32_t i;
   struct cpu_driver* p_cpu_driver = p_bbc->p_cpu_driver;
+  uint32_t flags = (k_cpu_flag_hard_reset | k_cpu_flag_replay);
 
   if (!keyboard_can_rewind(p_bbc->p_keyboard)) {
     return 0;
@@ -2186,10 +2509,23 @@ bbc_replay_seek(struct bbc_struct* p_bbc, uint64_t seek_target) {
 
   p_bbc->rewind_to_cycles = seek_target;
 
-  p_cpu_driver->p_funcs->apply_flags(
-      p_cpu_driver,
-      (k_cpu_flag_hard_reset | k_cpu_flag_replay),
-      0);
+  /* Restore the most recent snapshot at or before the target, and only replay
+   * from there. Newer snapshots are dropped; they'd be from the timeline being
+   * abandoned.
+   */
+  for (i = 0; i < p_bbc->snapshot_used; ++i) {
+    uint32_t index = (p_bbc->snapshot_next + p_bbc->snapshot_count - 1);
+    index %= p_bbc->snapshot_count;
+    if (p_bbc->p_snapshot_cycles[index] <= seek_target) {
+      p_bbc->snapshot_restore_index = index;
+      flags = (k_cpu_flag_restore | k_cpu_flag_replay);
+      break;
+    }
+    p_bbc->snapshot_next = index;
+  }
+  p_bbc->snapshot_used -= i;
+
+  p_cpu_driver->p_funcs->apply_flags(p_cpu_driver, flags, 0);
 
   return 1;
 }
@@ -2283,6 +2619,13 @@ bbc_cycles_timer_callback(void* p) {
     cycles_next_run = p_bbc->cycles_per_run_normal;
     delta_us = (1000000 / p_bbc->wakeup_rate);
 
+    /* Time spent emulating since the last wait, i.e. host load. */
+    if (p_bbc->run_start_time_us != 0) {
+      video_apply_host_load(p_bbc->p_video,
+                            (curr_time_us - p_bbc->run_start_time_us),
+                            delta_us);
+    }
+
     /* If sound is active, we use that as a source of timed wait, otherwise it's
      * a dedicated sleep.
      */
@@ -2296,6 +2639,7 @@ bbc_cycles_timer_callback(void* p) {
       /* This may adjust p_bbc->last_time_us to maintain smooth timing. */
       bbc_do_sleep(p_bbc, last_time_us, curr_time_us, delta_us);
     }
+    p_bbc->run_start_time_us = os_time_get_us();
   } else {
     /* Fast mode.
      * Fast mode is where the system executes as fast as the host CPU can
@@ -2303,6 +2647,7 @@ bbc_cycles_timer_callback(void* p) {
      * Effective system CPU rates of many GHz are likely to be obtained.
      */
     cycles_next_run = p_bbc->cycles_per_run_fast;
+    p_bbc->run_start_time_us = 0;
     /* TODO: limit delta_us max size in case system was paused? */
     delta_us = (curr_time_us - last_time_us);
   }
@@ -2344,6 +2689,7 @@ bbc_start_timer_tick(struct bbc_struct* p_bbc) {
   struct timing_struct* p_timing = p_bbc->p_timing;
 
   p_bbc->timer_id_cycles = timing_register_timer(p_timing,
+                                                 "bbc_cycles",
                                                  bbc_cycles_timer_callback,
                                                  p_bbc);
 
@@ -2359,7 +2705,7 @@ bbc_start_timer_tick(struct bbc_struct* p_bbc) {
    * p_bbc->wakeup_rate. This will ensure reasonable timer resolution and
    * excellent keyboard response.
    */
-  if (p_bbc->debug_flag) {
+  if (p_bbc->debug_flag && !debug_is_jit_sparse(p_bbc->p_debug)) {
     /* Assume 20Mhz speed or so. */
     speed = (20ull * 1000 * 1000);
   } else {
@@ -2383,6 +2729,48 @@ bbc_start_timer_tick(struct bbc_struct* p_bbc) {
   p_bbc->last_time_us = os_time_get_us();
 }
 
+static void
+bbc_snapshot_timer_callback(void* p) {
+  struct bbc_struct* p_bbc = (struct bbc_struct*) p;
+  struct cpu_driver* p_cpu_driver = p_bbc->p_cpu_driver;
+
+  (void) timing_set_timer_value(p_bbc->p_timing,
+                                p_bbc->timer_id_snapshot,
+                                p_bbc->snapshot_cycles);
+
+  /* Snapshots are only useful if there's a capture or replay to resume. */
+  if (!keyboard_can_rewind(p_bbc->p_keyboard)) {
+    return;
+  }
+
+  /* Let the CPU driver take the snapshot at an instruction boundary. */
+  p_cpu_driver->p_funcs->apply_flags(p_cpu_driver, k_cpu_flag_snapshot, 0);
+}
+
+static void
+bbc_start_snapshots(struct bbc_struct* p_bbc) {
+  struct timing_struct* p_timing = p_bbc->p_timing;
+  uint32_t snapshot_count = p_bbc->snapshot_count;
+
+  if (p_bbc->snapshot_cycles == 0) {
+    return;
+  }
+  if (!keyboard_can_rewind(p_bbc->p_keyboard)) {
+    return;
+  }
+
+  p_bbc->p_snapshots =
+      util_mallocz(snapshot_count * sizeof(struct snapshot_struct*));
+  p_bbc->p_snapshot_cycles = util_mallocz(snapshot_count * sizeof(uint64_t));
+  p_bbc->timer_id_snapshot = timing_register_timer(p_timing,
+                                                   "bbc_snapshot",
+                                                   bbc_snapshot_timer_callback,
+                                                   p_bbc);
+  (void) timing_start_timer_with_value(p_timing,
+                                       p_bbc->timer_id_snapshot,
+                                       p_bbc->snapshot_cycles);
+}
+
 static void*
 bbc_cpu_thread(void* p) {
   int exited;
@@ -2392,6 +2780,7 @@ bbc_cpu_thread(void* p) {
   struct cpu_driver* p_cpu_driver = p_bbc->p_cpu_driver;
 
   bbc_start_timer_tick(p_bbc);
+  bbc_start_snapshots(p_bbc);
 
   /* Set up initial fast mode correctly. */
   bbc_set_fast_flag(p_bbc, p_bbc->fast_flag);
@@ -2403,6 +2792,7 @@ bbc_cpu_thread(void* p) {
 
   p_bbc->running = 0;
   p_bbc->exit_value = p_cpu_driver->p_funcs->get_exit_value(p_cpu_driver);
+  debug_run_finished(p_bbc->p_debug);
 
   message.data[0] = k_message_exited;
   bbc_cpu_send_message(p_bbc, &message);
@@ -2513,29 +2903,17 @@ void
 bbc_set_stop_cycles(struct bbc_struct* p_bbc, uint64_t cycles) {
   struct timing_struct* p_timing = p_bbc->p_timing;
   uint32_t id = timing_register_timer(p_bbc->p_timing,
+                                      "bbc_stop_cycles",
                                       bbc_stop_cycles_timer_callback,
                                       p_bbc);
   p_bbc->timer_id_stop_cycles = id;
   (void) timing_start_timer_with_value(p_timing, id, cycles);
 }
 
-static void
-bbc_autoboot_timer_callback(void* p) {
-  struct bbc_struct* p_bbc = (struct bbc_struct*) p;
-  struct keyboard_struct* p_keyboard = p_bbc->p_keyboard;
-
-  (void) timing_stop_timer(p_bbc->p_timing, p_bbc->timer_id_autoboot);
-
-  keyboard_system_key_released(p_keyboard, k_keyboard_key_shift_left);
-}
-
 void
 bbc_set_autoboot(struct bbc_struct* p_bbc, int autoboot_flag) {
-  if (autoboot_flag && (p_bbc->timer_id_autoboot == -1)) {
-    p_bbc->timer_id_autoboot =
-        timing_register_timer(p_bbc->p_timing,
-                              bbc_autoboot_timer_callback,
-                              p_bbc);
+  if (autoboot_flag) {
+    bbc_register_autoboot_timer(p_bbc);
   }
   p_bbc->autoboot_flag = autoboot_flag;
 }
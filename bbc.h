@@ -9,6 +9,7 @@ struct cpu_driver;
 struct keyboard_struct;
 struct serial_struct;
 struct serial_ula_struct;
+struct snapshot_struct;
 struct sound_struct;
 struct state_6502;
 struct via_struct;
@@ -66,6 +67,8 @@ void bbc_save_rom(struct bbc_struct* p_bbc,
                   uint8_t* p_dest);
 void bbc_make_sideways_ram(struct bbc_struct* p_bbc, uint8_t index);
 uint8_t bbc_get_romsel(struct bbc_struct* p_bbc);
+/* The sideways bank paged in at 0x8000, after any ROMSEL aliasing. */
+uint8_t bbc_get_current_bank(struct bbc_struct* p_bbc);
 uint8_t bbc_get_acccon(struct bbc_struct* p_bbc);
 void bbc_sideways_select(struct bbc_struct* p_bbc, uint8_t index);
 void bbc_add_disc(struct bbc_struct* p_bbc,
@@ -91,6 +94,10 @@ void bbc_run_async(struct bbc_struct* p_bbc);
 uint32_t bbc_get_run_result(struct bbc_struct* p_bbc);
 int bbc_check_do_break(struct bbc_struct* p_bbc);
 int bbc_replay_seek(struct bbc_struct* p_bbc, uint64_t seek_target);
+/* Saves or loads the full machine state, depending on the snapshot's mode.
+ * Must be called at an instruction boundary, or before the CPU starts.
+ */
+void bbc_snapshot(struct bbc_struct* p_bbc, struct snapshot_struct* p_snapshot);
 
 struct state_6502* bbc_get_6502(struct bbc_struct* p_bbc);
 struct via_struct* bbc_get_sysvia(struct bbc_struct* p_bbc);
@@ -130,6 +137,10 @@ int bbc_get_print_flag(struct bbc_struct* p_bbc);
 
 int bbc_get_fast_flag(struct bbc_struct* p_bbc);
 void bbc_set_fast_flag(struct bbc_struct* p_bbc, int is_fast);
+/* Called when emulation is paused, e.g. in the debugger, so that the pause
+ * isn't measured as host load for video:frames-skip=auto.
+ */
+void bbc_reset_host_load(struct bbc_struct* p_bbc);
 
 void bbc_set_channel_handles(struct bbc_struct* p_bbc,
                              intptr_t handle_channel_read_bbc,
@@ -138,7 +149,7 @@ void bbc_set_channel_handles(struct bbc_struct* p_bbc,
                              intptr_t handle_channel_write_client);
 
 struct bbc_message {
-  uint64_t data[5];
+  uint64_t data[6];
 };
 void bbc_client_send_message(struct bbc_struct* p_bbc,
                              struct bbc_message* p_message);
@@ -2,6 +2,7 @@
 
 #include "bbc_options.h"
 #include "log.h"
+#include "snapshot.h"
 #include "util.h"
 
 #include <assert.h>
@@ -129,3 +130,12 @@ cmos_update_external_inputs(struct cmos_struct* p_cmos,
                p_cmos->read);
   }
 }
+
+void
+cmos_snapshot(struct cmos_struct* p_cmos, struct snapshot_struct* p_snapshot) {
+  SNAPSHOT_FIELD(p_snapshot, p_cmos->enabled);
+  SNAPSHOT_FIELD(p_snapshot, p_cmos->address_strobe);
+  SNAPSHOT_FIELD(p_snapshot, p_cmos->data);
+  SNAPSHOT_FIELD(p_snapshot, p_cmos->read);
+  SNAPSHOT_FIELD(p_snapshot, p_cmos->addr);
+}
@@ -6,6 +6,7 @@
 struct cmos_struct;
 
 struct bbc_options;
+struct snapshot_struct;
 
 struct cmos_struct* cmos_create(struct bbc_options* p_options);
 void cmos_destroy(struct cmos_struct* p_cmos);
@@ -16,4 +17,7 @@ void cmos_update_external_inputs(struct cmos_struct* p_cmos,
                                  uint8_t port_a,
                                  uint8_t IC32);
 
+void cmos_snapshot(struct cmos_struct* p_cmos,
+                   struct snapshot_struct* p_snapshot);
+
 #endif /* BEEBJIT_CMOS_H */
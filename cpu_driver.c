@@ -19,6 +19,13 @@ cpu_driver_memory_range_invalidate_dummy(struct cpu_driver* p_cpu_driver,
   (void) len;
 }
 
+static void
+cpu_driver_debug_invalidate_all_default(struct cpu_driver* p_cpu_driver) {
+  p_cpu_driver->p_funcs->memory_range_invalidate(p_cpu_driver,
+                                                 0,
+                                                 k_6502_addr_space_size);
+}
+
 static char*
 cpu_driver_get_address_info_dummy(struct cpu_driver* p_cpu_driver,
                                   uint16_t addr) {
@@ -43,6 +50,18 @@ cpu_driver_housekeeping_tick_dummy(struct cpu_driver* p_cpu_driver) {
   (void) p_cpu_driver;
 }
 
+static void
+cpu_driver_power_on_reset_dummy(struct cpu_driver* p_cpu_driver) {
+  (void) p_cpu_driver;
+}
+
+static void
+cpu_driver_profile_dummy(struct cpu_driver* p_cpu_driver,
+                         const char* p_file_name) {
+  (void) p_cpu_driver;
+  (void) p_file_name;
+}
+
 static void
 cpu_driver_set_reset_callback_default(
     struct cpu_driver* p_cpu_driver,
@@ -194,6 +213,7 @@ cpu_driver_alloc(int mode,
   p_funcs->get_exit_value = cpu_driver_get_exit_value_default;
   p_funcs->set_exit_value = cpu_driver_set_exit_value_default;
   p_funcs->memory_range_invalidate = cpu_driver_memory_range_invalidate_dummy;
+  p_funcs->debug_invalidate_all = cpu_driver_debug_invalidate_all_default;
   p_funcs->get_address_info = cpu_driver_get_address_info_dummy;
   p_funcs->get_custom_counters = cpu_driver_get_custom_counters_dummy;
   if (is_65c12) {
@@ -202,6 +222,9 @@ cpu_driver_alloc(int mode,
     p_funcs->get_opcode_maps = cpu_driver_get_6502_opcode_maps;
   }
   p_funcs->housekeeping_tick = cpu_driver_housekeeping_tick_dummy;
+  p_funcs->power_on_reset = cpu_driver_power_on_reset_dummy;
+  p_funcs->load_profile = cpu_driver_profile_dummy;
+  p_funcs->save_profile = cpu_driver_profile_dummy;
 
   return p_cpu_driver;
 }
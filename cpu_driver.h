@@ -22,6 +22,8 @@ enum {
   k_cpu_flag_soft_reset = 2,
   k_cpu_flag_hard_reset = 4,
   k_cpu_flag_replay = 8,
+  k_cpu_flag_snapshot = 16,
+  k_cpu_flag_restore = 32,
 };
 
 struct cpu_driver_funcs {
@@ -44,6 +46,10 @@ struct cpu_driver_funcs {
   void (*memory_range_invalidate)(struct cpu_driver* p_cpu_driver,
                                   uint16_t addr,
                                   uint32_t len);
+  /* Like memory_range_invalidate() over all memory, but called by the
+   * debugger, possibly from within the code being invalidated.
+   */
+  void (*debug_invalidate_all)(struct cpu_driver* p_cpu_driver);
   char* (*get_address_info)(struct cpu_driver* p_cpu_driver, uint16_t addr);
   void (*get_custom_counters)(struct cpu_driver* p_cpu_driver,
                               uint64_t* p_c1,
@@ -54,6 +60,12 @@ struct cpu_driver_funcs {
                           uint8_t** p_out_opmem,
                           uint8_t** p_out_opcycles);
   void (*housekeeping_tick)(struct cpu_driver* p_cpu_driver);
+  /* Called after power on has reset memory, including the OS ROM. */
+  void (*power_on_reset)(struct cpu_driver* p_cpu_driver);
+  void (*load_profile)(struct cpu_driver* p_cpu_driver,
+                       const char* p_file_name);
+  void (*save_profile)(struct cpu_driver* p_cpu_driver,
+                       const char* p_file_name);
 };
 
 struct cpu_driver_extra {
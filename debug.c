@@ -9,11 +9,13 @@
 #include "expression.h"
 #include "keyboard.h"
 #include "log.h"
+#include "os_alloc.h"
 #include "render.h"
 #include "state.h"
 #include "state_6502.h"
 #include "timing.h"
 #include "util.h"
+#include "util_container.h"
 #include "util_string.h"
 #include "via.h"
 #include "video.h"
@@ -32,11 +34,75 @@
 static const size_t k_max_opcode_len = (13 + 1);
 static const size_t k_max_extra_len = 32;
 enum {
+  /* Must fit the bits of the breakpoint index masks. */
   k_max_break = 16,
 };
 enum {
   k_max_input_len = 1024,
 };
+enum {
+  /* How often, in 2MHz cycles, to look for a pending debugger interrupt when
+   * running with sparse JIT traps.
+   */
+  k_debug_jit_poll_cycles = 20000,
+};
+
+enum {
+  /* Sample counts are indexed by address, with the sideways window at
+   * 0x8000 - 0xBFFF split out per bank after the first 64k.
+   */
+  k_debug_sample_num_keys = (k_6502_addr_space_size + (16 * 0x4000)),
+  k_debug_sample_max_frames = 32,
+  k_debug_sample_flat_entries = 32,
+};
+enum {
+  k_debug_trace_default_records = (1024 * 1024),
+  k_debug_trace_max_cycles_delta = 0xFFFF,
+};
+enum {
+  k_debug_trace_irq = 0x01,
+  k_debug_trace_nmi = 0x02,
+  k_debug_trace_has_addr = 0x04,
+  k_debug_trace_branch = 0x08,
+  k_debug_trace_branch_taken = 0x10,
+  k_debug_trace_long_delta = 0x20,
+};
+static const char* k_debug_trace_magic = "BJTRACE1";
+static const uint64_t k_debug_trace_max_long_cycles_delta = 0xFFFFFFFFFFFFull;
+
+/* The execution trace file is this header followed by a ring of fixed size
+ * records. The file is mapped shared so that the last records are still
+ * there to decode after a crash or bail. Values are host endian.
+ */
+struct debug_trace_header {
+  char magic[8];
+  uint32_t record_size;
+  uint32_t is_65c12;
+  uint64_t num_records;
+  uint64_t total_records;
+  uint64_t last_cycles;
+  uint8_t unused[24];
+};
+
+struct debug_trace_record {
+  uint16_t reg_pc;
+  uint8_t opcode;
+  uint8_t operand1;
+  uint8_t operand2;
+  uint8_t reg_a;
+  uint8_t reg_x;
+  uint8_t reg_y;
+  uint8_t reg_s;
+  uint8_t reg_flags;
+  uint16_t addr_6502;
+  uint8_t val;
+  uint8_t info;
+  /* Cycles since the previous record. If that doesn't fit, a long delta
+   * record, holding the delta in reg_pc, addr_6502 and cycles_delta (low to
+   * high), is written first, and this is 0.
+   */
+  uint16_t cycles_delta;
+};
 
 struct debug_breakpoint {
   int is_in_use;
@@ -92,7 +158,39 @@ struct debug_struct {
   /* Breakpointing. */
   int32_t next_or_finish_stop_addr;
   struct debug_breakpoint breakpoints[k_max_break];
-  uint32_t max_breakpoint_used_plus_one;
+  /* Index of enabled breakpoints, one bit per breakpoint, so the per
+   * instruction check only visits breakpoints that could match.
+   */
+  uint16_t breakpoint_exec_masks[k_6502_addr_space_size];
+  uint16_t breakpoint_memory_masks[k_6502_addr_space_size];
+  uint16_t breakpoint_any_exec_mask;
+  uint16_t breakpoint_any_memory_mask;
+  uint16_t breakpoint_memory_range_mask;
+  uint16_t breakpoint_exec_range_mask;
+  /* Sparse JIT traps: the JIT only compiles in debug calls where a breakpoint
+   * could hit, unless we're stepping, tracing, etc.
+   */
+  int is_jit_sparse;
+  int is_jit_trap_all;
+  int is_jit_traps_dirty;
+  /* Cheap per instruction gate for debug_needs_trap(). */
+  int is_any_trap_armed;
+  uint32_t timer_id_jit_poll;
+  /* Binary execution trace. */
+  intptr_t trace_handle;
+  struct os_alloc_mapping* p_trace_mapping;
+  struct debug_trace_header* p_trace_header;
+  struct debug_trace_record* p_trace_records;
+  uint64_t trace_num_records;
+  uint64_t trace_next_record;
+  /* Sampling profiler. */
+  uint32_t sample_cycles;
+  uint32_t timer_id_sample;
+  uint64_t sample_total;
+  uint32_t* p_sample_counts;
+  struct util_tree_struct* p_sample_tree;
+  char* p_sample_stacks_file_name;
+  int is_sample_dumped;
   int64_t temp_storage[16];
   int is_sub_instruction_active;
   uint32_t timer_id_sub_instruction;
@@ -122,6 +220,10 @@ struct debug_struct {
   /* Other. */
   uint8_t warn_at_addr_count[k_6502_addr_space_size];
   int32_t timer_id_debug;
+  /* Cycle count the debug timer is set to break at, or 0. Kept so the timer
+   * can be re-armed after a rewind moves the cycle count backwards.
+   */
+  uint64_t break_at_ticks;
   char previous_commands[k_max_input_len];
 };
 
@@ -151,21 +253,131 @@ debug_clear_breakpoint(struct debug_struct* p_debug, uint32_t i) {
 }
 
 static void
-debug_timer_callback(void* p) {
-  struct debug_struct* p_debug = (struct debug_struct*) p;
-  (void) timing_stop_timer(p_debug->p_timing, p_debug->timer_id_debug);
+debug_sample_key_name(char* p_buf, size_t buf_len, uint32_t key) {
+  if (key < k_6502_addr_space_size) {
+    (void) snprintf(p_buf, buf_len, "%.4"PRIX32, key);
+  } else {
+    key -= k_6502_addr_space_size;
+    (void) snprintf(p_buf,
+                    buf_len,
+                    "rom%"PRIX32":%.4"PRIX32,
+                    (key >> 14),
+                    (0x8000 + (key & 0x3FFF)));
+  }
+}
 
-  s_interrupt_received = 1;
+struct debug_sample_entry {
+  uint32_t key;
+  uint32_t count;
+};
+
+static int
+debug_sort_samples(const void* p_entry1, const void* p_entry2) {
+  uint32_t count1 = ((const struct debug_sample_entry*) p_entry1)->count;
+  uint32_t count2 = ((const struct debug_sample_entry*) p_entry2)->count;
+  if (count1 > count2) {
+    return -1;
+  } else if (count1 < count2) {
+    return 1;
+  }
+  return 0;
 }
 
-void
-debug_init(struct debug_struct* p_debug) {
-  struct cpu_driver* p_cpu_driver = bbc_get_cpu_driver(p_debug->p_bbc);
-  p_cpu_driver->p_funcs->get_opcode_maps(p_cpu_driver,
-                                         &p_debug->p_opcode_types,
-                                         &p_debug->p_opcode_modes,
-                                         &p_debug->p_opcode_mem,
-                                         &p_debug->p_opcode_cycles);
+static struct debug_sample_entry*
+debug_sample_get_sorted(const uint32_t* p_counts, uint32_t* p_num_entries) {
+  /* Returns the sampled keys, most samples first. */
+  uint32_t i;
+  uint32_t num_entries = 0;
+  struct debug_sample_entry* p_entries =
+      util_malloc(k_debug_sample_num_keys * sizeof(struct debug_sample_entry));
+
+  for (i = 0; i < k_debug_sample_num_keys; ++i) {
+    if (p_counts[i] > 0) {
+      p_entries[num_entries].key = i;
+      p_entries[num_entries].count = p_counts[i];
+      num_entries++;
+    }
+  }
+  qsort(p_entries,
+        num_entries,
+        sizeof(struct debug_sample_entry),
+        debug_sort_samples);
+
+  *p_num_entries = num_entries;
+  return p_entries;
+}
+
+static void
+debug_sample_write_stacks(struct util_file* p_file,
+                          struct util_tree_node_struct* p_node,
+                          char* p_path,
+                          size_t path_pos) {
+  uint32_t i;
+  uint32_t num_children = util_tree_node_get_num_children(p_node);
+
+  for (i = 0; i < num_children; ++i) {
+    char count_buf[24];
+    size_t pos = path_pos;
+    struct util_tree_node_struct* p_child =
+        util_tree_node_get_child(p_node, i);
+    int64_t count = util_tree_node_get_int_value(p_child);
+
+    if (pos > 0) {
+      p_path[pos++] = ';';
+    }
+    debug_sample_key_name(&p_path[pos],
+                          16,
+                          (uint32_t) util_tree_node_get_type(p_child));
+    pos += strlen(&p_path[pos]);
+    if (count > 0) {
+      (void) snprintf(count_buf, sizeof(count_buf), " %"PRId64"\n", count);
+      util_file_write(p_file, p_path, pos);
+      util_file_write(p_file, count_buf, strlen(count_buf));
+    }
+    debug_sample_write_stacks(p_file, p_child, p_path, pos);
+  }
+}
+
+static void
+debug_sample_dump(struct debug_struct* p_debug) {
+  uint32_t i;
+  struct debug_sample_entry* p_entries;
+  uint32_t num_entries;
+
+  if ((p_debug->p_sample_counts == NULL) || p_debug->is_sample_dumped) {
+    return;
+  }
+  p_debug->is_sample_dumped = 1;
+
+  p_entries = debug_sample_get_sorted(p_debug->p_sample_counts, &num_entries);
+
+  (void) printf("sample profile: %"PRIu64" samples every %"PRIu32" cycles\n",
+                p_debug->sample_total,
+                p_debug->sample_cycles);
+  for (i = 0; (i < num_entries) && (i < k_debug_sample_flat_entries); ++i) {
+    char key_buf[16];
+    uint32_t count = p_entries[i].count;
+    debug_sample_key_name(key_buf, sizeof(key_buf), p_entries[i].key);
+    (void) printf("%10s: %10"PRIu32" %5.1f%%\n",
+                  key_buf,
+                  count,
+                  ((count * 100.0) / p_debug->sample_total));
+  }
+  util_free(p_entries);
+
+  if (p_debug->p_sample_stacks_file_name != NULL) {
+    /* Collapsed stacks, one "caller;...;pc count" line per stack, as used
+     * by flame graph tools.
+     */
+    char path[(k_debug_sample_max_frames + 1) * 16];
+    struct util_file* p_file =
+        util_file_open(p_debug->p_sample_stacks_file_name, 1, 1);
+    debug_sample_write_stacks(p_file,
+                              util_tree_get_root(p_debug->p_sample_tree),
+                              &path[0],
+                              0);
+    util_file_close(p_file);
+  }
 }
 
 void
@@ -173,9 +385,25 @@ debug_destroy(struct debug_struct* p_debug) {
   disc_tool_destroy(p_debug->p_tool);
   util_string_list_free(p_debug->p_command_strings);
   util_string_list_free(p_debug->p_pending_commands);
+  if (p_debug->p_trace_mapping != NULL) {
+    os_alloc_free_mapping(p_debug->p_trace_mapping);
+    os_alloc_free_memory_handle(p_debug->trace_handle);
+  }
+  if (p_debug->p_sample_counts != NULL) {
+    /* Normally already done when the 6502 stopped. */
+    debug_sample_dump(p_debug);
+    util_free(p_debug->p_sample_counts);
+    util_tree_free(p_debug->p_sample_tree);
+    util_free(p_debug->p_sample_stacks_file_name);
+  }
   free(p_debug);
 }
 
+void
+debug_run_finished(struct debug_struct* p_debug) {
+  debug_sample_dump(p_debug);
+}
+
 volatile int*
 debug_get_interrupt(struct debug_struct* p_debug) {
   (void) p_debug;
@@ -189,26 +417,23 @@ debug_subsystem_active(void* p) {
 }
 
 static void
-debug_print_opcode(struct debug_struct* p_debug,
-                   char* buf,
+debug_print_opcode(char* buf,
                    size_t buf_len,
+                   uint8_t* p_opcode_types,
+                   uint8_t* p_opcode_modes,
                    uint8_t opcode,
                    uint8_t operand1,
                    uint8_t operand2,
                    uint16_t reg_pc,
-                   int do_irq) {
+                   int do_irq,
+                   int is_nmi) {
   uint8_t optype;
   uint8_t opmode;
   const char* opname;
   uint16_t addr;
 
   if (do_irq) {
-    struct state_6502* p_state_6502 = bbc_get_6502(p_debug->p_bbc);
-    /* Very close approximation. It's possible a non-NMI IRQ will be reported
-     * but then an NMI occurs if the NMI is raised within the first few cycles
-     * of the IRQ BRK.
-     */
-    if (state_6502_check_irq_firing(p_state_6502, k_state_6502_irq_nmi)) {
+    if (is_nmi) {
       (void) snprintf(buf, buf_len, "IRQ (NMI)");
     } else {
       (void) snprintf(buf, buf_len, "IRQ (IRQ)");
@@ -216,8 +441,8 @@ debug_print_opcode(struct debug_struct* p_debug,
     return;
   }
 
-  optype = p_debug->p_opcode_types[opcode];
-  opmode = p_debug->p_opcode_modes[opcode];
+  optype = p_opcode_types[opcode];
+  opmode = p_opcode_modes[opcode];
   opname = g_p_opnames[optype];
   addr = (operand1 | (operand2 << 8));
 
@@ -482,13 +707,15 @@ debug_disass(struct debug_struct* p_debug,
           p_cpu_driver, addr_6502);
     }
 
-    debug_print_opcode(p_debug,
-                       opcode_buf,
+    debug_print_opcode(opcode_buf,
                        sizeof(opcode_buf),
+                       p_debug->p_opcode_types,
+                       p_debug->p_opcode_modes,
                        opcode,
                        operand1,
                        operand2,
                        addr_6502,
+                       0,
                        0);
     (void) printf("[%s] %.4"PRIX16": %s\n",
                   p_address_info,
@@ -660,9 +887,6 @@ debug_get_free_breakpoint(struct debug_struct* p_debug) {
     struct debug_breakpoint* p_breakpoint = &p_debug->breakpoints[i];
     if (!p_breakpoint->is_in_use) {
       p_breakpoint->is_in_use = 1;
-      if ((i + 1) > p_debug->max_breakpoint_used_plus_one) {
-        p_debug->max_breakpoint_used_plus_one = (i + 1);
-      }
       return p_breakpoint;
     }
   }
@@ -670,18 +894,283 @@ debug_get_free_breakpoint(struct debug_struct* p_debug) {
   return NULL;
 }
 
-static inline void
-debug_calculate_max_breakpoint(struct debug_struct* p_debug) {
+static void
+debug_set_breakpoint_index_range(uint16_t* p_masks,
+                                 int32_t start,
+                                 int32_t end,
+                                 uint16_t bit) {
+  int32_t addr;
+
+  if (start < 0) {
+    start = 0;
+  }
+  if (end >= k_6502_addr_space_size) {
+    end = (k_6502_addr_space_size - 1);
+  }
+  for (addr = start; addr <= end; ++addr) {
+    p_masks[addr] |= bit;
+  }
+}
+
+static void
+debug_rebuild_breakpoint_index(struct debug_struct* p_debug) {
   uint32_t i;
 
-  p_debug->max_breakpoint_used_plus_one = 0;
+  (void) memset(p_debug->breakpoint_exec_masks,
+                '\0',
+                sizeof(p_debug->breakpoint_exec_masks));
+  (void) memset(p_debug->breakpoint_memory_masks,
+                '\0',
+                sizeof(p_debug->breakpoint_memory_masks));
+  p_debug->breakpoint_any_exec_mask = 0;
+  p_debug->breakpoint_any_memory_mask = 0;
+  p_debug->breakpoint_memory_range_mask = 0;
+  p_debug->breakpoint_exec_range_mask = 0;
 
   for (i = 0; i < k_max_break; ++i) {
     struct debug_breakpoint* p_breakpoint = &p_debug->breakpoints[i];
-    if (p_breakpoint->is_in_use) {
-      p_debug->max_breakpoint_used_plus_one = (i + 1);
+    uint16_t bit = (1 << i);
+    if (!p_breakpoint->is_in_use || !p_breakpoint->is_enabled) {
+      continue;
+    }
+    if (p_breakpoint->has_exec_range) {
+      debug_set_breakpoint_index_range(&p_debug->breakpoint_exec_masks[0],
+                                       p_breakpoint->exec_start,
+                                       p_breakpoint->exec_end,
+                                       bit);
+      p_debug->breakpoint_exec_range_mask |= bit;
+    } else {
+      p_debug->breakpoint_any_exec_mask |= bit;
+    }
+    if (p_breakpoint->has_memory_range) {
+      debug_set_breakpoint_index_range(&p_debug->breakpoint_memory_masks[0],
+                                       p_breakpoint->memory_start,
+                                       p_breakpoint->memory_end,
+                                       bit);
+      p_debug->breakpoint_memory_range_mask |= bit;
+    } else {
+      p_debug->breakpoint_any_memory_mask |= bit;
+    }
+  }
+
+  p_debug->is_jit_traps_dirty = 1;
+}
+
+static int
+debug_is_memory_breakpoint_reachable(struct debug_struct* p_debug,
+                                     uint16_t addr_6502,
+                                     uint32_t breakpoint_mask,
+                                     int is_dynamic_operand) {
+  uint8_t* p_mem_read = p_debug->p_mem_read;
+  uint8_t opcode = p_mem_read[addr_6502];
+  uint8_t opmode = p_debug->p_opcode_modes[opcode];
+  uint8_t optype = p_debug->p_opcode_types[opcode];
+  uint8_t opmem = p_debug->p_opcode_mem[opcode];
+  uint8_t operand1 = p_mem_read[(uint16_t) (addr_6502 + 1)];
+  uint8_t operand2 = p_mem_read[(uint16_t) (addr_6502 + 2)];
+  int32_t start = 0;
+  int32_t end = (k_6502_addr_space_size - 1);
+
+  if (!(opmem & (k_opmem_read_flag | k_opmem_write_flag))) {
+    return 0;
+  }
+
+  /* Work out the widest range of addresses the instruction could touch. A
+   * dynamic operand can change without a recompile, so could touch anything.
+   */
+  if (!is_dynamic_operand) {
+    switch (opmode) {
+    case k_zpg:
+      start = operand1;
+      end = operand1;
+      break;
+    case k_abs:
+      if ((optype == k_jsr) || (optype == k_jmp)) {
+        return 0;
+      }
+      start = (operand1 + (operand2 << 8));
+      end = start;
+      break;
+    case k_zpx:
+    case k_zpy:
+      end = 0xFF;
+      break;
+    case k_abx:
+    case k_aby:
+      start = (operand1 + (operand2 << 8));
+      end = (start + 0xFF);
+      if (end >= k_6502_addr_space_size) {
+        start = 0;
+        end = (k_6502_addr_space_size - 1);
+      }
+      break;
+    default:
+      break;
+    }
+  }
+
+  while (breakpoint_mask != 0) {
+    uint32_t i = __builtin_ctz(breakpoint_mask);
+    struct debug_breakpoint* p_breakpoint = &p_debug->breakpoints[i];
+    breakpoint_mask &= (breakpoint_mask - 1);
+
+    if ((end < p_breakpoint->memory_start) ||
+        (start > p_breakpoint->memory_end)) {
+      continue;
+    }
+    if (p_breakpoint->is_memory_read && (opmem & k_opmem_read_flag)) {
+      return 1;
+    }
+    if (p_breakpoint->is_memory_write && (opmem & k_opmem_write_flag)) {
+      return 1;
     }
   }
+
+  return 0;
+}
+
+int*
+debug_get_any_trap_armed(struct debug_struct* p_debug) {
+  return &p_debug->is_any_trap_armed;
+}
+
+int
+debug_needs_trap(struct debug_struct* p_debug,
+                 uint16_t addr_6502,
+                 int is_dynamic_operand) {
+  uint32_t candidates;
+
+  if (p_debug->is_jit_trap_all) {
+    return 1;
+  }
+  if (addr_6502 == p_debug->next_or_finish_stop_addr) {
+    return 1;
+  }
+
+  candidates = p_debug->breakpoint_exec_masks[addr_6502];
+  candidates |= p_debug->breakpoint_any_exec_mask;
+  if (candidates == 0) {
+    return 0;
+  }
+  if (candidates & p_debug->breakpoint_any_memory_mask) {
+    return 1;
+  }
+
+  return debug_is_memory_breakpoint_reachable(p_debug,
+                                              addr_6502,
+                                              candidates,
+                                              is_dynamic_operand);
+}
+
+int
+debug_is_jit_sparse(struct debug_struct* p_debug) {
+  return p_debug->is_jit_sparse;
+}
+
+static void
+debug_update_jit_traps(struct debug_struct* p_debug) {
+  struct cpu_driver* p_cpu_driver;
+  int is_trap_all;
+
+  if (!p_debug->is_jit_sparse) {
+    return;
+  }
+
+  is_trap_all = (!p_debug->debug_running ||
+                 p_debug->debug_running_print ||
+                 p_debug->stats ||
+                 (p_debug->p_trace_records != NULL) ||
+                 p_debug->is_sub_instruction_active ||
+                 s_interrupt_received);
+  p_debug->is_any_trap_armed = (is_trap_all ||
+                                (p_debug->next_or_finish_stop_addr != -1) ||
+                                p_debug->breakpoint_any_exec_mask ||
+                                p_debug->breakpoint_exec_range_mask);
+  if (is_trap_all == p_debug->is_jit_trap_all) {
+    if (is_trap_all || !p_debug->is_jit_traps_dirty) {
+      return;
+    }
+  }
+
+  p_debug->is_jit_trap_all = is_trap_all;
+  p_debug->is_jit_traps_dirty = 0;
+
+  /* Throw away all the JIT code so it is recompiled with the new traps. */
+  p_cpu_driver = bbc_get_cpu_driver(p_debug->p_bbc);
+  p_cpu_driver->p_funcs->debug_invalidate_all(p_cpu_driver);
+}
+
+static void
+debug_timer_callback(void* p) {
+  struct debug_struct* p_debug = (struct debug_struct*) p;
+  (void) timing_stop_timer(p_debug->p_timing, p_debug->timer_id_debug);
+  p_debug->break_at_ticks = 0;
+
+  s_interrupt_received = 1;
+  debug_update_jit_traps(p_debug);
+}
+
+void
+debug_rewound(struct debug_struct* p_debug) {
+  struct timing_struct* p_timing = p_debug->p_timing;
+  uint32_t timer_id = p_debug->timer_id_debug;
+  uint64_t ticks = timing_get_total_timer_ticks(p_timing);
+
+  if (timing_timer_is_running(p_timing, timer_id)) {
+    (void) timing_stop_timer(p_timing, timer_id);
+  }
+  if (p_debug->break_at_ticks > ticks) {
+    (void) timing_start_timer_with_value(p_timing,
+                                         timer_id,
+                                         (p_debug->break_at_ticks - ticks));
+  } else if (p_debug->break_at_ticks == ticks) {
+    /* Rewound to exactly the break point. */
+    p_debug->break_at_ticks = 0;
+    s_interrupt_received = 1;
+  }
+}
+
+static void
+debug_jit_poll_callback(void* p) {
+  struct debug_struct* p_debug = (struct debug_struct*) p;
+  (void) timing_set_timer_value(p_debug->p_timing,
+                                p_debug->timer_id_jit_poll,
+                                k_debug_jit_poll_cycles);
+
+  if (s_interrupt_received) {
+    debug_update_jit_traps(p_debug);
+  }
+}
+
+void
+debug_init(struct debug_struct* p_debug) {
+  struct cpu_driver* p_cpu_driver = bbc_get_cpu_driver(p_debug->p_bbc);
+  p_cpu_driver->p_funcs->get_opcode_maps(p_cpu_driver,
+                                         &p_debug->p_opcode_types,
+                                         &p_debug->p_opcode_modes,
+                                         &p_debug->p_opcode_mem,
+                                         &p_debug->p_opcode_cycles);
+  if (p_debug->p_trace_header != NULL) {
+    p_debug->p_trace_header->is_65c12 =
+        (p_debug->p_opcode_types == defs_6502_get_65c12_optype_map());
+  }
+
+  /* Sparse traps only make sense for the JIT; the other CPU drivers check in
+   * with the debugger every instruction regardless.
+   */
+  if (!p_debug->debug_active ||
+      (p_cpu_driver->p_extra->type != k_cpu_mode_jit)) {
+    p_debug->is_jit_sparse = 0;
+  }
+  if (p_debug->is_jit_sparse) {
+    p_debug->timer_id_jit_poll = timing_register_timer(p_debug->p_timing,
+                                                       "debug_jit_poll",
+                                                       debug_jit_poll_callback,
+                                                       p_debug);
+    (void) timing_start_timer_with_value(p_debug->p_timing,
+                                         p_debug->timer_id_jit_poll,
+                                         k_debug_jit_poll_cycles);
+  }
 }
 
 static inline void
@@ -689,22 +1178,33 @@ debug_check_breakpoints(struct debug_struct* p_debug,
                         int* p_out_print,
                         int* p_out_stop,
                         uint8_t opmem) {
-  uint32_t i;
-  uint32_t max_breakpoint_used_plus_one = p_debug->max_breakpoint_used_plus_one;
+  uint32_t candidates;
+  uint32_t memory_candidates;
+  int32_t addr_6502 = p_debug->addr_6502;
 
   if (p_debug->reg_pc == p_debug->next_or_finish_stop_addr) {
     *p_out_print = 1;
     *p_out_stop = 1;
   }
 
-  for (i = 0; i < max_breakpoint_used_plus_one; ++i) {
+  candidates = p_debug->breakpoint_exec_masks[p_debug->reg_pc];
+  candidates |= p_debug->breakpoint_any_exec_mask;
+  if (candidates == 0) {
+    return;
+  }
+  memory_candidates = p_debug->breakpoint_any_memory_mask;
+  if ((addr_6502 >= 0) && (addr_6502 < k_6502_addr_space_size)) {
+    memory_candidates |= p_debug->breakpoint_memory_masks[addr_6502];
+  } else {
+    /* Let the range checks below decide. */
+    memory_candidates |= p_debug->breakpoint_memory_range_mask;
+  }
+  candidates &= memory_candidates;
+
+  while (candidates != 0) {
+    uint32_t i = __builtin_ctz(candidates);
     struct debug_breakpoint* p_breakpoint = &p_debug->breakpoints[i];
-    if (!p_breakpoint->is_in_use) {
-      continue;
-    }
-    if (!p_breakpoint->is_enabled) {
-      continue;
-    }
+    candidates &= (candidates - 1);
 
     if (p_breakpoint->has_exec_range) {
       if ((p_debug->reg_pc < p_breakpoint->exec_start) ||
@@ -812,13 +1312,15 @@ debug_dump_stats(struct debug_struct* p_debug) {
     if (!count) {
       continue;
     }
-    debug_print_opcode(p_debug,
-                       opcode_buf,
+    debug_print_opcode(opcode_buf,
                        sizeof(opcode_buf),
+                       p_debug->p_opcode_types,
+                       p_debug->p_opcode_modes,
                        opcode,
                        0,
                        0,
                        0xFFFE,
+                       0,
                        0);
     (void) printf("%14s: %"PRIu64"\n", opcode_buf, count);
   }
@@ -1599,6 +2101,8 @@ debug_setup_breakpoint(struct debug_struct* p_debug) {
   if (p_breakpoint->memory_end == -1) {
     p_breakpoint->memory_end = p_breakpoint->memory_start;
   }
+
+  debug_rebuild_breakpoint_index(p_debug);
 }
 
 static void
@@ -1657,29 +2161,35 @@ debug_print_flags_buf(char* p_flags_buf, uint8_t reg_flags) {
   }
 }
 
-static inline void
-debug_print_status_line(struct debug_struct* p_debug,
-                        struct cpu_driver* p_cpu_driver,
-                        uint8_t opcode,
-                        uint8_t operand1,
-                        uint8_t operand2,
-                        int do_irq,
-                        int branch_taken) {
-  char sub_tag[5];
+static void
+debug_print_status_line_raw(const char* p_address_info,
+                            uint8_t* p_opcode_types,
+                            uint8_t* p_opcode_modes,
+                            uint16_t reg_pc,
+                            uint8_t reg_a,
+                            uint8_t reg_x,
+                            uint8_t reg_y,
+                            uint8_t reg_s,
+                            uint8_t reg_flags,
+                            uint8_t opcode,
+                            uint8_t operand1,
+                            uint8_t operand2,
+                            int do_irq,
+                            int is_nmi,
+                            int32_t addr_6502,
+                            uint8_t val,
+                            int branch_taken) {
   char flags_buf[9];
   char opcode_buf[k_max_opcode_len];
   char extra_buf[k_max_extra_len];
-  const char* p_address_info;
-  uint8_t reg_flags = p_debug->reg_flags;
 
   extra_buf[0] = '\0';
-  if (p_debug->addr_6502 != -1) {
-    uint8_t* p_mem_read = p_debug->p_mem_read;
+  if (addr_6502 != -1) {
     (void) snprintf(extra_buf,
                     sizeof(extra_buf),
                     "[addr=%.4"PRIX16" val=%.2"PRIX8"]",
-                    (uint16_t) p_debug->addr_6502,
-                    p_mem_read[p_debug->addr_6502]);
+                    (uint16_t) addr_6502,
+                    val);
   } else if (branch_taken != -1) {
     if (branch_taken == 0) {
       (void) snprintf(extra_buf, sizeof(extra_buf), "[not taken]");
@@ -1688,17 +2198,62 @@ debug_print_status_line(struct debug_struct* p_debug,
     }
   }
 
-  debug_print_opcode(p_debug,
-                     opcode_buf,
+  debug_print_opcode(opcode_buf,
                      sizeof(opcode_buf),
+                     p_opcode_types,
+                     p_opcode_modes,
                      opcode,
                      operand1,
                      operand2,
-                     p_debug->reg_pc,
-                     do_irq);
+                     reg_pc,
+                     do_irq,
+                     is_nmi);
 
   debug_print_flags_buf(&flags_buf[0], reg_flags);
 
+  (void) printf("[%s] %.4"PRIX16": %-14s "
+                "[A=%.2"PRIX8" X=%.2"PRIX8" Y=%.2"PRIX8" S=%.2"PRIX8" F=%s] "
+                "%s\n",
+                p_address_info,
+                reg_pc,
+                opcode_buf,
+                reg_a,
+                reg_x,
+                reg_y,
+                reg_s,
+                flags_buf,
+                extra_buf);
+}
+
+static inline int
+debug_is_nmi(struct debug_struct* p_debug, int do_irq) {
+  if (!do_irq) {
+    return 0;
+  }
+  /* Very close approximation. It's possible a non-NMI IRQ will be reported
+   * but then an NMI occurs if the NMI is raised within the first few cycles
+   * of the IRQ BRK.
+   */
+  return state_6502_check_irq_firing(p_debug->p_state_6502,
+                                     k_state_6502_irq_nmi);
+}
+
+static inline void
+debug_print_status_line(struct debug_struct* p_debug,
+                        struct cpu_driver* p_cpu_driver,
+                        uint8_t opcode,
+                        uint8_t operand1,
+                        uint8_t operand2,
+                        int do_irq,
+                        int branch_taken) {
+  char sub_tag[5];
+  const char* p_address_info;
+  uint8_t val = 0;
+
+  if (p_debug->addr_6502 != -1) {
+    val = p_debug->p_mem_read[p_debug->addr_6502];
+  }
+
   if (p_cpu_driver != NULL) {
     p_address_info = p_cpu_driver->p_funcs->get_address_info(p_cpu_driver,
                                                              p_debug->reg_pc);
@@ -1711,21 +2266,103 @@ debug_print_status_line(struct debug_struct* p_debug,
     p_address_info = &sub_tag[0];
   }
 
-  (void) printf("[%s] %.4"PRIX16": %-14s "
-                "[A=%.2"PRIX8" X=%.2"PRIX8" Y=%.2"PRIX8" S=%.2"PRIX8" F=%s] "
-                "%s\n",
-                p_address_info,
-                p_debug->reg_pc,
-                opcode_buf,
-                p_debug->reg_a,
-                p_debug->reg_x,
-                p_debug->reg_y,
-                p_debug->reg_s,
-                flags_buf,
-                extra_buf);
+  debug_print_status_line_raw(p_address_info,
+                              p_debug->p_opcode_types,
+                              p_debug->p_opcode_modes,
+                              p_debug->reg_pc,
+                              p_debug->reg_a,
+                              p_debug->reg_x,
+                              p_debug->reg_y,
+                              p_debug->reg_s,
+                              p_debug->reg_flags,
+                              opcode,
+                              operand1,
+                              operand2,
+                              do_irq,
+                              debug_is_nmi(p_debug, do_irq),
+                              p_debug->addr_6502,
+                              val,
+                              branch_taken);
   (void) fflush(stdout);
 }
 
+static inline struct debug_trace_record*
+debug_trace_next_record(struct debug_struct* p_debug) {
+  struct debug_trace_record* p_record =
+      &p_debug->p_trace_records[p_debug->trace_next_record];
+
+  p_debug->p_trace_header->total_records++;
+  p_debug->trace_next_record++;
+  if (p_debug->trace_next_record == p_debug->trace_num_records) {
+    p_debug->trace_next_record = 0;
+  }
+
+  return p_record;
+}
+
+static inline void
+debug_trace_record(struct debug_struct* p_debug,
+                   uint8_t opcode,
+                   uint8_t operand1,
+                   uint8_t operand2,
+                   int do_irq,
+                   int branch_taken) {
+  uint64_t cycles;
+  uint64_t cycles_delta;
+  uint8_t info = 0;
+  struct debug_trace_header* p_header = p_debug->p_trace_header;
+  struct debug_trace_record* p_record;
+
+  cycles = state_6502_get_cycles(p_debug->p_state_6502);
+  cycles_delta = (cycles - p_header->last_cycles);
+  if (cycles_delta > k_debug_trace_max_cycles_delta) {
+    /* 48 bits is years of emulated time; saturate beyond that. */
+    if (cycles_delta > k_debug_trace_max_long_cycles_delta) {
+      cycles_delta = k_debug_trace_max_long_cycles_delta;
+    }
+    p_record = debug_trace_next_record(p_debug);
+    (void) memset(p_record, '\0', sizeof(*p_record));
+    p_record->info = k_debug_trace_long_delta;
+    p_record->reg_pc = cycles_delta;
+    p_record->addr_6502 = (cycles_delta >> 16);
+    p_record->cycles_delta = (cycles_delta >> 32);
+    cycles_delta = 0;
+  }
+
+  p_record = debug_trace_next_record(p_debug);
+
+  if (do_irq) {
+    info |= k_debug_trace_irq;
+    if (debug_is_nmi(p_debug, do_irq)) {
+      info |= k_debug_trace_nmi;
+    }
+  }
+  if (p_debug->addr_6502 != -1) {
+    info |= k_debug_trace_has_addr;
+    p_record->addr_6502 = p_debug->addr_6502;
+    p_record->val = p_debug->p_mem_read[p_debug->addr_6502];
+  } else if (branch_taken != -1) {
+    info |= k_debug_trace_branch;
+    if (branch_taken) {
+      info |= k_debug_trace_branch_taken;
+    }
+  }
+
+  p_record->reg_pc = p_debug->reg_pc;
+  p_record->opcode = opcode;
+  p_record->operand1 = operand1;
+  p_record->operand2 = operand2;
+  p_record->reg_a = p_debug->reg_a;
+  p_record->reg_x = p_debug->reg_x;
+  p_record->reg_y = p_debug->reg_y;
+  p_record->reg_s = p_debug->reg_s;
+  p_record->reg_flags = p_debug->reg_flags;
+  p_record->info = info;
+  p_record->cycles_delta = cycles_delta;
+
+  p_header->last_cycles = cycles;
+}
+
 static void*
 debug_callback_common(struct debug_struct* p_debug,
                       struct cpu_driver* p_cpu_driver,
@@ -1848,6 +2485,18 @@ debug_callback_common(struct debug_struct* p_debug,
     }
   }
 
+  /* Sub-instruction callbacks revisit the same instruction, so only the
+   * instruction boundary is traced.
+   */
+  if ((p_debug->p_trace_records != NULL) && (p_cpu_driver != NULL)) {
+    debug_trace_record(p_debug,
+                       opcode,
+                       operand1,
+                       operand2,
+                       do_irq,
+                       branch_taken);
+  }
+
   debug_check_unusual(p_debug,
                       opcode,
                       operand1,
@@ -1900,6 +2549,8 @@ debug_callback_common(struct debug_struct* p_debug,
     p_debug->debug_running = 0;
   }
 
+  debug_update_jit_traps(p_debug);
+
   if (p_debug->debug_running) {
     return 0;
   }
@@ -1912,6 +2563,8 @@ debug_callback_common(struct debug_struct* p_debug,
 
   p_bbc = p_debug->p_bbc;
   p_tool = p_debug->p_tool;
+  /* Time stopped at the prompt shouldn't count as host load. */
+  bbc_reset_host_load(p_bbc);
   disc_tool_set_disc(p_tool, disc_drive_get_disc(bbc_get_drive_0(p_bbc)));
 
   while (1) {
@@ -2011,6 +2664,7 @@ debug_callback_common(struct debug_struct* p_debug,
     }
 
     if (!strcmp(p_command, "q")) {
+      debug_sample_dump(p_debug);
       exit(0);
     } else if (!strcmp(p_command, "bail")) {
       util_bail("debug bailing!");
@@ -2049,6 +2703,7 @@ debug_callback_common(struct debug_struct* p_debug,
       break;
     } else if (!strcmp(p_command, "n")) {
       p_debug->next_or_finish_stop_addr = (p_debug->reg_pc + oplen);
+      p_debug->is_jit_traps_dirty = 1;
       p_debug->debug_running = 1;
       break;
     } else if (!strcmp(p_command, "f")) {
@@ -2060,6 +2715,7 @@ debug_callback_common(struct debug_struct* p_debug,
       finish_addr++;
       (void) printf("finish will stop at $%.4"PRIX16"\n", finish_addr);
       p_debug->next_or_finish_stop_addr = finish_addr;
+      p_debug->is_jit_traps_dirty = 1;
       p_debug->debug_running = 1;
       break;
     } else if (sscanf(input_buf, "m %"PRIx32, &parse_int) == 1) {
@@ -2073,21 +2729,24 @@ debug_callback_common(struct debug_struct* p_debug,
                       "m %x",
                       (uint16_t) parse_int);
     } else if (sscanf(input_buf, "breakat %"PRIu64, &parse_u64) == 1) {
-      uint64_t ticks_delta;
-      struct timing_struct* p_timing = p_debug->p_timing;
-      uint32_t timer_id = p_debug->timer_id_debug;
-      uint64_t ticks = timing_get_total_timer_ticks(p_timing);
-      if (timing_timer_is_running(p_timing, timer_id)) {
-        (void) timing_stop_timer(p_timing, timer_id);
-      }
-      if (parse_u64 > ticks) {
-        ticks_delta = (parse_u64 - ticks);
-        (void) timing_start_timer_with_value(p_timing, timer_id, ticks_delta);
-      }
+      p_debug->break_at_ticks = parse_u64;
+      debug_rewound(p_debug);
     } else if (!strcmp(p_command, "seek")) {
       (void) bbc_replay_seek(p_bbc, (parse_int * 2000000ull));
       p_debug->debug_running = 1;
       break;
+    } else if (sscanf(input_buf, "back %"PRIu64, &parse_u64) == 1) {
+      uint64_t ticks = timing_get_total_timer_ticks(p_debug->p_timing);
+      if ((parse_u64 == 0) ||
+          (parse_u64 > ticks) ||
+          !bbc_replay_seek(p_bbc, (ticks - parse_u64))) {
+        (void) printf("back needs -capture or -replay\n");
+      } else {
+        /* The break is armed by debug_rewound() once the rewind happens. */
+        p_debug->break_at_ticks = (ticks - parse_u64);
+        p_debug->debug_running = 1;
+        break;
+      }
     } else if (!strcmp(p_command, "b") || !strcmp(p_command, "break")) {
       debug_setup_breakpoint(p_debug);
     } else if (!strcmp(p_command, "bm")) {
@@ -2105,13 +2764,14 @@ debug_callback_common(struct debug_struct* p_debug,
                (parse_int >= 0) &&
                (parse_int < k_max_break)) {
       debug_clear_breakpoint(p_debug, parse_int);
-      debug_calculate_max_breakpoint(p_debug);
+      debug_rebuild_breakpoint_index(p_debug);
     } else if (!strcmp(p_command, "enable") &&
                (parse_int >= 0) &&
                (parse_int < k_max_break)) {
       struct debug_breakpoint* p_breakpoint = &p_debug->breakpoints[parse_int];
       if (p_breakpoint->is_in_use) {
         p_breakpoint->is_enabled = 1;
+        debug_rebuild_breakpoint_index(p_debug);
       }
     } else if (!strcmp(p_command, "disable") &&
                (parse_int >= 0) &&
@@ -2119,6 +2779,7 @@ debug_callback_common(struct debug_struct* p_debug,
       struct debug_breakpoint* p_breakpoint = &p_debug->breakpoints[parse_int];
       if (p_breakpoint->is_in_use) {
         p_breakpoint->is_enabled = 0;
+        debug_rebuild_breakpoint_index(p_debug);
       }
     } else if (!strcmp(p_command, "eval") && (p_param_1_str != NULL)) {
       int64_t expression_ret;
@@ -2214,9 +2875,15 @@ debug_callback_common(struct debug_struct* p_debug,
                (parse_int2 < 65536)) {
       parse_string[255] = '\0';
       debug_save_raw(p_debug, parse_string, parse_int, parse_int2);
+    } else if (sscanf(input_buf, "ssb %255s", parse_string) == 1) {
+      parse_string[255] = '\0';
+      state_save_bem(p_bbc, parse_string);
+    } else if (sscanf(input_buf, "ssz %255s", parse_string) == 1) {
+      parse_string[255] = '\0';
+      state_save(p_bbc, parse_string, 1);
     } else if (sscanf(input_buf, "ss %255s", parse_string) == 1) {
       parse_string[255] = '\0';
-      state_save(p_bbc, parse_string);
+      state_save(p_bbc, parse_string, 0);
     } else if (!strcmp(input_buf, "d") ||
                (!strncmp(input_buf, "d ", 2) &&
                     (sscanf(input_buf, "d %"PRIx32, &parse_int) == 1))) {
@@ -2434,9 +3101,12 @@ debug_callback_common(struct debug_struct* p_debug,
   "breakat <c>        : break at <c> cycles\n"
   "keydown <k>        : simulate key press <k>\n"
   "keyup <k>          : simulate key release <k>\n"
-  "ss <f>             : save state to BEM file <f> (deprecated)\n"
+  "ss <f>             : save state to file <f>\n"
+  "ssz <f>            : save compressed state to file <f>\n"
+  "ssb <f>            : save state to BEM file <f> (deprecated)\n"
   "fast               : toggle fast mode on/off\n"
   "seek <s>           : seek a replay file to <s> seconds\n"
+  "back <c>           : go back <c> cycles, via snapshot and replay\n"
   "bail               : exit emulator with failure code\n"
   );
     } else {
@@ -2454,6 +3124,8 @@ debug_callback_common(struct debug_struct* p_debug,
       util_bail("fflush() failed");
     }
   }
+  debug_update_jit_traps(p_debug);
+
   if (do_trap) {
     os_debug_trap();
   }
@@ -2478,12 +3150,152 @@ debug_callback(struct cpu_driver* p_cpu_driver, int do_irq) {
   return debug_callback_common(p_debug, p_cpu_driver, do_irq);
 }
 
+static inline uint32_t
+debug_sample_key(uint16_t addr_6502, uint8_t bank) {
+  if ((addr_6502 < 0x8000) || (addr_6502 >= 0xC000)) {
+    return addr_6502;
+  }
+  return (k_6502_addr_space_size + (bank * 0x4000) + (addr_6502 - 0x8000));
+}
+
+static struct util_tree_node_struct*
+debug_sample_get_child(struct util_tree_node_struct* p_node, uint32_t key) {
+  uint32_t i;
+  struct util_tree_node_struct* p_child;
+  uint32_t num_children = util_tree_node_get_num_children(p_node);
+
+  for (i = 0; i < num_children; ++i) {
+    p_child = util_tree_node_get_child(p_node, i);
+    if (util_tree_node_get_type(p_child) == (int32_t) key) {
+      return p_child;
+    }
+  }
+
+  p_child = util_tree_node_alloc(key);
+  util_tree_node_add_child(p_node, p_child);
+  return p_child;
+}
+
+static void
+debug_sample_add(struct debug_struct* p_debug,
+                 uint16_t reg_pc,
+                 uint8_t reg_s,
+                 uint8_t bank) {
+  uint32_t key;
+  uint32_t i;
+  uint32_t frames[k_debug_sample_max_frames];
+  uint32_t num_frames = 0;
+  struct util_tree_node_struct* p_node;
+  uint8_t* p_mem_read = p_debug->p_mem_read;
+
+  key = debug_sample_key(reg_pc, bank);
+  p_debug->p_sample_counts[key]++;
+  p_debug->sample_total++;
+
+  /* Derive the call stack from the stack page: any byte pair that points
+   * just past a JSR is taken as a return address. This is a heuristic;
+   * pushed data can look the same, and a caller in a different sideways bank
+   * is attributed to the current one.
+   */
+  i = (reg_s + 1);
+  while ((i < 0xFF) && (num_frames < k_debug_sample_max_frames)) {
+    uint16_t ret_addr = (p_mem_read[0x100 + i] |
+                         (p_mem_read[0x100 + i + 1] << 8));
+    uint16_t call_addr = (ret_addr - 2);
+    if (p_mem_read[call_addr] == 0x20) {
+      frames[num_frames++] = debug_sample_key(call_addr, bank);
+      i += 2;
+    } else {
+      i++;
+    }
+  }
+
+  /* The tree runs from the outermost caller down to the sampled PC. */
+  p_node = util_tree_get_root(p_debug->p_sample_tree);
+  while (num_frames > 0) {
+    num_frames--;
+    p_node = debug_sample_get_child(p_node, frames[num_frames]);
+  }
+  p_node = debug_sample_get_child(p_node, key);
+  util_tree_node_set_int_value(p_node,
+                               (util_tree_node_get_int_value(p_node) + 1));
+}
+
+static void
+debug_sample_callback(void* p) {
+  uint8_t reg_a;
+  uint8_t reg_x;
+  uint8_t reg_y;
+  uint8_t reg_s;
+  uint8_t reg_flags;
+  uint16_t reg_pc;
+  struct debug_struct* p_debug = (struct debug_struct*) p;
+
+  (void) timing_set_timer_value(p_debug->p_timing,
+                                p_debug->timer_id_sample,
+                                p_debug->sample_cycles);
+
+  state_6502_get_registers(p_debug->p_state_6502,
+                           &reg_a,
+                           &reg_x,
+                           &reg_y,
+                           &reg_s,
+                           &reg_flags,
+                           &reg_pc);
+  debug_sample_add(p_debug,
+                   reg_pc,
+                   reg_s,
+                   bbc_get_current_bank(p_debug->p_bbc));
+}
+
+static void
+debug_trace_setup(struct debug_struct* p_debug,
+                  const char* p_file_name,
+                  uint64_t num_records) {
+  size_t size;
+  struct debug_trace_header* p_header;
+  void* p_addr;
+
+  if (num_records == 0) {
+    util_bail("trace needs at least one record");
+  }
+  size = (sizeof(struct debug_trace_header) +
+          (num_records * sizeof(struct debug_trace_record)));
+
+  p_debug->trace_handle = os_alloc_get_file_handle(p_file_name, size);
+  p_debug->p_trace_mapping = os_alloc_get_mapping_from_handle(
+      p_debug->trace_handle, NULL, 0, size);
+  p_addr = os_alloc_get_mapping_addr(p_debug->p_trace_mapping);
+
+  p_header = (struct debug_trace_header*) p_addr;
+  (void) memcpy(&p_header->magic[0],
+                k_debug_trace_magic,
+                sizeof(p_header->magic));
+  p_header->record_size = sizeof(struct debug_trace_record);
+  p_header->num_records = num_records;
+  p_header->total_records = 0;
+  p_header->last_cycles = 0;
+
+  p_debug->p_trace_header = p_header;
+  p_debug->p_trace_records = (struct debug_trace_record*) (p_header + 1);
+  p_debug->trace_num_records = num_records;
+  p_debug->trace_next_record = 0;
+
+  log_do_log(k_log_misc,
+             k_log_info,
+             "tracing last %"PRIu64" instructions to %s",
+             num_records,
+             p_file_name);
+}
+
 struct debug_struct*
 debug_create(struct bbc_struct* p_bbc,
              int debug_active,
              struct bbc_options* p_options) {
   uint32_t i;
   struct debug_struct* p_debug;
+  char* p_trace_file_name = NULL;
+  uint64_t trace_num_records = k_debug_trace_default_records;
   struct timing_struct* p_timing = bbc_get_timing(p_bbc);
 
   assert(s_p_debug == NULL);
@@ -2520,16 +3332,55 @@ debug_create(struct bbc_struct* p_bbc,
   }
 
   p_debug->timer_id_debug = timing_register_timer(p_timing,
+                                                  "debug",
                                                   debug_timer_callback,
                                                   p_debug);
   p_debug->timer_id_sub_instruction = timing_register_timer(
       p_timing,
+      "debug_sub_instruction",
       debug_sub_instruction_callback,
       p_debug);
 
   if (util_has_option(p_options->p_opt_flags, "debug:sub-instruction")) {
     debug_make_sub_instruction_active(p_debug);
   }
+  /* Until the debugger first checks in, the JIT traps every instruction. */
+  p_debug->is_jit_sparse = util_has_option(p_options->p_opt_flags,
+                                           "debug:jit-sparse");
+  p_debug->is_jit_trap_all = 1;
+  p_debug->is_any_trap_armed = 1;
+
+  (void) util_get_str_option(&p_trace_file_name,
+                             p_options->p_opt_flags,
+                             "debug:trace=");
+  if (p_trace_file_name != NULL) {
+    (void) util_get_u64_option(&trace_num_records,
+                               p_options->p_opt_flags,
+                               "debug:trace-records=");
+    debug_trace_setup(p_debug, p_trace_file_name, trace_num_records);
+    util_free(p_trace_file_name);
+  }
+
+  /* The sampling profiler works without the debugger being active. */
+  (void) util_get_u32_option(&p_debug->sample_cycles,
+                             p_options->p_opt_flags,
+                             "debug:sample=");
+  if (p_debug->sample_cycles > 0) {
+    p_debug->p_sample_counts =
+        util_mallocz(k_debug_sample_num_keys * sizeof(uint32_t));
+    p_debug->p_sample_tree = util_tree_alloc();
+    util_tree_set_root(p_debug->p_sample_tree, util_tree_node_alloc(-1));
+    (void) util_get_str_option(&p_debug->p_sample_stacks_file_name,
+                               p_options->p_opt_flags,
+                               "debug:sample-stacks=");
+    p_debug->timer_id_sample = timing_register_timer(p_timing,
+                                                     "debug_sample",
+                                                     debug_sample_callback,
+                                                     p_debug);
+    (void) timing_start_timer_with_value(p_timing,
+                                         p_debug->timer_id_sample,
+                                         p_debug->sample_cycles);
+  }
 
   os_terminal_set_ctrl_c_callback(debug_interrupt_callback);
 
@@ -2541,3 +3392,152 @@ debug_set_commands(struct debug_struct* p_debug, const char* p_commands) {
   util_string_split(p_debug->p_pending_commands, p_commands, ';', '\'');
   debug_interrupt_callback();
 }
+
+static uint64_t
+debug_trace_get_delta(const struct debug_trace_record* p_record) {
+  uint64_t delta = p_record->cycles_delta;
+  if (p_record->info & k_debug_trace_long_delta) {
+    delta = (p_record->reg_pc |
+             ((uint64_t) p_record->addr_6502 << 16) |
+             (delta << 32));
+  }
+  return delta;
+}
+
+static uint64_t
+debug_trace_decode(const struct debug_trace_header* p_header,
+                   const struct debug_trace_record* p_records,
+                   const struct debug_trace_record** p_out_records,
+                   uint64_t* p_out_cycles) {
+  /* Puts the instruction records, oldest first, and their absolute cycle
+   * counts, into the out arrays. Returns how many there are.
+   */
+  uint64_t num_records;
+  uint64_t start;
+  uint64_t cycles;
+  uint64_t i;
+  uint64_t num_out = 0;
+
+  num_records = p_header->total_records;
+  start = 0;
+  if (num_records > p_header->num_records) {
+    num_records = p_header->num_records;
+    start = (p_header->total_records % p_header->num_records);
+  }
+
+  /* Only the final cycle count is absolute, so walk back to the first. */
+  cycles = p_header->last_cycles;
+  for (i = 1; i < num_records; ++i) {
+    cycles -= debug_trace_get_delta(
+        &p_records[(start + i) % p_header->num_records]);
+  }
+
+  for (i = 0; i < num_records; ++i) {
+    const struct debug_trace_record* p_record =
+        &p_records[(start + i) % p_header->num_records];
+
+    if (i > 0) {
+      cycles += debug_trace_get_delta(p_record);
+    }
+    if (p_record->info & k_debug_trace_long_delta) {
+      continue;
+    }
+    p_out_records[num_out] = p_record;
+    p_out_cycles[num_out] = cycles;
+    num_out++;
+  }
+
+  return num_out;
+}
+
+void
+debug_decode_trace(const char* p_file_name) {
+  struct debug_trace_header header;
+  struct util_file* p_file;
+  struct debug_trace_record* p_records;
+  const struct debug_trace_record** p_decoded_records;
+  uint64_t* p_decoded_cycles;
+  uint8_t* p_opcode_types;
+  uint8_t* p_opcode_modes;
+  uint64_t num_records;
+  uint64_t i;
+  uint64_t ret;
+
+  p_file = util_file_open(p_file_name, 0, 0);
+  ret = util_file_read(p_file, &header, sizeof(header));
+  if ((ret != sizeof(header)) ||
+      memcmp(&header.magic[0], k_debug_trace_magic, sizeof(header.magic)) ||
+      (header.record_size != sizeof(struct debug_trace_record)) ||
+      (header.num_records == 0)) {
+    util_bail("not a trace file");
+  }
+
+  p_records = util_malloc(header.num_records * sizeof(*p_records));
+  ret = util_file_read(p_file,
+                       p_records,
+                       (header.num_records * sizeof(*p_records)));
+  util_file_close(p_file);
+  if (ret != (header.num_records * sizeof(*p_records))) {
+    util_bail("truncated trace file");
+  }
+
+  defs_6502_init();
+  if (header.is_65c12) {
+    p_opcode_types = defs_6502_get_65c12_optype_map();
+    p_opcode_modes = defs_6502_get_65c12_opmode_map();
+  } else {
+    p_opcode_types = defs_6502_get_6502_optype_map();
+    p_opcode_modes = defs_6502_get_6502_opmode_map();
+  }
+
+  p_decoded_records = util_malloc(header.num_records *
+                                  sizeof(*p_decoded_records));
+  p_decoded_cycles = util_malloc(header.num_records *
+                                 sizeof(*p_decoded_cycles));
+  num_records = debug_trace_decode(&header,
+                                   p_records,
+                                   p_decoded_records,
+                                   p_decoded_cycles);
+
+  for (i = 0; i < num_records; ++i) {
+    char cycles_buf[24];
+    int32_t addr_6502 = -1;
+    int branch_taken = -1;
+    const struct debug_trace_record* p_record = p_decoded_records[i];
+    uint8_t info = p_record->info;
+
+    if (info & k_debug_trace_has_addr) {
+      addr_6502 = p_record->addr_6502;
+    } else if (info & k_debug_trace_branch) {
+      branch_taken = !!(info & k_debug_trace_branch_taken);
+    }
+    (void) snprintf(cycles_buf,
+                    sizeof(cycles_buf),
+                    "%"PRIu64,
+                    p_decoded_cycles[i]);
+
+    debug_print_status_line_raw(cycles_buf,
+                                p_opcode_types,
+                                p_opcode_modes,
+                                p_record->reg_pc,
+                                p_record->reg_a,
+                                p_record->reg_x,
+                                p_record->reg_y,
+                                p_record->reg_s,
+                                p_record->reg_flags,
+                                p_record->opcode,
+                                p_record->operand1,
+                                p_record->operand2,
+                                !!(info & k_debug_trace_irq),
+                                !!(info & k_debug_trace_nmi),
+                                addr_6502,
+                                p_record->val,
+                                branch_taken);
+  }
+
+  util_free(p_decoded_cycles);
+  util_free(p_decoded_records);
+  util_free(p_records);
+}
+
+#include "test-debug.c"
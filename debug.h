@@ -15,11 +15,31 @@ struct debug_struct* debug_create(struct bbc_struct* p_bbc,
 /* debug_init() is called after the cpu_driver is set up. */
 void debug_init(struct debug_struct* p_debug);
 void debug_destroy(struct debug_struct* p_debug);
+/* Called when the 6502 stops running, whichever way the run ends. */
+void debug_run_finished(struct debug_struct* p_debug);
 
 volatile int* debug_get_interrupt(struct debug_struct* p_debug);
 int debug_subsystem_active(void* p);
 void debug_set_commands(struct debug_struct* p_debug, const char* p_commands);
 
 void* debug_callback(struct cpu_driver* p_cpu_driver, int do_irq);
+/* Called after a rewind, to re-arm any pending cycle count break. */
+void debug_rewound(struct debug_struct* p_debug);
+
+/* Sparse JIT traps: the JIT (and its helper interpreter) ask whether a debug
+ * call is needed at a given 6502 address, instead of calling in for every
+ * instruction.
+ */
+int debug_is_jit_sparse(struct debug_struct* p_debug);
+/* Zero only when debug_needs_trap() is certain to say no everywhere. */
+int* debug_get_any_trap_armed(struct debug_struct* p_debug);
+int debug_needs_trap(struct debug_struct* p_debug,
+                     uint16_t addr_6502,
+                     int is_dynamic_operand);
+
+/* Prints the instructions recorded with -opt debug:trace=<f> in the same
+ * format as the debugger's status line, tagged with the cycle count.
+ */
+void debug_decode_trace(const char* p_file_name);
 
 #endif /* BEEBJIT_DEBUG_H */
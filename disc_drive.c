@@ -4,6 +4,7 @@
 #include "disc.h"
 #include "ibm_disc_format.h"
 #include "log.h"
+#include "snapshot.h"
 #include "timing.h"
 #include "util.h"
 
@@ -220,9 +221,11 @@ disc_drive_create(uint32_t id,
                                            "disc:drive1-40");
   }
 
-  p_drive->timer_id = timing_register_timer(p_timing,
-                                            disc_drive_timer_callback,
-                                            p_drive);
+  p_drive->timer_id = timing_register_timer(
+      p_timing,
+      ((id == 0) ? "disc_drive0" : "disc_drive1"),
+      disc_drive_timer_callback,
+      p_drive);
 
   return p_drive;
 }
@@ -481,3 +484,27 @@ disc_drive_write_pulses(struct disc_drive_struct* p_drive, uint32_t pulses) {
   }
   disc_write_pulses(p_disc, is_side_upper, track, head_position, pulses);
 }
+
+void
+disc_drive_snapshot(struct disc_drive_struct* p_drive,
+                    struct snapshot_struct* p_snapshot) {
+  /* Note that this doesn't cover disc contents, only the drive mechanics. */
+  SNAPSHOT_FIELD(p_snapshot, p_drive->disc_index);
+  SNAPSHOT_FIELD(p_snapshot, p_drive->is_side_upper);
+  SNAPSHOT_FIELD(p_snapshot, p_drive->track);
+  SNAPSHOT_FIELD(p_snapshot, p_drive->head_position);
+  SNAPSHOT_FIELD(p_snapshot, p_drive->pulse_position);
+  (void) timing_snapshot_timer(p_drive->p_timing,
+                               p_drive->timer_id,
+                               p_snapshot);
+
+  /* A state file may be loaded with a different set of discs. */
+  if (snapshot_is_load(p_snapshot)) {
+    if (p_drive->disc_index > p_drive->discs_added) {
+      util_bail("snapshot disc index out of range");
+    }
+    if (p_drive->head_position >= disc_drive_get_track_length(p_drive)) {
+      p_drive->head_position = 0;
+    }
+  }
+}
@@ -7,6 +7,7 @@ struct disc_drive_struct;
 
 struct bbc_options;
 struct disc_struct;
+struct snapshot_struct;
 struct timing_struct;
 
 struct disc_drive_struct* disc_drive_create(uint32_t id,
@@ -48,4 +49,7 @@ void disc_drive_seek_track(struct disc_drive_struct* p_drive, int32_t delta);
 void disc_drive_write_pulses(struct disc_drive_struct* p_drive,
                              uint32_t pulses);
 
+void disc_drive_snapshot(struct disc_drive_struct* p_drive,
+                         struct snapshot_struct* p_snapshot);
+
 #endif /* BEEBJIT_DISC_DRIVE_H */
@@ -10,6 +10,14 @@
 #include <stdlib.h>
 #include <string.h>
 
+struct expression_op_struct {
+  int32_t type;
+  uint32_t jump_target;
+  int64_t value;
+  expression_var_read_func_t p_var_read_func;
+  expression_var_write_func_t p_var_write_func;
+};
+
 struct expression_struct {
   expression_var_read_lookup_func_t p_var_read_lookup_func;
   expression_var_write_lookup_func_t p_var_write_lookup_func;
@@ -17,6 +25,16 @@ struct expression_struct {
   char* p_expr_str;
   struct util_tree_struct* p_tree;
   struct util_tree_node_struct* p_current_node;
+
+  /* The parsed tree is compiled to a flat stack machine program, with
+   * variable accessors resolved, for fast repeated execution.
+   */
+  struct expression_op_struct* p_ops;
+  uint32_t num_ops;
+  uint32_t max_ops;
+  uint32_t stack_depth;
+  uint32_t max_stack_depth;
+  int64_t* p_stack;
 };
 
 struct expression_variable_funcs_struct {
@@ -48,6 +66,20 @@ enum {
   k_expression_node_assign = 21,
 };
 
+/* Compiled ops. Binary operators use the node type as the op type. */
+enum {
+  k_expression_op_push = 100,
+  k_expression_op_read = 101,
+  k_expression_op_read_indexed = 102,
+  k_expression_op_write = 103,
+  k_expression_op_write_indexed = 104,
+  /* If the top of stack is zero, jump. Otherwise pop it. */
+  k_expression_op_and_jump = 105,
+  /* If the top of stack is non-zero, set it to 1 and jump. Otherwise pop it. */
+  k_expression_op_or_jump = 106,
+  k_expression_op_bool = 107,
+};
+
 struct expression_struct*
 expression_create(expression_var_read_lookup_func_t p_var_read_lookup_func,
                   expression_var_write_lookup_func_t p_var_write_lookup_func,
@@ -66,6 +98,8 @@ void
 expression_destroy(struct expression_struct* p_expression) {
   util_free(p_expression->p_expr_str);
   util_tree_free(p_expression->p_tree);
+  util_free(p_expression->p_ops);
+  util_free(p_expression->p_stack);
   util_free(p_expression);
 }
 
@@ -76,6 +110,9 @@ expression_clear(struct expression_struct* p_expression) {
   util_tree_free(p_expression->p_tree);
   p_expression->p_tree = util_tree_alloc();
   p_expression->p_current_node = NULL;
+  p_expression->num_ops = 0;
+  p_expression->stack_depth = 0;
+  p_expression->max_stack_depth = 0;
 }
 
 static int32_t
@@ -303,6 +340,174 @@ expression_process_token(struct expression_struct* p_expression,
   p_expression->p_current_node = p_new_node;
 }
 
+static uint32_t
+expression_emit(struct expression_struct* p_expression,
+                int32_t type,
+                int32_t stack_delta) {
+  struct expression_op_struct* p_op;
+  uint32_t index = p_expression->num_ops;
+
+  if (index == p_expression->max_ops) {
+    p_expression->max_ops = ((p_expression->max_ops * 2) + 16);
+    p_expression->p_ops = util_realloc(
+        p_expression->p_ops,
+        (p_expression->max_ops * sizeof(struct expression_op_struct)));
+  }
+  p_op = &p_expression->p_ops[index];
+  (void) memset(p_op, '\0', sizeof(struct expression_op_struct));
+  p_op->type = type;
+  p_expression->num_ops++;
+
+  p_expression->stack_depth += stack_delta;
+  if (p_expression->stack_depth > p_expression->max_stack_depth) {
+    p_expression->max_stack_depth = p_expression->stack_depth;
+  }
+
+  return index;
+}
+
+static void
+expression_emit_push(struct expression_struct* p_expression, int64_t value) {
+  uint32_t index = expression_emit(p_expression, k_expression_op_push, 1);
+  p_expression->p_ops[index].value = value;
+}
+
+static void
+expression_compile_node(struct expression_struct* p_expression,
+                        struct util_tree_node_struct* p_node) {
+  struct expression_variable_funcs_struct* p_funcs;
+  uint32_t index;
+  int32_t type = util_tree_node_get_type(p_node);
+  uint32_t num_children = util_tree_node_get_num_children(p_node);
+  struct util_tree_node_struct* p_child_node_1 = NULL;
+  struct util_tree_node_struct* p_child_node_2 = NULL;
+
+  if (num_children > 0) {
+    p_child_node_1 = util_tree_node_get_child(p_node, 0);
+  }
+  if (num_children > 1) {
+    p_child_node_2 = util_tree_node_get_child(p_node, 1);
+  }
+
+  switch (type) {
+  case k_expression_node_integer:
+    expression_emit_push(p_expression, util_tree_node_get_int_value(p_node));
+    break;
+  case k_expression_node_var:
+    p_funcs = (struct expression_variable_funcs_struct*)
+        util_tree_node_get_object_value(p_node);
+    if (num_children == 1) {
+      expression_compile_node(p_expression, p_child_node_1);
+      index = expression_emit(p_expression, k_expression_op_read_indexed, 0);
+    } else {
+      index = expression_emit(p_expression, k_expression_op_read, 1);
+    }
+    p_expression->p_ops[index].p_var_read_func = p_funcs->p_var_read_func;
+    break;
+  case k_expression_node_plus:
+  case k_expression_node_minus:
+  case k_expression_node_multiply:
+  case k_expression_node_divide:
+  case k_expression_node_equal:
+  case k_expression_node_not_equal:
+  case k_expression_node_less_than:
+  case k_expression_node_less_than_equal:
+  case k_expression_node_greater_than:
+  case k_expression_node_greater_than_equal:
+  case k_expression_node_bitwise_and:
+  case k_expression_node_bitwise_or:
+    if (num_children == 2) {
+      expression_compile_node(p_expression, p_child_node_1);
+      expression_compile_node(p_expression, p_child_node_2);
+      (void) expression_emit(p_expression, type, -1);
+    } else {
+      expression_emit_push(p_expression, 0);
+    }
+    break;
+  case k_expression_node_logical_and:
+  case k_expression_node_logical_or:
+    if (num_children == 2) {
+      int32_t jump_type = k_expression_op_and_jump;
+      if (type == k_expression_node_logical_or) {
+        jump_type = k_expression_op_or_jump;
+      }
+      expression_compile_node(p_expression, p_child_node_1);
+      /* The right hand side is skipped if the left hand side decides the
+       * result.
+       */
+      index = expression_emit(p_expression, jump_type, -1);
+      expression_compile_node(p_expression, p_child_node_2);
+      (void) expression_emit(p_expression, k_expression_op_bool, 0);
+      p_expression->p_ops[index].jump_target = p_expression->num_ops;
+    } else {
+      expression_emit_push(p_expression, 0);
+    }
+    break;
+  case k_expression_node_paren_open:
+  case k_expression_node_square_open:
+    if (num_children == 1) {
+      expression_compile_node(p_expression, p_child_node_1);
+    } else {
+      expression_emit_push(p_expression, 0);
+    }
+    break;
+  case k_expression_node_assign:
+    if (num_children != 2) {
+      expression_emit_push(p_expression, 0);
+      break;
+    }
+    expression_compile_node(p_expression, p_child_node_2);
+    if (util_tree_node_get_type(p_child_node_1) != k_expression_node_var) {
+      break;
+    }
+    p_funcs = (struct expression_variable_funcs_struct*)
+        util_tree_node_get_object_value(p_child_node_1);
+    if (util_tree_node_get_num_children(p_child_node_1) == 1) {
+      expression_compile_node(p_expression,
+                              util_tree_node_get_child(p_child_node_1, 0));
+      index = expression_emit(p_expression, k_expression_op_write_indexed, -1);
+    } else {
+      index = expression_emit(p_expression, k_expression_op_write, 0);
+    }
+    p_expression->p_ops[index].p_var_write_func = p_funcs->p_var_write_func;
+    break;
+  default:
+    assert(0);
+    expression_emit_push(p_expression, 0);
+    break;
+  }
+}
+
+static void
+expression_compile(struct expression_struct* p_expression) {
+  struct util_tree_node_struct* p_node =
+      util_tree_get_root(p_expression->p_tree);
+
+  p_expression->num_ops = 0;
+  p_expression->stack_depth = 0;
+  p_expression->max_stack_depth = 0;
+  if (p_node == NULL) {
+    return;
+  }
+
+  expression_compile_node(p_expression, p_node);
+  assert(p_expression->stack_depth == 1);
+
+  util_free(p_expression->p_stack);
+  p_expression->p_stack = util_malloc(p_expression->max_stack_depth *
+                                      sizeof(int64_t));
+}
+
+const char*
+expression_get_original_string(struct expression_struct* p_expression) {
+  return p_expression->p_expr_str;
+}
+
+uint32_t
+expression_get_tree_size(struct expression_struct* p_expression) {
+  return util_tree_get_tree_size(p_expression->p_tree);
+}
+
 int64_t
 expression_parse(struct expression_struct* p_expression,
                  const char* p_expr_str) {
@@ -377,200 +582,131 @@ expression_parse(struct expression_struct* p_expression,
     }
   }
 
+  expression_compile(p_expression);
+
   return 0;
 }
 
-static int64_t
-expression_execute_node(struct expression_struct* p_expression,
-                        struct util_tree_node_struct* p_node) {
-  struct expression_variable_funcs_struct* p_funcs;
-  expression_var_read_func_t p_read_func;
-  expression_var_write_func_t p_write_func;
-  int64_t lhs;
-  int64_t rhs;
-  uint32_t index;
-  int64_t ret = 0;
-  int32_t type = util_tree_node_get_type(p_node);
-  uint32_t num_children = util_tree_node_get_num_children(p_node);
-  struct util_tree_node_struct* p_child_node_1 = NULL;
-  struct util_tree_node_struct* p_child_node_2 = NULL;
+int64_t
+expression_execute(struct expression_struct* p_expression) {
+  uint32_t pc;
+  struct expression_op_struct* p_ops = p_expression->p_ops;
+  uint32_t num_ops = p_expression->num_ops;
+  void* p_variable_object = p_expression->p_variable_object;
+  /* Points to the top of stack entry. */
+  int64_t* p_top = (p_expression->p_stack - 1);
 
-  if (num_children > 0) {
-    p_child_node_1 = util_tree_node_get_child(p_node, 0);
-  }
-  if (num_children > 1) {
-    p_child_node_2 = util_tree_node_get_child(p_node, 1);
+  if (num_ops == 0) {
+    return 0;
   }
 
-  switch (type) {
-  case k_expression_node_integer:
-    ret = util_tree_node_get_int_value(p_node);
-    break;
-  case k_expression_node_var:
-    index = 0;
-    if (num_children == 1) {
-      index = expression_execute_node(p_expression, p_child_node_1);
-    }
-    p_funcs = (struct expression_variable_funcs_struct*)
-        util_tree_node_get_object_value(p_node);
-    p_read_func = p_funcs->p_var_read_func;
-    if (p_read_func != NULL) {
-      ret = p_read_func(p_expression->p_variable_object, index);
-    }
-    break;
-  case k_expression_node_plus:
-    if (num_children == 2) {
-      ret = expression_execute_node(p_expression, p_child_node_1);
-      ret += expression_execute_node(p_expression, p_child_node_2);
-    }
-    break;
-  case k_expression_node_minus:
-    if (num_children == 2) {
-      ret = expression_execute_node(p_expression, p_child_node_1);
-      ret -= expression_execute_node(p_expression, p_child_node_2);
-    }
-    break;
-  case k_expression_node_multiply:
-    if (num_children == 2) {
-      ret = expression_execute_node(p_expression, p_child_node_1);
-      ret *= expression_execute_node(p_expression, p_child_node_2);
-    }
-    break;
-  case k_expression_node_divide:
-    if (num_children == 2) {
-      ret = expression_execute_node(p_expression, p_child_node_1);
-      ret /= expression_execute_node(p_expression, p_child_node_2);
-    }
-    break;
-  case k_expression_node_equal:
-    if (num_children == 2) {
-      lhs = expression_execute_node(p_expression, p_child_node_1);
-      rhs = expression_execute_node(p_expression, p_child_node_2);
-      ret = (lhs == rhs);
-    }
-    break;
-  case k_expression_node_not_equal:
-    if (num_children == 2) {
-      lhs = expression_execute_node(p_expression, p_child_node_1);
-      rhs = expression_execute_node(p_expression, p_child_node_2);
-      ret = (lhs != rhs);
-    }
-    break;
-  case k_expression_node_less_than:
-    if (num_children == 2) {
-      lhs = expression_execute_node(p_expression, p_child_node_1);
-      rhs = expression_execute_node(p_expression, p_child_node_2);
-      ret = (lhs < rhs);
-    }
-    break;
-  case k_expression_node_less_than_equal:
-    if (num_children == 2) {
-      lhs = expression_execute_node(p_expression, p_child_node_1);
-      rhs = expression_execute_node(p_expression, p_child_node_2);
-      ret = (lhs <= rhs);
-    }
-    break;
-  case k_expression_node_greater_than:
-    if (num_children == 2) {
-      lhs = expression_execute_node(p_expression, p_child_node_1);
-      rhs = expression_execute_node(p_expression, p_child_node_2);
-      ret = (lhs > rhs);
-    }
-    break;
-  case k_expression_node_greater_than_equal:
-    if (num_children == 2) {
-      lhs = expression_execute_node(p_expression, p_child_node_1);
-      rhs = expression_execute_node(p_expression, p_child_node_2);
-      ret = (lhs >= rhs);
-    }
-    break;
-  case k_expression_node_logical_and:
-    if (num_children == 2) {
-      lhs = expression_execute_node(p_expression, p_child_node_1);
-      rhs = 0;
-      if (lhs) {
-        rhs = expression_execute_node(p_expression, p_child_node_2);
+  pc = 0;
+  while (pc < num_ops) {
+    struct expression_op_struct* p_op = &p_ops[pc];
+    int64_t rhs;
+    pc++;
+    switch (p_op->type) {
+    case k_expression_op_push:
+      *++p_top = p_op->value;
+      break;
+    case k_expression_op_read:
+      *++p_top = 0;
+      if (p_op->p_var_read_func != NULL) {
+        *p_top = p_op->p_var_read_func(p_variable_object, 0);
       }
-      ret = (lhs && rhs);
-    }
-    break;
-  case k_expression_node_logical_or:
-    if (num_children == 2) {
-      lhs = expression_execute_node(p_expression, p_child_node_1);
-      rhs = 0;
-      if (!lhs) {
-        rhs = expression_execute_node(p_expression, p_child_node_2);
+      break;
+    case k_expression_op_read_indexed:
+      if (p_op->p_var_read_func != NULL) {
+        *p_top = p_op->p_var_read_func(p_variable_object, (uint32_t) *p_top);
+      } else {
+        *p_top = 0;
       }
-      ret = (lhs || rhs);
-    }
-    break;
-  case k_expression_node_bitwise_and:
-    if (num_children == 2) {
-      ret = expression_execute_node(p_expression, p_child_node_1);
-      ret &= expression_execute_node(p_expression, p_child_node_2);
-    }
-    break;
-  case k_expression_node_bitwise_or:
-    if (num_children == 2) {
-      ret = expression_execute_node(p_expression, p_child_node_1);
-      ret |= expression_execute_node(p_expression, p_child_node_2);
-    }
-    break;
-  case k_expression_node_paren_open:
-  case k_expression_node_square_open:
-    if (num_children == 1) {
-      ret = expression_execute_node(p_expression, p_child_node_1);
-    }
-    break;
-  case k_expression_node_assign:
-    if (num_children != 2) {
       break;
-    }
-    rhs = expression_execute_node(p_expression, p_child_node_2);
-    ret = rhs;
-    if (util_tree_node_get_type(p_child_node_1) == k_expression_node_var) {
-      index = 0;
-      if (util_tree_node_get_num_children(p_child_node_1) == 1) {
-        struct util_tree_node_struct* p_index_node =
-            util_tree_node_get_child(p_child_node_1, 0);
-        index = expression_execute_node(p_expression, p_index_node);
+    case k_expression_op_write:
+      if (p_op->p_var_write_func != NULL) {
+        p_op->p_var_write_func(p_variable_object, 0, *p_top);
+      }
+      break;
+    case k_expression_op_write_indexed:
+      rhs = *p_top--;
+      if (p_op->p_var_write_func != NULL) {
+        p_op->p_var_write_func(p_variable_object, (uint32_t) rhs, *p_top);
+      }
+      break;
+    case k_expression_op_and_jump:
+      if (*p_top == 0) {
+        pc = p_op->jump_target;
+      } else {
+        p_top--;
       }
-      p_funcs = (struct expression_variable_funcs_struct*)
-          util_tree_node_get_object_value(p_child_node_1);
-      p_write_func = p_funcs->p_var_write_func;
-      if (p_write_func != NULL) {
-        p_write_func(p_expression->p_variable_object, index, rhs);
+      break;
+    case k_expression_op_or_jump:
+      if (*p_top != 0) {
+        *p_top = 1;
+        pc = p_op->jump_target;
+      } else {
+        p_top--;
       }
+      break;
+    case k_expression_op_bool:
+      *p_top = !!*p_top;
+      break;
+    case k_expression_node_plus:
+      rhs = *p_top--;
+      *p_top += rhs;
+      break;
+    case k_expression_node_minus:
+      rhs = *p_top--;
+      *p_top -= rhs;
+      break;
+    case k_expression_node_multiply:
+      rhs = *p_top--;
+      *p_top *= rhs;
+      break;
+    case k_expression_node_divide:
+      rhs = *p_top--;
+      *p_top /= rhs;
+      break;
+    case k_expression_node_equal:
+      rhs = *p_top--;
+      *p_top = (*p_top == rhs);
+      break;
+    case k_expression_node_not_equal:
+      rhs = *p_top--;
+      *p_top = (*p_top != rhs);
+      break;
+    case k_expression_node_less_than:
+      rhs = *p_top--;
+      *p_top = (*p_top < rhs);
+      break;
+    case k_expression_node_less_than_equal:
+      rhs = *p_top--;
+      *p_top = (*p_top <= rhs);
+      break;
+    case k_expression_node_greater_than:
+      rhs = *p_top--;
+      *p_top = (*p_top > rhs);
+      break;
+    case k_expression_node_greater_than_equal:
+      rhs = *p_top--;
+      *p_top = (*p_top >= rhs);
+      break;
+    case k_expression_node_bitwise_and:
+      rhs = *p_top--;
+      *p_top &= rhs;
+      break;
+    case k_expression_node_bitwise_or:
+      rhs = *p_top--;
+      *p_top |= rhs;
+      break;
+    default:
+      assert(0);
+      break;
     }
-    break;
-  default:
-    assert(0);
   }
 
-  return ret;
-}
-
-const char*
-expression_get_original_string(struct expression_struct* p_expression) {
-  return p_expression->p_expr_str;
-}
-
-uint32_t
-expression_get_tree_size(struct expression_struct* p_expression) {
-  return util_tree_get_tree_size(p_expression->p_tree);
-}
-
-int64_t
-expression_execute(struct expression_struct* p_expression) {
-  struct util_tree_node_struct* p_node;
-  if (p_expression->p_tree == NULL) {
-    return 0;
-  }
-  p_node = util_tree_get_root(p_expression->p_tree);
-  if (p_node == NULL) {
-    return 0;
-  }
-  return expression_execute_node(p_expression, p_node);
+  assert(p_top == p_expression->p_stack);
+  return *p_top;
 }
 
 #include "test-expression.c"
@@ -0,0 +1,247 @@
+#include "frame_stream.h"
+
+#include "log.h"
+#include "os_channel.h"
+#include "os_thread.h"
+#include "util.h"
+#include "util_compress.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+enum {
+  k_frame_stream_queue_slots = 8,
+  k_frame_stream_exit = 0xFFFFFFFF,
+};
+
+enum {
+  k_frame_stream_y4m = 1,
+  k_frame_stream_png = 2,
+};
+
+struct frame_stream_struct {
+  struct util_file* p_file;
+  uint32_t format;
+  uint32_t width;
+  uint32_t height;
+  uint32_t frame_size;
+  int is_dedup;
+
+  struct os_thread_struct* p_thread;
+  intptr_t handle_main_read;
+  intptr_t handle_main_write;
+  intptr_t handle_writer_read;
+  intptr_t handle_writer_write;
+  uint32_t* p_slots[k_frame_stream_queue_slots];
+  uint32_t num_slots_used;
+
+  /* Only touched by the writer thread. */
+  uint8_t* p_out;
+  uint32_t* p_last_frame;
+  int has_last_frame;
+  uint64_t num_frames_written;
+  uint64_t num_frames_deduped;
+};
+
+static uint32_t
+frame_stream_get_format(const char* p_format) {
+  if (!strcmp(p_format, "y4m")) {
+    return k_frame_stream_y4m;
+  } else if (!strcmp(p_format, "png")) {
+    return k_frame_stream_png;
+  }
+  return 0;
+}
+
+int
+frame_stream_is_format_valid(const char* p_format) {
+  return (frame_stream_get_format(p_format) != 0);
+}
+
+static void
+frame_stream_write_y4m(struct frame_stream_struct* p_stream,
+                       const uint32_t* p_frame) {
+  /* BT.601 studio range, which is what players assume for Y4M. */
+  static const char s_frame_header[] = "FRAME\n";
+  uint32_t i;
+  uint32_t num_pixels = (p_stream->width * p_stream->height);
+  uint8_t* p_y = p_stream->p_out;
+  uint8_t* p_u = (p_y + num_pixels);
+  uint8_t* p_v = (p_u + num_pixels);
+
+  for (i = 0; i < num_pixels; ++i) {
+    uint32_t pixel = p_frame[i];
+    int32_t r = ((pixel >> 16) & 0xFF);
+    int32_t g = ((pixel >> 8) & 0xFF);
+    int32_t b = (pixel & 0xFF);
+    p_y[i] = ((((66 * r) + (129 * g) + (25 * b) + 128) >> 8) + 16);
+    p_u[i] = ((((-38 * r) - (74 * g) + (112 * b) + 128) >> 8) + 128);
+    p_v[i] = ((((112 * r) - (94 * g) - (18 * b) + 128) >> 8) + 128);
+  }
+
+  util_file_write(p_stream->p_file,
+                  s_frame_header,
+                  (sizeof(s_frame_header) - 1));
+  util_file_write(p_stream->p_file, p_stream->p_out, (num_pixels * 3));
+}
+
+static void
+frame_stream_write_png(struct frame_stream_struct* p_stream,
+                       const uint32_t* p_frame) {
+  uint32_t i;
+  uint8_t* p_png;
+  size_t png_len;
+  uint32_t num_pixels = (p_stream->width * p_stream->height);
+  uint8_t* p_rgb = p_stream->p_out;
+
+  for (i = 0; i < num_pixels; ++i) {
+    uint32_t pixel = p_frame[i];
+    p_rgb[0] = (pixel >> 16);
+    p_rgb[1] = (pixel >> 8);
+    p_rgb[2] = pixel;
+    p_rgb += 3;
+  }
+
+  p_png = util_compress_png(&png_len,
+                            p_stream->p_out,
+                            p_stream->width,
+                            p_stream->height);
+  util_file_write(p_stream->p_file, p_png, png_len);
+  util_free(p_png);
+}
+
+static void
+frame_stream_write_frame(struct frame_stream_struct* p_stream,
+                         const uint32_t* p_frame) {
+  if (p_stream->is_dedup) {
+    if (p_stream->has_last_frame &&
+        !memcmp(p_stream->p_last_frame, p_frame, p_stream->frame_size)) {
+      p_stream->num_frames_deduped++;
+      return;
+    }
+    (void) memcpy(p_stream->p_last_frame, p_frame, p_stream->frame_size);
+    p_stream->has_last_frame = 1;
+  }
+
+  if (p_stream->format == k_frame_stream_y4m) {
+    frame_stream_write_y4m(p_stream, p_frame);
+  } else {
+    frame_stream_write_png(p_stream, p_frame);
+  }
+  p_stream->num_frames_written++;
+}
+
+static void*
+frame_stream_thread(void* p) {
+  struct frame_stream_struct* p_stream = (struct frame_stream_struct*) p;
+
+  while (1) {
+    uint32_t slot;
+    os_channel_read(p_stream->handle_writer_read, &slot, sizeof(slot));
+    if (slot == k_frame_stream_exit) {
+      break;
+    }
+    frame_stream_write_frame(p_stream, p_stream->p_slots[slot]);
+    /* Hand the slot back to the main thread. */
+    os_channel_write(p_stream->handle_writer_write, &slot, sizeof(slot));
+  }
+
+  return NULL;
+}
+
+struct frame_stream_struct*
+frame_stream_create(const char* p_file_name,
+                    const char* p_format,
+                    uint32_t width,
+                    uint32_t height,
+                    int is_dedup) {
+  uint32_t i;
+  struct frame_stream_struct* p_stream =
+      util_mallocz(sizeof(struct frame_stream_struct));
+
+  p_stream->format = frame_stream_get_format(p_format);
+  if (p_stream->format == 0) {
+    util_bail("unknown frame stream format %s", p_format);
+  }
+
+  p_stream->width = width;
+  p_stream->height = height;
+  p_stream->frame_size = (width * height * 4);
+  p_stream->is_dedup = is_dedup;
+  p_stream->p_file = util_file_open(p_file_name, 1, 1);
+
+  if (p_stream->format == k_frame_stream_y4m) {
+    char header[64];
+    int len = snprintf(header,
+                       sizeof(header),
+                       "YUV4MPEG2 W%"PRIu32" H%"PRIu32" F50:1 Ip A1:1 C444\n",
+                       width,
+                       height);
+    util_file_write(p_stream->p_file, header, len);
+  }
+
+  for (i = 0; i < k_frame_stream_queue_slots; ++i) {
+    p_stream->p_slots[i] = util_malloc(p_stream->frame_size);
+  }
+  /* Either 3 planes of YUV, or packed RGB. */
+  p_stream->p_out = util_malloc(width * height * 3);
+  if (is_dedup) {
+    p_stream->p_last_frame = util_malloc(p_stream->frame_size);
+  }
+
+  os_channel_get_handles(&p_stream->handle_main_read,
+                         &p_stream->handle_writer_write,
+                         &p_stream->handle_writer_read,
+                         &p_stream->handle_main_write);
+  p_stream->p_thread = os_thread_create(frame_stream_thread, p_stream);
+
+  return p_stream;
+}
+
+void
+frame_stream_destroy(struct frame_stream_struct* p_stream) {
+  uint32_t i;
+  uint32_t message = k_frame_stream_exit;
+
+  os_channel_write(p_stream->handle_main_write, &message, sizeof(message));
+  (void) os_thread_destroy(p_stream->p_thread);
+  os_channel_free_handles(p_stream->handle_main_read,
+                          p_stream->handle_writer_write,
+                          p_stream->handle_writer_read,
+                          p_stream->handle_main_write);
+
+  util_file_close(p_stream->p_file);
+
+  log_do_log(k_log_misc,
+             k_log_info,
+             "frame stream: %"PRIu64" frames written, %"PRIu64" duplicates",
+             p_stream->num_frames_written,
+             p_stream->num_frames_deduped);
+
+  for (i = 0; i < k_frame_stream_queue_slots; ++i) {
+    util_free(p_stream->p_slots[i]);
+  }
+  util_free(p_stream->p_out);
+  util_free(p_stream->p_last_frame);
+  util_free(p_stream);
+}
+
+void
+frame_stream_add(struct frame_stream_struct* p_stream,
+                 const uint32_t* p_buffer) {
+  uint32_t slot;
+
+  /* Use each slot once, then wait for the writer to return them. */
+  if (p_stream->num_slots_used < k_frame_stream_queue_slots) {
+    slot = p_stream->num_slots_used;
+    p_stream->num_slots_used++;
+  } else {
+    os_channel_read(p_stream->handle_main_read, &slot, sizeof(slot));
+  }
+
+  (void) memcpy(p_stream->p_slots[slot], p_buffer, p_stream->frame_size);
+  os_channel_write(p_stream->handle_main_write, &slot, sizeof(slot));
+}
+
+#include "test-frame_stream.c"
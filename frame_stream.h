@@ -0,0 +1,29 @@
+#ifndef BEEBJIT_FRAME_STREAM_H
+#define BEEBJIT_FRAME_STREAM_H
+
+#include <stdint.h>
+
+/* Writes captured frames to a single file or named pipe, from a writer thread
+ * fed by a small bounded queue.
+ * Formats are "y4m", uncompressed YUV 4:4:4 at 50Hz, and "png", a stream of
+ * concatenated PNG images such as ffmpeg's -f image2pipe reads.
+ * Y4M declares a fixed 50Hz, so every frame must be captured, without any
+ * video:frames-skip.
+ */
+struct frame_stream_struct;
+
+int frame_stream_is_format_valid(const char* p_format);
+
+struct frame_stream_struct* frame_stream_create(const char* p_file_name,
+                                                const char* p_format,
+                                                uint32_t width,
+                                                uint32_t height,
+                                                int is_dedup);
+/* Waits for any queued frames to be written out. */
+void frame_stream_destroy(struct frame_stream_struct* p_stream);
+
+/* Copies the BGRA frame into the queue. Only blocks if the queue is full. */
+void frame_stream_add(struct frame_stream_struct* p_stream,
+                      const uint32_t* p_buffer);
+
+#endif /* BEEBJIT_FRAME_STREAM_H */
@@ -4,6 +4,7 @@
 #include "disc_drive.h"
 #include "ibm_disc_format.h"
 #include "log.h"
+#include "snapshot.h"
 #include "state_6502.h"
 #include "timing.h"
 #include "util.h"
@@ -857,6 +858,7 @@ intel_fdc_create(struct state_6502* p_state_6502,
   p_fdc->p_state_6502 = p_state_6502;
   p_fdc->p_timing = p_timing;
   p_fdc->timer_id = timing_register_timer(p_timing,
+                                          "intel_fdc",
                                           intel_fdc_timer_fired,
                                           p_fdc);
 
@@ -2119,3 +2121,42 @@ intel_fdc_set_drives(struct intel_fdc_struct* p_fdc,
   disc_drive_set_pulses_callback(p_drive_0, intel_fdc_pulses_callback, p_fdc);
   disc_drive_set_pulses_callback(p_drive_1, intel_fdc_pulses_callback, p_fdc);
 }
+
+void
+intel_fdc_snapshot(struct intel_fdc_struct* p_fdc,
+                   struct snapshot_struct* p_snapshot) {
+  int32_t current_drive = -1;
+
+  if (p_fdc->p_current_drive == p_fdc->p_drive_0) {
+    current_drive = 0;
+  } else if (p_fdc->p_current_drive == p_fdc->p_drive_1) {
+    current_drive = 1;
+  }
+  SNAPSHOT_FIELD(p_snapshot, current_drive);
+  if (current_drive == 0) {
+    p_fdc->p_current_drive = p_fdc->p_drive_0;
+  } else if (current_drive == 1) {
+    p_fdc->p_current_drive = p_fdc->p_drive_1;
+  } else {
+    p_fdc->p_current_drive = NULL;
+  }
+
+  SNAPSHOT_FIELD(p_snapshot, p_fdc->parameter_callback);
+  SNAPSHOT_FIELD(p_snapshot, p_fdc->index_pulse_callback);
+  SNAPSHOT_FIELD(p_snapshot, p_fdc->timer_state);
+  SNAPSHOT_FIELD(p_snapshot, p_fdc->call_context);
+  SNAPSHOT_FIELD(p_snapshot, p_fdc->did_seek_step);
+  SNAPSHOT_FIELD(p_snapshot, p_fdc->regs);
+  SNAPSHOT_FIELD(p_snapshot, p_fdc->is_result_ready);
+  SNAPSHOT_FIELD(p_snapshot, p_fdc->mmio_data);
+  SNAPSHOT_FIELD(p_snapshot, p_fdc->mmio_clocks);
+  SNAPSHOT_FIELD(p_snapshot, p_fdc->drive_out);
+  SNAPSHOT_FIELD(p_snapshot, p_fdc->shift_register);
+  SNAPSHOT_FIELD(p_snapshot, p_fdc->num_shifts);
+  SNAPSHOT_FIELD(p_snapshot, p_fdc->state);
+  SNAPSHOT_FIELD(p_snapshot, p_fdc->state_count);
+  SNAPSHOT_FIELD(p_snapshot, p_fdc->state_is_index_pulse);
+  SNAPSHOT_FIELD(p_snapshot, p_fdc->crc);
+  SNAPSHOT_FIELD(p_snapshot, p_fdc->on_disc_crc);
+  (void) timing_snapshot_timer(p_fdc->p_timing, p_fdc->timer_id, p_snapshot);
+}
@@ -7,6 +7,7 @@ struct intel_fdc_struct;
 
 struct bbc_options;
 struct disc_drive_struct;
+struct snapshot_struct;
 struct state_6502;
 struct timing_struct;
 
@@ -29,4 +30,7 @@ void intel_fdc_write(struct intel_fdc_struct* p_fdc,
                      uint16_t addr,
                      uint8_t val);
 
+void intel_fdc_snapshot(struct intel_fdc_struct* p_fdc,
+                        struct snapshot_struct* p_snapshot);
+
 #endif /* BEEBJIT_INTEL_FDC_H */
@@ -35,6 +35,8 @@ struct interp_struct {
   uint8_t* p_mem_write;
   int debug_subsystem_active;
   volatile int* p_debug_interrupt;
+  int* p_debug_any_trap_armed;
+  struct debug_struct* p_debug;
 
   uint8_t callback_intf;
   int callback_do_irq;
@@ -122,6 +124,10 @@ interp_init(struct cpu_driver* p_cpu_driver) {
 
   p_interp->debug_subsystem_active = debug_subsystem_active(p_debug);
   p_interp->p_debug_interrupt = debug_get_interrupt(p_debug);
+  p_interp->p_debug = p_debug;
+  if (p_interp->debug_subsystem_active) {
+    p_interp->p_debug_any_trap_armed = debug_get_any_trap_armed(p_debug);
+  }
 
   p_cpu_driver->p_funcs->get_opcode_maps(p_cpu_driver,
                                          NULL,
@@ -1176,6 +1182,7 @@ interp_enter_with_details(struct interp_struct* p_interp,
   uint8_t* p_mem_write = p_interp->p_mem_write;
   uint8_t* p_stack = (p_mem_write + k_6502_stack_addr);
   volatile int* p_debug_interrupt = p_interp->p_debug_interrupt;
+  int* p_debug_any_trap_armed = p_interp->p_debug_any_trap_armed;
   int64_t cycles_this_instruction = 0;
   uint8_t opcode = 0;
   int special_checks = k_interp_special_entry;
@@ -2897,6 +2904,10 @@ do_special_checks:
     poll_irq = (special_checks & k_interp_special_poll_irq);
     if (countdown <= 0) {
       special_checks &= ~k_interp_special_countdown;
+      /* Timer callbacks, such as the sampling profiler, may look at the PC.
+       * It's cheap to keep it current here, off the fast path.
+       */
+      state_6502_set_pc(p_state_6502, pc);
       if (countdown < 0) {
         /* Expiry within the instruction that just finished. Need to poll IRQ
          * point of this instruction.
@@ -2996,16 +3007,48 @@ check_irq:
       if (cpu_driver_flags & k_cpu_flag_exited) {
         break;
       }
-      if (cpu_driver_flags & (k_cpu_flag_soft_reset | k_cpu_flag_hard_reset)) {
+      if (do_irq) {
+        /* A decided but not yet started IRQ is local interpreter state that
+         * snapshots don't capture. Leave the snapshot pending.
+         */
+        cpu_driver_flags &= ~k_cpu_flag_snapshot;
+      }
+      if (cpu_driver_flags & (k_cpu_flag_soft_reset |
+                              k_cpu_flag_hard_reset |
+                              k_cpu_flag_snapshot |
+                              k_cpu_flag_restore)) {
         void (*do_reset_callback)(void* p, uint32_t flags) =
             p_interp->driver.do_reset_callback;
         if (do_reset_callback != NULL) {
+          if (cpu_driver_flags & (k_cpu_flag_snapshot | k_cpu_flag_restore)) {
+            /* Snapshots need time and registers current at this instruction
+             * boundary.
+             */
+            INTERP_TIMING_ADVANCE(0);
+            flags = interp_get_flags(zf, nf, cf, of, df, intf);
+            state_6502_set_registers(p_state_6502, a, x, y, s, flags, pc);
+          }
           do_reset_callback(p_interp->driver.p_do_reset_callback_object,
                             cpu_driver_flags);
           state_6502_get_registers(p_state_6502, &a, &x, &y, &s, &flags, &pc);
           interp_set_flags(flags, &zf, &nf, &cf, &of, &df, &intf);
           do_irq = 0;
 
+          if (cpu_driver_flags & k_cpu_flag_restore) {
+            /* A restore may have changed the memory map and the IRQ lines. */
+            write_callback_from =
+                p_memory_access->memory_write_needs_callback_from(p_memory_obj);
+            read_callback_from =
+                p_memory_access->memory_read_needs_callback_from(p_memory_obj);
+            special_checks &= ~k_interp_special_poll_irq;
+            if (p_state_6502->abi_state.irq_fire &&
+                (state_6502_check_irq_firing(p_state_6502,
+                                             k_state_6502_irq_nmi) ||
+                 !intf)) {
+              special_checks |= k_interp_special_poll_irq;
+            }
+          }
+
           countdown = timing_get_countdown(p_timing);
         }
       }
@@ -3056,8 +3099,14 @@ check_irq:
       opcode = p_mem_read[pc];
     }
 
-    /* The debug callout fires before the next instruction executes. */
-    if (p_interp->debug_subsystem_active || *p_debug_interrupt) {
+    /* The debug callout fires before the next instruction executes. With
+     * sparse JIT traps, only where the debugger asks for it.
+     */
+    if ((p_interp->debug_subsystem_active &&
+         (do_irq ||
+          (*p_debug_any_trap_armed &&
+           debug_needs_trap(p_interp->p_debug, pc, 0)))) ||
+        *p_debug_interrupt) {
       INTERP_TIMING_ADVANCE(0);
       interp_call_debugger(p_interp,
                            &a,
@@ -31,6 +31,31 @@
 #include <string.h>
 #include <unistd.h>
 
+enum {
+  /* How many 6502 addresses the stale code sweeper looks at per housekeeping
+   * tick. A full lap of the address space takes 1024 ticks, which is about 2
+   * seconds at the default wakeup rate.
+   */
+  k_jit_sweep_addrs_per_tick = 64,
+};
+
+enum {
+  /* The OS ROM, the range compiled ahead of time. Sideways ROMs are not worth
+   * compiling ahead of time because every ROM bank switch invalidates them.
+   */
+  k_jit_os_rom_start = 0xC000,
+  /* The OS entry points, JMPs in a table near the top of the OS ROM. */
+  k_jit_os_entry_table_start = 0xFFB9,
+  k_jit_os_entry_table_end = 0xFFF7,
+};
+
+enum {
+  /* The block had invalidated code when the sweeper last looked. */
+  k_jit_sweep_stale = 1,
+  /* The sweeper has retired a block at this address before. */
+  k_jit_sweep_retired = 2,
+};
+
 struct jit_struct {
   /* Fields referenced by the JIT code. */
   struct cpu_driver driver;
@@ -61,10 +86,14 @@ struct jit_struct {
   uint8_t* p_opcode_mem;
   uint8_t* p_opcode_cycles;
   uint32_t counter_stay_in_interp;
-  uint64_t last_housekeeping_cycles;
+  uint16_t sweep_addr;
+  /* Indexed by block start. */
+  uint8_t sweep_state[k_6502_addr_space_size];
 
   int log_compile;
   int log_fault;
+  int option_precompile;
+  int is_precompile_pending;
 
   uint64_t counter_num_compiles;
   uint64_t counter_num_interps;
@@ -220,33 +249,6 @@ jit_destroy(struct cpu_driver* p_cpu_driver) {
   os_alloc_free_aligned(p_cpu_driver);
 }
 
-static int
-jit_enter(struct cpu_driver* p_cpu_driver) {
-  int exited;
-  int64_t countdown;
-
-  struct timing_struct* p_timing = p_cpu_driver->p_extra->p_timing;
-  struct state_6502* p_state_6502 = p_cpu_driver->abi.p_state_6502;
-  uint16_t addr_6502 = state_6502_get_pc(p_state_6502);
-  struct jit_struct* p_jit = (struct jit_struct*) p_cpu_driver;
-  struct jit_metadata* p_metadata = p_jit->p_metadata;
-  void* p_start_addr = jit_metadata_get_host_block_address(p_metadata,
-                                                           addr_6502);
-  void* p_mem_base = (void*) K_BBC_MEM_READ_IND_ADDR;
-
-  countdown = timing_get_countdown(p_timing);
-
-  /* The memory must be aligned to at least 0x100 so that our register access
-   * tricks work.
-   */
-  assert(((uintptr_t) p_mem_base & 0xff) == 0);
-
-  exited = asm_jit_enter(p_jit, p_start_addr, countdown, p_mem_base);
-  assert(exited == 1);
-
-  return exited;
-}
-
 static void
 jit_set_reset_callback(struct cpu_driver* p_cpu_driver,
                        void (*do_reset_callback)(void* p, uint32_t flags),
@@ -271,6 +273,13 @@ jit_set_memory_written_callback(struct cpu_driver* p_cpu_driver,
       p_memory_written_callback_object);
 }
 
+static void
+jit_reset_sweep(struct jit_struct* p_jit) {
+  /* The sweeper's marks are history from the old timeline. */
+  (void) memset(p_jit->sweep_state, '\0', sizeof(p_jit->sweep_state));
+  p_jit->sweep_addr = 0;
+}
+
 static void
 jit_apply_flags(struct cpu_driver* p_cpu_driver,
                 uint32_t flags_set,
@@ -278,6 +287,13 @@ jit_apply_flags(struct cpu_driver* p_cpu_driver,
   struct jit_struct* p_jit = (struct jit_struct*) p_cpu_driver;
   struct cpu_driver* p_interp_driver = (struct cpu_driver*) p_jit->p_interp;
 
+  /* A completed snapshot restore, e.g. for a rewind, is a new timeline, much
+   * like a power on reset.
+   */
+  if (flags_clear & k_cpu_flag_restore) {
+    jit_reset_sweep(p_jit);
+  }
+
   p_interp_driver->p_funcs->apply_flags(p_interp_driver,
                                         flags_set,
                                         flags_clear);
@@ -309,15 +325,16 @@ jit_set_exit_value(struct cpu_driver* p_cpu_driver, uint32_t exit_value) {
 }
 
 static void
-jit_memory_range_invalidate(struct cpu_driver* p_cpu_driver,
-                            uint16_t addr_6502,
-                            uint32_t len) {
+jit_invalidate_range(struct jit_struct* p_jit,
+                     uint16_t addr_6502,
+                     uint32_t len,
+                     int32_t keep_code_block) {
   uint32_t i;
   void* p_block_ptr;
 
-  struct jit_struct* p_jit = (struct jit_struct*) p_cpu_driver;
   struct jit_metadata* p_metadata = p_jit->p_metadata;
   uint32_t addr_end_6502 = (addr_6502 + len);
+  uint32_t run_start = addr_6502;
 
   assert(len <= k_6502_addr_space_size);
   assert(addr_end_6502 <= k_6502_addr_space_size);
@@ -340,16 +357,71 @@ jit_memory_range_invalidate(struct cpu_driver* p_cpu_driver,
   for (i = addr_6502; i < addr_end_6502; ++i) {
     void* p_jit_ptr;
     p_jit_ptr = jit_metadata_get_host_jit_ptr(p_metadata, i);
+    if ((keep_code_block != -1) &&
+        (jit_metadata_get_code_block(p_metadata, i) == keep_code_block)) {
+      if (!jit_metadata_is_jit_ptr_no_code(p_metadata, p_jit_ptr) &&
+          !jit_metadata_is_jit_ptr_dynamic(p_metadata, p_jit_ptr)) {
+        asm_jit_invalidate_code_at(p_jit_ptr);
+      }
+      p_jit_ptr = jit_metadata_get_host_block_address(p_metadata, i);
+      asm_jit_invalidate_code_at(p_jit_ptr);
+      if (i > run_start) {
+        jit_compiler_memory_range_invalidate(p_jit->p_compiler,
+                                             run_start,
+                                             (i - run_start));
+      }
+      run_start = (i + 1);
+      continue;
+    }
     asm_jit_invalidate_code_at(p_jit_ptr);
     p_jit_ptr = jit_metadata_get_host_block_address(p_metadata, i);
     asm_jit_invalidate_code_at(p_jit_ptr);
     jit_metadata_make_jit_ptr_no_code(p_metadata, i);
     jit_metadata_set_code_block(p_metadata, i, -1);
   }
+  if (addr_end_6502 > run_start) {
+    jit_compiler_memory_range_invalidate(p_jit->p_compiler,
+                                         run_start,
+                                         (addr_end_6502 - run_start));
+  }
 
   asm_jit_finish_code_updates(p_jit->p_asm);
+}
+
+static void
+jit_memory_range_invalidate(struct cpu_driver* p_cpu_driver,
+                            uint16_t addr_6502,
+                            uint32_t len) {
+  struct jit_struct* p_jit = (struct jit_struct*) p_cpu_driver;
+  jit_invalidate_range(p_jit, addr_6502, len, -1);
+}
+
+static void
+jit_debug_invalidate_all(struct cpu_driver* p_cpu_driver) {
+  /* The debugger calls in from within the code block containing the current
+   * 6502 PC. Its metadata (and compiler fixups) are needed to continue, so
+   * only its jit pointers are invalidated, as for self-modifying code.
+   */
+  struct jit_struct* p_jit = (struct jit_struct*) p_cpu_driver;
+  struct state_6502* p_state_6502 = p_cpu_driver->abi.p_state_6502;
+  int32_t curr_code_block = jit_metadata_get_code_block(
+      p_jit->p_metadata, state_6502_get_pc(p_state_6502));
+
+  jit_invalidate_range(p_jit, 0, k_6502_addr_space_size, curr_code_block);
+}
 
-  jit_compiler_memory_range_invalidate(p_jit->p_compiler, addr_6502, len);
+static void
+jit_power_on_reset(struct cpu_driver* p_cpu_driver) {
+  /* The OS ROM is only (re)loaded at power on. If requested, compile it ahead
+   * of time on the next entry.
+   */
+  struct jit_struct* p_jit = (struct jit_struct*) p_cpu_driver;
+
+  if (p_jit->option_precompile) {
+    p_jit->is_precompile_pending = 1;
+  }
+
+  jit_reset_sweep(p_jit);
 }
 
 static char*
@@ -378,13 +450,12 @@ jit_get_custom_counters(struct cpu_driver* p_cpu_driver,
   *p_c2 = p_jit->counter_num_interps;
 }
 
-static void
-jit_check_code_block(struct jit_struct* p_jit, uint16_t block_addr_6502) {
+static int
+jit_has_invalidated_code_in_block(struct jit_struct* p_jit,
+                                  uint16_t block_addr_6502) {
   struct jit_metadata* p_metadata = p_jit->p_metadata;
   int32_t code_block = jit_metadata_get_code_block(p_metadata, block_addr_6502);
-  int has_invalidations = 0;
   uint16_t addr_6502;
-  void* p_block_ptr;
 
   assert(code_block == block_addr_6502);
 
@@ -395,16 +466,23 @@ jit_check_code_block(struct jit_struct* p_jit, uint16_t block_addr_6502) {
     if (jit_metadata_is_jit_ptr_dynamic(p_metadata, p_jit_ptr)) {
       /* No action. */
     } else if (asm_jit_is_invalidated_code_at(p_jit_ptr)) {
-      has_invalidations = 1;
-      break;
+      return 1;
     }
     addr_6502++;
     code_block = jit_metadata_get_code_block(p_metadata, addr_6502);
   }
 
-  if (!has_invalidations) {
-    return;
-  }
+  return 0;
+}
+
+static void
+jit_retire_code_block(struct jit_struct* p_jit,
+                      uint16_t block_addr_6502,
+                      int do_tag_dynamic) {
+  struct jit_metadata* p_metadata = p_jit->p_metadata;
+  int32_t code_block;
+  uint16_t addr_6502;
+  void* p_block_ptr;
 
   if (p_jit->log_compile) {
     log_do_log(k_log_jit,
@@ -421,7 +499,7 @@ jit_check_code_block(struct jit_struct* p_jit, uint16_t block_addr_6502) {
     assert(!jit_metadata_is_jit_ptr_no_code(p_metadata, p_jit_ptr));
     if (jit_metadata_is_jit_ptr_dynamic(p_metadata, p_jit_ptr)) {
       /* No action. */
-    } else if (asm_jit_is_invalidated_code_at(p_jit_ptr)) {
+    } else if (do_tag_dynamic && asm_jit_is_invalidated_code_at(p_jit_ptr)) {
       /* This stopgap measure attempts to prevent write invalidation faults on
        * ARM64. If we get here, and there's an invalidated code address, it's
        * probably because that code isn't ever being executed. If it was
@@ -463,32 +541,139 @@ jit_cleanup_stale_code(struct jit_struct* p_jit) {
     if (next_code_block == curr_code_block) {
       continue;
     }
-    if (next_code_block != -1) {
-      jit_check_code_block(p_jit, i);
+    if ((next_code_block != -1) &&
+        jit_has_invalidated_code_in_block(p_jit, i)) {
+      jit_retire_code_block(p_jit, i, 1);
     }
     curr_code_block = next_code_block;
   }
 }
 
+static void
+jit_sweep_stale_code(struct jit_struct* p_jit, uint32_t num_addrs) {
+  uint32_t i;
+  struct jit_metadata* p_metadata = p_jit->p_metadata;
+  uint16_t addr_6502 = p_jit->sweep_addr;
+
+  /* The sweeper visits each block start once per lap of the address space.
+   * A block that contains invalidated code has had writes since it was last
+   * executed, because executing invalidated code recompiles it. If a block is
+   * still in that state a whole lap later, it's considered dead and retired.
+   */
+  for (i = 0; i < num_addrs; ++i) {
+    uint8_t* p_sweep_state = &p_jit->sweep_state[addr_6502];
+    int32_t code_block = jit_metadata_get_code_block(p_metadata, addr_6502);
+
+    if (code_block == addr_6502) {
+      if (!jit_has_invalidated_code_in_block(p_jit, addr_6502)) {
+        *p_sweep_state &= ~k_jit_sweep_stale;
+      } else if (!(*p_sweep_state & k_jit_sweep_stale)) {
+        *p_sweep_state |= k_jit_sweep_stale;
+      } else {
+        /* Only tag invalidated addresses as dynamic if the block was already
+         * retired once before. That suggests code being continually modified
+         * but rarely executed, as opposed to a one-off such as a loader being
+         * overwritten.
+         */
+        jit_retire_code_block(p_jit,
+                              addr_6502,
+                              !!(*p_sweep_state & k_jit_sweep_retired));
+        *p_sweep_state = k_jit_sweep_retired;
+      }
+    }
+
+    addr_6502++;
+  }
+
+  p_jit->sweep_addr = addr_6502;
+}
+
 static void
 jit_housekeeping_tick(struct cpu_driver* p_cpu_driver) {
-  static const uint64_t k_cycles_threshold = (2000000 * 60 * 5);
   struct jit_struct* p_jit = (struct jit_struct*) p_cpu_driver;
-  struct state_6502* p_state_6502 = p_cpu_driver->abi.p_state_6502;
-  uint64_t cycles = state_6502_get_cycles(p_state_6502);
 
-  /* Some time after 6502 reset (currently 5 minutes of virtual time), sweep
-   * the JIT code space and clear out any code blocks containing invalidations.
+  /* Continually sweep a slice of the JIT code space, clearing out code blocks
+   * that contain invalidations and haven't been executed for a while.
    * Such code blocks are likely no longer active, but contribute an overhead,
    * especially on ARM64, where writing a code invalidation pointer faults.
    */
-  if (p_jit->last_housekeeping_cycles < k_cycles_threshold) {
-    if (cycles >= k_cycles_threshold) {
-      jit_cleanup_stale_code(p_jit);
-    }
+  jit_sweep_stale_code(p_jit, k_jit_sweep_addrs_per_tick);
+}
+
+static void
+jit_load_profile(struct cpu_driver* p_cpu_driver, const char* p_file_name) {
+  struct util_file* p_file;
+  uint64_t len;
+  uint8_t* p_buf;
+  int32_t num_records;
+  struct jit_struct* p_jit = (struct jit_struct*) p_cpu_driver;
+
+  p_file = util_file_try_read_open(p_file_name);
+  if (p_file == NULL) {
+    log_do_log(k_log_jit, k_log_info, "no JIT profile at %s", p_file_name);
+    return;
+  }
+  len = util_file_get_size(p_file);
+  p_buf = util_malloc(len);
+  len = util_file_read(p_file, p_buf, len);
+  util_file_close(p_file);
+
+  num_records = jit_compiler_load_profile(p_jit->p_compiler, p_buf, len);
+  if (num_records < 0) {
+    log_do_log(k_log_jit,
+               k_log_warning,
+               "ignoring bad JIT profile %s",
+               p_file_name);
+  } else {
+    log_do_log(k_log_jit,
+               k_log_info,
+               "loaded %d JIT profile records from %s",
+               num_records,
+               p_file_name);
   }
 
-  p_jit->last_housekeeping_cycles = cycles;
+  util_free(p_buf);
+}
+
+static void
+jit_save_profile(struct cpu_driver* p_cpu_driver, const char* p_file_name) {
+  uint8_t* p_buf;
+  uint32_t len;
+  struct jit_struct* p_jit = (struct jit_struct*) p_cpu_driver;
+
+  p_buf = jit_compiler_save_profile(p_jit->p_compiler, &len);
+  util_file_write_fully(p_file_name, p_buf, len);
+  util_free(p_buf);
+}
+
+static void
+jit_invalidate_zero_page_writers(struct jit_struct* p_jit) {
+  uint32_t i;
+  struct jit_metadata* p_metadata = p_jit->p_metadata;
+  struct jit_compiler* p_compiler = p_jit->p_compiler;
+
+  for (i = 0; i < k_6502_addr_space_size; ++i) {
+    void* p_block_ptr;
+    if (jit_metadata_get_code_block(p_metadata, i) != (int32_t) i) {
+      continue;
+    }
+    if (!jit_compiler_is_block_zero_page_writer(p_compiler, i)) {
+      continue;
+    }
+
+    if (p_jit->log_compile) {
+      log_do_log(k_log_jit,
+                 k_log_info,
+                 "invalidating zero page writer block at $%.4X",
+                 i);
+    }
+
+    jit_metadata_clear_block(p_metadata, i);
+    p_block_ptr = jit_metadata_get_host_block_address(p_metadata, i);
+    asm_jit_start_code_updates(p_jit->p_asm, p_block_ptr, 4);
+    asm_jit_invalidate_code_at(p_block_ptr);
+    asm_jit_finish_code_updates(p_jit->p_asm);
+  }
 }
 
 static int64_t
@@ -551,22 +736,17 @@ jit_compile(struct jit_struct* p_jit,
                "compiling zero page code @$%.2X",
                addr_6502);
 
-    /* Invalidate all existing compiled code because if it writes to the zero
-     * page, it isn't doing self-modified code correctly.
+    /* From now on, zero page stores are compiled with self-modified code
+     * checks. Existing code blocks that store to the zero page without such
+     * checks are invalidated, so they get recompiled.
+     * Stack page code doesn't need similar treatment because the compiler
+     * only ever compiles it as dynamic opcodes.
      */
-    jit_memory_range_invalidate(&p_jit->driver,
-                                0,
-                                (k_6502_addr_space_size - 1));
-
     jit_compiler_set_compiling_for_code_in_zero_page(p_compiler, 1);
+    jit_invalidate_zero_page_writers(p_jit);
+    code_block_6502 = jit_metadata_get_code_block(p_metadata, addr_6502);
     do_redo_prepare = 1;
   }
-  if ((addr_6502 <= 0x1FF) && (addr_6502_end >= 0x100)) {
-    log_do_log(k_log_jit,
-               k_log_unimplemented,
-               "compiling stack page code @$%.4X; self-modify not handled",
-               addr_6502);
-  }
 
   if (do_redo_prepare) {
     /* Some compilation options changed, so-generate the compiler structures. */
@@ -587,6 +767,9 @@ jit_compile(struct jit_struct* p_jit,
   jit_compiler_execute_compile_block(p_compiler);
   asm_jit_finish_code_updates(p_jit->p_asm);
 
+  /* The block is evidently live, so the stale code sweeper starts afresh. */
+  p_jit->sweep_state[addr_6502] &= ~k_jit_sweep_stale;
+
   /* Handle any overlap with existing code blocks. */
   if ((code_block_6502 != -1) && (code_block_6502 != addr_6502)) {
     /* We're splitting a code block before, so invalidate it. */
@@ -631,6 +814,175 @@ jit_compile(struct jit_struct* p_jit,
   return countdown;
 }
 
+static int
+jit_is_precompile_addr(struct jit_struct* p_jit, uint32_t addr_6502) {
+  struct memory_access* p_memory_access =
+      p_jit->driver.p_extra->p_memory_access;
+  if ((addr_6502 < k_jit_os_rom_start) ||
+      (addr_6502 >= k_6502_addr_space_size)) {
+    return 0;
+  }
+  return !p_memory_access->memory_read_needs_callback(
+      p_memory_access->p_callback_obj, addr_6502);
+}
+
+static void
+jit_precompile_os(struct jit_struct* p_jit) {
+  uint32_t i;
+  uint32_t num_pending;
+  uint32_t num_compiles;
+  uint16_t* p_pending;
+  uint8_t* p_is_reachable;
+  uint8_t* p_is_entry;
+
+  struct state_6502* p_state_6502 = p_jit->driver.abi.p_state_6502;
+  struct jit_metadata* p_metadata = p_jit->p_metadata;
+  struct jit_compiler* p_compiler = p_jit->p_compiler;
+  uint8_t* p_mem_read = p_jit->driver.p_extra->p_memory_access->p_mem_read;
+  uint16_t saved_pc = state_6502_get_pc(p_state_6502);
+  uint64_t saved_num_compiles = p_jit->counter_num_compiles;
+
+  p_pending = util_malloc(k_6502_addr_space_size * sizeof(uint16_t));
+  p_is_reachable = util_mallocz(k_6502_addr_space_size);
+  p_is_entry = util_mallocz(k_6502_addr_space_size);
+  num_pending = 0;
+
+  /* Seed the code discovery from the 6502 vectors, the OS entry table, and
+   * any block starts already known, e.g. from a loaded profile.
+   */
+  p_pending[num_pending++] = util_read_le16(&p_mem_read[k_6502_vector_reset]);
+  p_pending[num_pending++] = util_read_le16(&p_mem_read[k_6502_vector_irq]);
+  p_pending[num_pending++] = util_read_le16(&p_mem_read[k_6502_vector_nmi]);
+  for (i = k_jit_os_entry_table_start; i < k_jit_os_entry_table_end; i += 3) {
+    p_pending[num_pending++] = i;
+  }
+  for (i = k_jit_os_rom_start; i < k_6502_addr_space_size; ++i) {
+    if (jit_compiler_is_block_start(p_compiler, i)) {
+      p_pending[num_pending++] = i;
+    }
+  }
+
+  /* Walk the reachable code. Subroutine and jump targets become block starts;
+   * branch targets are only followed, as they are normally compiled in to the
+   * block that branches to them.
+   */
+  for (i = 0; i < num_pending; ++i) {
+    p_is_entry[p_pending[i]] = 1;
+  }
+  while (num_pending > 0) {
+    uint16_t addr_6502 = p_pending[--num_pending];
+
+    while (jit_is_precompile_addr(p_jit, addr_6502) &&
+           !p_is_reachable[addr_6502]) {
+      uint8_t opcode_6502 = p_mem_read[addr_6502];
+      uint8_t optype = p_jit->p_opcode_types[opcode_6502];
+      uint8_t opmode = p_jit->p_opcode_modes[opcode_6502];
+      uint32_t oplen = g_opmodelens[opmode];
+      uint16_t operand = 0;
+      uint32_t next_addr_6502 = (addr_6502 + oplen);
+
+      if ((optype == k_kil) || (optype == k_brk)) {
+        break;
+      }
+      if (!jit_is_precompile_addr(p_jit, (next_addr_6502 - 1))) {
+        break;
+      }
+      p_is_reachable[addr_6502] = 1;
+
+      if (oplen == 3) {
+        operand = util_read_le16(&p_mem_read[addr_6502 + 1]);
+      } else if (opmode == k_rel) {
+        operand = (next_addr_6502 + (int8_t) p_mem_read[addr_6502 + 1]);
+      }
+      if ((optype == k_jsr) || ((optype == k_jmp) && (opmode == k_abs))) {
+        if (!p_is_entry[operand] && (num_pending < k_6502_addr_space_size)) {
+          p_is_entry[operand] = 1;
+          p_pending[num_pending++] = operand;
+        }
+      } else if ((opmode == k_rel) &&
+                 !p_is_reachable[operand] &&
+                 (num_pending < k_6502_addr_space_size)) {
+        p_pending[num_pending++] = operand;
+      }
+      if ((optype == k_jmp) || (optype == k_rts) || (optype == k_rti)) {
+        break;
+      }
+      addr_6502 = next_addr_6502;
+    }
+  }
+
+  /* Compile entry points from the top down, so that each block ends at the
+   * next entry point rather than later compiles splitting it. Then mop up any
+   * reachable code not covered, such as code only reached by a branch.
+   */
+  for (i = k_6502_addr_space_size; i > k_jit_os_rom_start; --i) {
+    uint16_t addr_6502 = (i - 1);
+    if (p_is_entry[addr_6502] &&
+        p_is_reachable[addr_6502] &&
+        !jit_metadata_is_pc_in_code_block(p_metadata, addr_6502)) {
+      (void) jit_compile(
+          p_jit,
+          jit_metadata_get_host_block_address(p_metadata, addr_6502),
+          0,
+          0);
+    }
+  }
+  for (i = k_jit_os_rom_start; i < k_6502_addr_space_size; ++i) {
+    if (p_is_reachable[i] && !jit_metadata_is_pc_in_code_block(p_metadata, i)) {
+      (void) jit_compile(p_jit,
+                         jit_metadata_get_host_block_address(p_metadata, i),
+                         0,
+                         0);
+    }
+  }
+
+  num_compiles = (p_jit->counter_num_compiles - saved_num_compiles);
+  if (p_jit->log_compile) {
+    log_do_log(k_log_jit,
+               k_log_info,
+               "precompiled %"PRIu32" OS ROM blocks",
+               num_compiles);
+  }
+
+  state_6502_set_pc(p_state_6502, saved_pc);
+
+  util_free(p_pending);
+  util_free(p_is_reachable);
+  util_free(p_is_entry);
+}
+
+static int
+jit_enter(struct cpu_driver* p_cpu_driver) {
+  int exited;
+  int64_t countdown;
+
+  struct timing_struct* p_timing = p_cpu_driver->p_extra->p_timing;
+  struct state_6502* p_state_6502 = p_cpu_driver->abi.p_state_6502;
+  uint16_t addr_6502 = state_6502_get_pc(p_state_6502);
+  struct jit_struct* p_jit = (struct jit_struct*) p_cpu_driver;
+  struct jit_metadata* p_metadata = p_jit->p_metadata;
+  void* p_start_addr = jit_metadata_get_host_block_address(p_metadata,
+                                                           addr_6502);
+  void* p_mem_base = (void*) K_BBC_MEM_READ_IND_ADDR;
+
+  if (p_jit->is_precompile_pending) {
+    p_jit->is_precompile_pending = 0;
+    jit_precompile_os(p_jit);
+  }
+
+  countdown = timing_get_countdown(p_timing);
+
+  /* The memory must be aligned to at least 0x100 so that our register access
+   * tricks work.
+   */
+  assert(((uintptr_t) p_mem_base & 0xff) == 0);
+
+  exited = asm_jit_enter(p_jit, p_start_addr, countdown, p_mem_base);
+  assert(exited == 1);
+
+  return exited;
+}
+
 static void
 jit_safe_hex_convert(char* p_buf, void* p_ptr) {
   size_t i;
@@ -817,6 +1169,8 @@ jit_init(struct cpu_driver* p_cpu_driver) {
 
   p_jit->log_compile = util_has_option(p_options->p_log_flags, "jit:compile");
   p_jit->log_fault = util_has_option(p_options->p_log_flags, "jit:fault");
+  p_jit->option_precompile = util_has_option(p_options->p_opt_flags,
+                                             "jit:precompile");
   p_funcs->get_opcode_maps(p_cpu_driver,
                            &p_jit->p_opcode_types,
                            &p_jit->p_opcode_modes,
@@ -832,9 +1186,13 @@ jit_init(struct cpu_driver* p_cpu_driver) {
   p_funcs->get_exit_value = jit_get_exit_value;
   p_funcs->set_exit_value = jit_set_exit_value;
   p_funcs->memory_range_invalidate = jit_memory_range_invalidate;
+  p_funcs->debug_invalidate_all = jit_debug_invalidate_all;
   p_funcs->get_address_info = jit_get_address_info;
   p_funcs->get_custom_counters = jit_get_custom_counters;
   p_funcs->housekeeping_tick = jit_housekeeping_tick;
+  p_funcs->power_on_reset = jit_power_on_reset;
+  p_funcs->load_profile = jit_load_profile;
+  p_funcs->save_profile = jit_save_profile;
 
   p_jit->p_compile_callback = jit_compile;
   p_cpu_driver->abi.p_debug_asm = asm_debug_trampoline;
@@ -1,6 +1,7 @@
 #include "jit_compiler.h"
 
 #include "bbc_options.h"
+#include "debug.h"
 #include "defs_6502.h"
 #include "jit_metadata.h"
 #include "jit_opcode.h"
@@ -25,14 +26,53 @@
 
 enum {
   k_opcode_history_length = 8,
+  k_history_page_shift = 8,
+  k_history_page_size = (1 << k_history_page_shift),
+  k_history_num_pages = (k_6502_addr_space_size >> k_history_page_shift),
 };
 
 struct jit_compile_history {
   uint64_t times[k_opcode_history_length];
-  int32_t opcodes[k_opcode_history_length];
+  int16_t opcodes[k_opcode_history_length];
   uint8_t was_self_modified[k_opcode_history_length];
-  uint32_t ring_buffer_index;
-  int32_t opcode;
+  uint8_t ring_buffer_index;
+};
+
+/* The state needed to recover from bouncing out of the JIT at a given 6502
+ * address, packed so that a fixup touches a single cache line.
+ */
+struct jit_compile_fixup {
+  int32_t nz;
+  int16_t cycles;
+  int16_t a;
+  int16_t x;
+  int16_t y;
+  uint16_t v;
+  uint16_t c;
+};
+
+enum {
+  k_addr_flag_block_start = 1,
+  k_addr_flag_block_continuation = 2,
+  /* Only meaningful at a block start. Set if the block contains zero page
+   * stores that were compiled without self-modified code checks.
+   */
+  k_addr_flag_zero_page_writer = 4,
+};
+
+/* Profile format: an 8 byte magic, a 32-bit record count, then fixed size
+ * records. Multi-byte fields are little endian. Each record is:
+ * 2 bytes address, 1 byte address flags, 1 byte history ring buffer index,
+ * 1 byte history opcode valid bitmask, 1 byte history self-modified bitmask,
+ * then the history opcodes, 1 byte each.
+ */
+static const char* k_profile_magic = "BJITPRF1";
+enum {
+  k_profile_magic_len = 8,
+  k_profile_header_len = (k_profile_magic_len + 4),
+  k_profile_record_len = (6 + k_opcode_history_length),
+  k_profile_addr_flags = (k_addr_flag_block_start |
+                          k_addr_flag_block_continuation),
 };
 
 enum {
@@ -46,6 +86,7 @@ struct jit_compiler {
   struct jit_metadata* p_jit_metadata;
   uint8_t* p_mem_read;
   int debug;
+  struct debug_struct* p_debug;
   int log_dynamic;
   uint8_t* p_opcode_types;
   uint8_t* p_opcode_modes;
@@ -70,17 +111,13 @@ struct jit_compiler {
 
   int compile_for_code_in_zero_page;
 
-  struct jit_compile_history history[k_6502_addr_space_size];
-  uint8_t addr_is_block_start[k_6502_addr_space_size];
-  uint8_t addr_is_block_continuation[k_6502_addr_space_size];
-
-  int32_t addr_cycles_fixup[k_6502_addr_space_size];
-  int32_t addr_nz_fixup[k_6502_addr_space_size];
-  int32_t addr_v_fixup[k_6502_addr_space_size];
-  int32_t addr_c_fixup[k_6502_addr_space_size];
-  int32_t addr_a_fixup[k_6502_addr_space_size];
-  int32_t addr_x_fixup[k_6502_addr_space_size];
-  int32_t addr_y_fixup[k_6502_addr_space_size];
+  /* Compile history is only kept for pages that have seen compilation, and
+   * each page is allocated on first use.
+   */
+  struct jit_compile_history* p_history_pages[k_history_num_pages];
+  struct jit_compile_history empty_history;
+  uint8_t addr_flags[k_6502_addr_space_size];
+  struct jit_compile_fixup addr_fixups[k_6502_addr_space_size];
 
   /* State used within compilation routines and subroutines. */
   struct jit_opcode_details opcode_details[k_max_addr_space_per_compile];
@@ -90,6 +127,55 @@ struct jit_compiler {
   int has_unresolved_jumps;
 };
 
+static void
+jit_compiler_clear_fixup(struct jit_compile_fixup* p_fixup) {
+  p_fixup->nz = -1;
+  p_fixup->cycles = -1;
+  p_fixup->a = -1;
+  p_fixup->x = -1;
+  p_fixup->y = -1;
+  p_fixup->v = 0;
+  p_fixup->c = 0;
+}
+
+static void
+jit_compiler_reset_history(struct jit_compile_history* p_history) {
+  uint32_t i;
+  for (i = 0; i < k_opcode_history_length; ++i) {
+    p_history->times[i] = 0;
+    p_history->opcodes[i] = -1;
+    p_history->was_self_modified[i] = 0;
+  }
+  p_history->ring_buffer_index = 0;
+}
+
+static inline struct jit_compile_history*
+jit_compiler_get_history(struct jit_compiler* p_compiler, uint16_t addr_6502) {
+  struct jit_compile_history* p_page =
+      p_compiler->p_history_pages[addr_6502 >> k_history_page_shift];
+  if (p_page == NULL) {
+    return NULL;
+  }
+  return &p_page[addr_6502 & (k_history_page_size - 1)];
+}
+
+static struct jit_compile_history*
+jit_compiler_get_or_create_history(struct jit_compiler* p_compiler,
+                                   uint16_t addr_6502) {
+  uint32_t i;
+  uint32_t page = (addr_6502 >> k_history_page_shift);
+  struct jit_compile_history* p_page = p_compiler->p_history_pages[page];
+  if (p_page == NULL) {
+    p_page = util_malloc(k_history_page_size *
+                         sizeof(struct jit_compile_history));
+    for (i = 0; i < k_history_page_size; ++i) {
+      jit_compiler_reset_history(&p_page[i]);
+    }
+    p_compiler->p_history_pages[page] = p_page;
+  }
+  return &p_page[addr_6502 & (k_history_page_size - 1)];
+}
+
 struct jit_compiler*
 jit_compiler_create(struct asm_jit_struct* p_asm,
                     struct timing_struct* p_timing,
@@ -116,9 +202,11 @@ jit_compiler_create(struct asm_jit_struct* p_asm,
   p_compiler->p_asm = p_asm;
   p_compiler->p_timing = p_timing;
   p_compiler->p_memory_access = p_memory_access;
+  jit_compiler_reset_history(&p_compiler->empty_history);
   p_compiler->p_jit_metadata = p_jit_metadata;
   p_compiler->p_mem_read = p_memory_access->p_mem_read;
   p_compiler->debug = debug;
+  p_compiler->p_debug = p_options->p_debug_object;
   p_compiler->p_opcode_types = p_opcode_types;
   p_compiler->p_opcode_modes = p_opcode_modes;
   p_compiler->p_opcode_mem = p_opcode_mem;
@@ -192,6 +280,12 @@ jit_compiler_create(struct asm_jit_struct* p_asm,
 
 void
 jit_compiler_destroy(struct jit_compiler* p_compiler) {
+  uint32_t i;
+  for (i = 0; i < k_history_num_pages; ++i) {
+    if (p_compiler->p_history_pages[i] != NULL) {
+      util_free(p_compiler->p_history_pages[i]);
+    }
+  }
   util_buffer_destroy(p_compiler->p_tmp_buf);
   util_buffer_destroy(p_compiler->p_single_uopcode_buf);
   util_buffer_destroy(p_compiler->p_single_uopcode_epilog_buf);
@@ -239,6 +333,11 @@ jit_compiler_resolve_branch_target(struct jit_compiler* p_compiler,
   return p_ret;
 }
 
+static inline int
+jit_compiler_is_stack_page_addr(uint16_t addr_6502) {
+  return ((addr_6502 >> 8) == 0x01);
+}
+
 static void
 jit_compiler_get_opcode_details(struct jit_compiler* p_compiler,
                                 struct jit_opcode_details* p_details,
@@ -295,6 +394,15 @@ jit_compiler_get_opcode_details(struct jit_compiler* p_compiler,
     p_details->num_bytes_6502 = (k_6502_addr_space_size - addr_6502);
   }
 
+  /* Code in the stack page may be overwritten by stack pushes, and those
+   * aren't checked for self-modification. If we can't compile it as a dynamic
+   * opcode, bounce to the interpreter which always fetches fresh opcodes.
+   */
+  if (jit_compiler_is_stack_page_addr(addr_6502) &&
+      p_compiler->option_no_dynamic_opcode) {
+    use_interp = 1;
+  }
+
   p_details->p_host_address_prefix_end = NULL;
   p_details->p_host_address_start = NULL;
   p_details->cycles_run_start = -1;
@@ -804,9 +912,8 @@ jit_compiler_add_history(struct jit_compiler* p_compiler,
                          int is_self_modified,
                          uint64_t ticks) {
   uint32_t ring_buffer_index;
-  struct jit_compile_history* p_history = &p_compiler->history[addr_6502];
-
-  p_history->opcode = opcode_6502;
+  struct jit_compile_history* p_history =
+      jit_compiler_get_or_create_history(p_compiler, addr_6502);
 
   ring_buffer_index = p_history->ring_buffer_index;
 
@@ -832,8 +939,9 @@ jit_compiler_get_dynamic_history(struct jit_compiler* p_compiler,
                                  int is_self_modify_invalidated) {
   uint32_t i;
   uint64_t ticks = timing_get_total_timer_ticks(p_compiler->p_timing);
-  struct jit_compile_history* p_history = &p_compiler->history[addr_6502];
-  uint32_t index = p_history->ring_buffer_index;
+  struct jit_compile_history* p_history =
+      jit_compiler_get_history(p_compiler, addr_6502);
+  uint32_t index;
   int had_opcode_mismatch = 0;
 
   uint32_t new_opcode_count = 0;
@@ -841,6 +949,11 @@ jit_compiler_get_dynamic_history(struct jit_compiler* p_compiler,
   uint32_t any_opcode_count = 0;
   uint32_t any_opcode_invalidate_count = 0;
 
+  if (p_history == NULL) {
+    p_history = &p_compiler->empty_history;
+  }
+  index = p_history->ring_buffer_index;
+
   for (i = 0; i < k_opcode_history_length; ++i) {
     int was_self_modified;
     int32_t old_opcode = p_history->opcodes[index];
@@ -1077,7 +1190,7 @@ jit_compiler_find_compile_bounds(struct jit_compiler* p_compiler) {
     }
 
     /* Exit loop condition: next opcode is the start of a block boundary. */
-    if (p_compiler->addr_is_block_start[addr_6502]) {
+    if (p_compiler->addr_flags[addr_6502] & k_addr_flag_block_start) {
       break;
     }
 
@@ -1093,8 +1206,11 @@ jit_compiler_find_compile_bounds(struct jit_compiler* p_compiler) {
   /* Terminate the list of opcodes. */
   jit_compiler_make_last_opcode(p_compiler, p_details);
 
-  p_compiler->addr_is_block_continuation[addr_6502] =
-      is_next_block_continuation;
+  if (is_next_block_continuation) {
+    p_compiler->addr_flags[addr_6502] |= k_addr_flag_block_continuation;
+  } else {
+    p_compiler->addr_flags[addr_6502] &= ~k_addr_flag_block_continuation;
+  }
 }
 
 static void
@@ -1114,6 +1230,7 @@ jit_compiler_check_dynamics(struct jit_compiler* p_compiler) {
     uint32_t any_opcode_invalidate_count;
     int is_self_modify_invalidated = 0;
     int is_dynamic_operand_match = 0;
+    int is_stack_page_code;
 
     opcode_6502_len = p_details->num_bytes_6502;
     assert(opcode_6502_len > 0);
@@ -1124,6 +1241,7 @@ jit_compiler_check_dynamics(struct jit_compiler* p_compiler) {
      */
     addr_6502 = p_details->addr_6502;
     opcode_6502 = p_details->opcode_6502;
+    is_stack_page_code = jit_compiler_is_stack_page_addr(addr_6502);
     if (jit_metadata_has_invalidated_code(p_jit_metadata, addr_6502)) {
       is_self_modify_invalidated = 1;
     }
@@ -1157,6 +1275,7 @@ jit_compiler_check_dynamics(struct jit_compiler* p_compiler) {
      * Exile uses it a lot; you'll also find it in Thrust, Galaforce 2.
      */
     if (!p_compiler->option_no_sub_instruction &&
+        !is_stack_page_code &&
         (new_opcode_invalidate_count == 0) &&
         (new_opcode_count >= p_compiler->dynamic_trigger) &&
         (opcode_6502_len > 1)) {
@@ -1193,6 +1312,7 @@ jit_compiler_check_dynamics(struct jit_compiler* p_compiler) {
     }
 
     if (!p_compiler->option_no_dynamic_operand &&
+        !is_stack_page_code &&
         (new_opcode_invalidate_count >= p_compiler->dynamic_trigger)) {
       is_dynamic_operand_match = 1;
       /* This can be a no-op if we don't support dynamic operands with this
@@ -1214,8 +1334,12 @@ jit_compiler_check_dynamics(struct jit_compiler* p_compiler) {
     if (p_compiler->option_no_dynamic_opcode) {
       continue;
     }
+    /* Stack page code is always compiled as dynamic opcodes. See
+     * jit_compiler_get_opcode_details().
+     */
     if ((any_opcode_invalidate_count < p_compiler->dynamic_trigger) &&
-        !is_dynamic_operand_match) {
+        !is_dynamic_operand_match &&
+        !is_stack_page_code) {
       continue;
     }
     if (p_compiler->log_dynamic) {
@@ -1239,6 +1363,31 @@ jit_compiler_check_dynamics(struct jit_compiler* p_compiler) {
   }
 }
 
+static void
+jit_compiler_check_debug_traps(struct jit_compiler* p_compiler) {
+  struct jit_opcode_details* p_details;
+  struct debug_struct* p_debug = p_compiler->p_debug;
+
+  if (!debug_is_jit_sparse(p_debug)) {
+    return;
+  }
+
+  for (p_details = &p_compiler->opcode_details[0];
+       p_details->addr_6502 != -1;
+       p_details += p_details->num_bytes_6502) {
+    int32_t index;
+    if (jit_opcode_find_uop(p_details, &index, k_opcode_debug) == NULL) {
+      continue;
+    }
+    if (debug_needs_trap(p_debug,
+                         p_details->addr_6502,
+                         p_details->is_dynamic_operand)) {
+      continue;
+    }
+    jit_opcode_erase_uop(p_details, k_opcode_debug);
+  }
+}
+
 static void
 jit_compiler_asm_rewrite(struct jit_compiler* p_compiler) {
   struct jit_opcode_details* p_details;
@@ -1479,11 +1628,13 @@ jit_compiler_update_metadata(struct jit_compiler* p_compiler) {
   int32_t start_addr_6502 = p_compiler->start_addr_6502;
   uint32_t cycles = 0;
   uint32_t jit_ptr = 0;
+  int is_zero_page_writer = 0;
 
   for (p_details = &p_compiler->opcode_details[0];
        p_details->addr_6502 != -1;
        p_details += p_details->num_bytes_6502) {
     uint8_t i;
+    struct jit_compile_fixup* p_fixup;
     void* p_host_address_prefix_end = p_details->p_host_address_prefix_end;
     void* p_host_address_start = p_details->p_host_address_start;
     uint32_t num_bytes_6502 = p_details->num_bytes_6502;
@@ -1495,6 +1646,23 @@ jit_compiler_update_metadata(struct jit_compiler* p_compiler) {
       cycles = p_details->cycles_run_start;
     }
 
+    /* Track blocks that write the zero page without self-modify checks. If
+     * code later shows up in the zero page, just these blocks need
+     * invalidating.
+     */
+    if (!p_compiler->compile_for_code_in_zero_page &&
+        (p_details->opmem_6502 & k_opmem_write_flag)) {
+      switch (p_details->opmode_6502) {
+      case k_zpg:
+      case k_zpx:
+      case k_zpy:
+        is_zero_page_writer = 1;
+        break;
+      default:
+        break;
+      }
+    }
+
     /* Advance current jit pointer to the greater of end of any block prefix,
      * or start of block body.
      */
@@ -1514,17 +1682,10 @@ jit_compiler_update_metadata(struct jit_compiler* p_compiler) {
 
       if (addr_6502 != p_compiler->start_addr_6502) {
         jit_metadata_invalidate_jump_target(p_jit_metadata, addr_6502);
-        p_compiler->addr_is_block_start[addr_6502] = 0;
-        p_compiler->addr_is_block_continuation[addr_6502] = 0;
+        p_compiler->addr_flags[addr_6502] = 0;
       }
 
-      p_compiler->addr_nz_fixup[addr_6502] = -1;
-      p_compiler->addr_v_fixup[addr_6502] = 0;
-      p_compiler->addr_c_fixup[addr_6502] = 0;
-      p_compiler->addr_a_fixup[addr_6502] = -1;
-      p_compiler->addr_x_fixup[addr_6502] = -1;
-      p_compiler->addr_y_fixup[addr_6502] = -1;
-      p_compiler->addr_cycles_fixup[addr_6502] = -1;
+      jit_compiler_clear_fixup(&p_compiler->addr_fixups[addr_6502]);
 
       if (i != 0) {
         if (p_details->is_dynamic_operand) {
@@ -1542,19 +1703,27 @@ jit_compiler_update_metadata(struct jit_compiler* p_compiler) {
                                  p_details->self_modify_invalidated,
                                  ticks);
 
-        p_compiler->addr_cycles_fixup[addr_6502] = cycles;
-        p_compiler->addr_a_fixup[addr_6502] = p_details->reg_a;
-        p_compiler->addr_x_fixup[addr_6502] = p_details->reg_x;
-        p_compiler->addr_y_fixup[addr_6502] = p_details->reg_y;
-        p_compiler->addr_nz_fixup[addr_6502] = p_details->nz_flags_location;
-        p_compiler->addr_c_fixup[addr_6502] = p_details->c_flag_location;
-        p_compiler->addr_v_fixup[addr_6502] = p_details->v_flag_location;
+        p_fixup = &p_compiler->addr_fixups[addr_6502];
+        assert(cycles <= INT16_MAX);
+        p_fixup->cycles = cycles;
+        p_fixup->a = p_details->reg_a;
+        p_fixup->x = p_details->reg_x;
+        p_fixup->y = p_details->reg_y;
+        p_fixup->nz = p_details->nz_flags_location;
+        p_fixup->c = p_details->c_flag_location;
+        p_fixup->v = p_details->v_flag_location;
       }
 
       addr_6502++;
     }
     cycles -= p_details->max_cycles;
   }
+
+  if (is_zero_page_writer) {
+    p_compiler->addr_flags[start_addr_6502] |= k_addr_flag_zero_page_writer;
+  } else {
+    p_compiler->addr_flags[start_addr_6502] &= ~k_addr_flag_zero_page_writer;
+  }
 }
 
 uint32_t
@@ -1575,10 +1744,11 @@ jit_compiler_prepare_compile_block(struct jit_compiler* p_compiler,
   p_compiler->p_last_opcode = NULL;
   p_compiler->sub_instruction_addr_6502 = -1;
 
-  if (p_compiler->addr_is_block_start[start_addr_6502]) {
+  if (p_compiler->addr_flags[start_addr_6502] & k_addr_flag_block_start) {
     /* Retain any existing block start determination. */
     is_block_start = 1;
-  } else if (!p_compiler->addr_is_block_continuation[start_addr_6502] &&
+  } else if (!(p_compiler->addr_flags[start_addr_6502] &
+               k_addr_flag_block_continuation) &&
              !is_invalidation) {
     /* New block starts are only created if this isn't a compilation
      * continuation, and this isn't an invalidation of existing code.
@@ -1586,8 +1756,12 @@ jit_compiler_prepare_compile_block(struct jit_compiler* p_compiler,
     is_block_start = 1;
   }
 
-  p_compiler->addr_is_block_start[start_addr_6502] = is_block_start;
-  /* NOTE: p_compiler->addr_is_block_continuation[start_addr_6502] is left as
+  if (is_block_start) {
+    p_compiler->addr_flags[start_addr_6502] |= k_addr_flag_block_start;
+  } else {
+    p_compiler->addr_flags[start_addr_6502] &= ~k_addr_flag_block_start;
+  }
+  /* NOTE: the block continuation flag for start_addr_6502 is left as
    * it currently is.
    * The only way to clear it is compile across the continuation boundary.
    */
@@ -1604,6 +1778,11 @@ jit_compiler_prepare_compile_block(struct jit_compiler* p_compiler,
    */
   jit_compiler_check_dynamics(p_compiler);
 
+  /* In sparse debug mode, drop the debug traps the debugger doesn't need. */
+  if (p_compiler->debug) {
+    jit_compiler_check_debug_traps(p_compiler);
+  }
+
   /* If the block didn't end with an explicit jump, put it in. */
   p_details = p_compiler->p_last_opcode;
   assert(p_details->addr_6502 != -1);
@@ -1689,13 +1868,14 @@ jit_compiler_fixup_state(struct jit_compiler* p_compiler,
                          int64_t countdown,
                          uint64_t host_flags) {
   uint16_t pc_6502 = p_state_6502->abi_state.reg_pc;
-  int32_t cycles_fixup = p_compiler->addr_cycles_fixup[pc_6502];
-  int32_t nz_fixup = p_compiler->addr_nz_fixup[pc_6502];
-  int32_t v_fixup = p_compiler->addr_v_fixup[pc_6502];
-  int32_t c_fixup = p_compiler->addr_c_fixup[pc_6502];
-  int32_t a_fixup = p_compiler->addr_a_fixup[pc_6502];
-  int32_t x_fixup = p_compiler->addr_x_fixup[pc_6502];
-  int32_t y_fixup = p_compiler->addr_y_fixup[pc_6502];
+  struct jit_compile_fixup* p_fixup = &p_compiler->addr_fixups[pc_6502];
+  int32_t cycles_fixup = p_fixup->cycles;
+  int32_t nz_fixup = p_fixup->nz;
+  int32_t v_fixup = p_fixup->v;
+  int32_t c_fixup = p_fixup->c;
+  int32_t a_fixup = p_fixup->a;
+  int32_t x_fixup = p_fixup->x;
+  int32_t y_fixup = p_fixup->y;
 
   /* cycles_fixup can be 0 in the case the opcode is bouncing to the
    * interpreter -- an invalid opcode, for example.
@@ -1791,31 +1971,27 @@ jit_compiler_memory_range_invalidate(struct jit_compiler* p_compiler,
   assert(addr_end <= k_6502_addr_space_size);
 
   for (i = addr; i < addr_end; ++i) {
-    uint32_t j;
-    for (j = 0; j < k_opcode_history_length; ++j) {
-      p_compiler->history[i].times[j] = 0;
-      p_compiler->history[i].opcodes[j] = -1;
-      p_compiler->history[i].was_self_modified[j] = 0;
-    }
-    p_compiler->history[i].ring_buffer_index = 0;
-    p_compiler->history[i].opcode = -1;
-    p_compiler->addr_is_block_start[i] = 0;
-    p_compiler->addr_is_block_continuation[i] = 0;
-
-    p_compiler->addr_cycles_fixup[i] = -1;
-    p_compiler->addr_nz_fixup[i] = -1;
-    p_compiler->addr_v_fixup[i] = 0;
-    p_compiler->addr_c_fixup[i] = 0;
-    p_compiler->addr_a_fixup[i] = -1;
-    p_compiler->addr_x_fixup[i] = -1;
-    p_compiler->addr_y_fixup[i] = -1;
+    struct jit_compile_history* p_history = jit_compiler_get_history(p_compiler,
+                                                                     i);
+    if (p_history != NULL) {
+      jit_compiler_reset_history(p_history);
+    }
+    p_compiler->addr_flags[i] = 0;
+    jit_compiler_clear_fixup(&p_compiler->addr_fixups[i]);
   }
 }
 
 int
 jit_compiler_is_block_continuation(struct jit_compiler* p_compiler,
                                    uint16_t addr_6502) {
-  return p_compiler->addr_is_block_continuation[addr_6502];
+  return !!(p_compiler->addr_flags[addr_6502] &
+            k_addr_flag_block_continuation);
+}
+
+int
+jit_compiler_is_block_start(struct jit_compiler* p_compiler,
+                            uint16_t addr_6502) {
+  return !!(p_compiler->addr_flags[addr_6502] & k_addr_flag_block_start);
 }
 
 int
@@ -1830,12 +2006,20 @@ jit_compiler_set_compiling_for_code_in_zero_page(
   p_compiler->compile_for_code_in_zero_page = value;
 }
 
+int
+jit_compiler_is_block_zero_page_writer(struct jit_compiler* p_compiler,
+                                       uint16_t block_addr_6502) {
+  return !!(p_compiler->addr_flags[block_addr_6502] &
+            k_addr_flag_zero_page_writer);
+}
+
 void
 jit_compiler_tag_address_as_dynamic(struct jit_compiler* p_compiler,
                                     uint16_t addr_6502) {
   uint32_t i;
   uint64_t ticks = timing_get_total_timer_ticks(p_compiler->p_timing);
-  struct jit_compile_history* p_history = &p_compiler->history[addr_6502];
+  struct jit_compile_history* p_history =
+      jit_compiler_get_or_create_history(p_compiler, addr_6502);
 
   p_history->ring_buffer_index = 0;
 
@@ -1846,6 +2030,123 @@ jit_compiler_tag_address_as_dynamic(struct jit_compiler* p_compiler,
   }
 }
 
+uint8_t*
+jit_compiler_save_profile(struct jit_compiler* p_compiler, uint32_t* p_len) {
+  uint32_t i;
+  uint8_t* p_buf;
+  uint8_t* p_record;
+  uint32_t num_records = 0;
+
+  p_buf = util_malloc(k_profile_header_len +
+                      (k_6502_addr_space_size * k_profile_record_len));
+  p_record = (p_buf + k_profile_header_len);
+
+  for (i = 0; i < k_6502_addr_space_size; ++i) {
+    uint32_t j;
+    uint8_t valid_mask = 0;
+    uint8_t self_modified_mask = 0;
+    uint8_t addr_flags = (p_compiler->addr_flags[i] & k_profile_addr_flags);
+    struct jit_compile_history* p_history = jit_compiler_get_history(p_compiler,
+                                                                     i);
+    if (p_history == NULL) {
+      p_history = &p_compiler->empty_history;
+    }
+    for (j = 0; j < k_opcode_history_length; ++j) {
+      if (p_history->opcodes[j] != -1) {
+        valid_mask |= (1 << j);
+      }
+      if (p_history->was_self_modified[j]) {
+        self_modified_mask |= (1 << j);
+      }
+    }
+    if ((addr_flags == 0) && (valid_mask == 0)) {
+      continue;
+    }
+
+    p_record[0] = (i & 0xFF);
+    p_record[1] = (i >> 8);
+    p_record[2] = addr_flags;
+    p_record[3] = p_history->ring_buffer_index;
+    p_record[4] = valid_mask;
+    p_record[5] = self_modified_mask;
+    for (j = 0; j < k_opcode_history_length; ++j) {
+      p_record[6 + j] = (uint8_t) p_history->opcodes[j];
+    }
+    p_record += k_profile_record_len;
+    num_records++;
+  }
+
+  (void) memcpy(p_buf, k_profile_magic, k_profile_magic_len);
+  p_buf[8] = (num_records & 0xFF);
+  p_buf[9] = ((num_records >> 8) & 0xFF);
+  p_buf[10] = ((num_records >> 16) & 0xFF);
+  p_buf[11] = (num_records >> 24);
+
+  *p_len = (k_profile_header_len + (num_records * k_profile_record_len));
+  return p_buf;
+}
+
+int32_t
+jit_compiler_load_profile(struct jit_compiler* p_compiler,
+                          uint8_t* p_buf,
+                          uint32_t len) {
+  uint32_t i;
+  uint32_t num_records;
+  uint8_t* p_record;
+  uint64_t ticks = timing_get_total_timer_ticks(p_compiler->p_timing);
+
+  if ((len < k_profile_header_len) ||
+      (memcmp(p_buf, k_profile_magic, k_profile_magic_len) != 0)) {
+    return -1;
+  }
+  num_records = util_read_le32(p_buf + k_profile_magic_len);
+  if ((num_records > k_6502_addr_space_size) ||
+      (len != (k_profile_header_len + (num_records * k_profile_record_len)))) {
+    return -1;
+  }
+
+  p_record = (p_buf + k_profile_header_len);
+  for (i = 0; i < num_records; ++i) {
+    if (p_record[3] >= k_opcode_history_length) {
+      return -1;
+    }
+    p_record += k_profile_record_len;
+  }
+
+  p_record = (p_buf + k_profile_header_len);
+  for (i = 0; i < num_records; ++i) {
+    uint32_t j;
+    uint16_t addr_6502 = util_read_le16(p_record);
+    uint8_t addr_flags = (p_record[2] & k_profile_addr_flags);
+    uint8_t ring_buffer_index = p_record[3];
+    uint8_t valid_mask = p_record[4];
+    uint8_t self_modified_mask = p_record[5];
+
+    p_compiler->addr_flags[addr_6502] |= addr_flags;
+    if (valid_mask != 0) {
+      /* Recorded times are meaningless in a new session, so the history is
+       * treated as having just happened.
+       */
+      struct jit_compile_history* p_history =
+          jit_compiler_get_or_create_history(p_compiler, addr_6502);
+      p_history->ring_buffer_index = ring_buffer_index;
+      for (j = 0; j < k_opcode_history_length; ++j) {
+        if (valid_mask & (1 << j)) {
+          p_history->opcodes[j] = p_record[6 + j];
+          p_history->times[j] = ticks;
+        } else {
+          p_history->opcodes[j] = -1;
+          p_history->times[j] = 0;
+        }
+        p_history->was_self_modified[j] = !!(self_modified_mask & (1 << j));
+      }
+    }
+    p_record += k_profile_record_len;
+  }
+
+  return num_records;
+}
+
 void
 jit_compiler_testing_set_optimizing(struct jit_compiler* p_compiler,
                                     int optimizing) {
@@ -1891,17 +2192,17 @@ jit_compiler_testing_set_accurate_cycles(struct jit_compiler* p_compiler,
 int32_t
 jit_compiler_testing_get_cycles_fixup(struct jit_compiler* p_compiler,
                                       uint16_t addr) {
-  return p_compiler->addr_cycles_fixup[addr];
+  return p_compiler->addr_fixups[addr].cycles;
 }
 
 int32_t
 jit_compiler_testing_get_a_fixup(struct jit_compiler* p_compiler,
                                  uint16_t addr) {
-  return p_compiler->addr_a_fixup[addr];
+  return p_compiler->addr_fixups[addr].a;
 }
 
 int32_t
 jit_compiler_testing_get_x_fixup(struct jit_compiler* p_compiler,
                                  uint16_t addr) {
-  return p_compiler->addr_x_fixup[addr];
+  return p_compiler->addr_fixups[addr].x;
 }
@@ -43,15 +43,30 @@ void jit_compiler_memory_range_invalidate(struct jit_compiler* p_compiler,
 
 int jit_compiler_is_block_continuation(struct jit_compiler* p_compiler,
                                        uint16_t addr_6502);
+int jit_compiler_is_block_start(struct jit_compiler* p_compiler,
+                                uint16_t addr_6502);
 
 int jit_compiler_is_compiling_for_code_in_zero_page(
     struct jit_compiler* p_compiler);
 void jit_compiler_set_compiling_for_code_in_zero_page(
     struct jit_compiler* p_compiler, int value);
+int jit_compiler_is_block_zero_page_writer(struct jit_compiler* p_compiler,
+                                           uint16_t block_addr_6502);
 
 void jit_compiler_tag_address_as_dynamic(struct jit_compiler* p_compiler,
                                          uint16_t addr_6502);
 
+/* Returns a buffer, owned by the caller, containing the compiler decisions
+ * worth persisting across runs: dynamic opcode / operand history and block
+ * boundaries.
+ */
+uint8_t* jit_compiler_save_profile(struct jit_compiler* p_compiler,
+                                   uint32_t* p_len);
+/* Returns the number of records loaded, or -1 if the profile is malformed. */
+int32_t jit_compiler_load_profile(struct jit_compiler* p_compiler,
+                                  uint8_t* p_buf,
+                                  uint32_t len);
+
 void jit_compiler_testing_set_optimizing(struct jit_compiler* p_compiler,
                                          int is_optimizing);
 void jit_compiler_testing_set_dynamic_operand(struct jit_compiler* p_compiler,
@@ -8,12 +8,19 @@
 
 #include <assert.h>
 
+enum {
+  k_jit_metadata_no_code_block = 0xFFFF,
+};
+
 struct jit_metadata {
   void* p_jit_base;
   void* p_jit_ptr_no_code;
   void* p_jit_ptr_dynamic;
   uint32_t* p_jit_ptrs;
-  int32_t code_blocks[k_6502_addr_space_size];
+  /* Stored as the distance back to the code block start, which is always
+   * small, to halve the footprint.
+   */
+  uint16_t code_block_offsets[k_6502_addr_space_size];
 };
 
 struct jit_metadata*
@@ -32,7 +39,7 @@ jit_metadata_create(void* p_jit_base,
   for (i = 0; i < k_6502_addr_space_size; ++i) {
     p_metadata->p_jit_ptrs[i] =
         (uint32_t) (uintptr_t) p_metadata->p_jit_ptr_no_code;
-    p_metadata->code_blocks[i] = -1;
+    p_metadata->code_block_offsets[i] = k_jit_metadata_no_code_block;
   }
 
   return p_metadata;
@@ -66,14 +73,19 @@ jit_metadata_get_host_jit_ptr(struct jit_metadata* p_metadata,
 int
 jit_metadata_is_pc_in_code_block(struct jit_metadata* p_metadata,
                                  uint16_t addr_6502) {
-  int ret = (p_metadata->code_blocks[addr_6502] != -1);
+  int ret = (p_metadata->code_block_offsets[addr_6502] !=
+             k_jit_metadata_no_code_block);
   return ret;
 }
 
 int32_t
 jit_metadata_get_code_block(struct jit_metadata* p_metadata,
                             uint16_t addr_6502) {
-  return p_metadata->code_blocks[addr_6502];
+  uint16_t offset = p_metadata->code_block_offsets[addr_6502];
+  if (offset == k_jit_metadata_no_code_block) {
+    return -1;
+  }
+  return (uint16_t) (addr_6502 - offset);
 }
 
 int
@@ -108,7 +120,8 @@ jit_metadata_has_invalidated_code(struct jit_metadata* p_metadata,
     return 1;
   }
 
-  assert(p_metadata->code_blocks[addr_6502] != -1);
+  assert(p_metadata->code_block_offsets[addr_6502] !=
+         k_jit_metadata_no_code_block);
 
   return asm_jit_is_invalidated_code_at(p_jit_ptr);
 }
@@ -191,7 +204,12 @@ void
 jit_metadata_set_code_block(struct jit_metadata* p_jit_metadata,
                             uint16_t addr_6502,
                             int32_t code_block) {
-  p_jit_metadata->code_blocks[addr_6502] = code_block;
+  uint16_t offset = k_jit_metadata_no_code_block;
+  if (code_block != -1) {
+    offset = (uint16_t) (addr_6502 - code_block);
+    assert(offset != k_jit_metadata_no_code_block);
+  }
+  p_jit_metadata->code_block_offsets[addr_6502] = offset;
 }
 
 void
@@ -3,6 +3,7 @@
 #include "bbc_options.h"
 #include "log.h"
 #include "os_lock.h"
+#include "snapshot.h"
 #include "state_6502.h"
 #include "timing.h"
 #include "util.h"
@@ -57,6 +58,10 @@ struct keyboard_struct {
   char* p_replay_file_name;
   uint32_t replay_timer_id;
   uint32_t rewind_timer_id;
+  /* Where in the capture or replay file the next rewind should resume from.
+   * Zero means the start.
+   */
+  uint64_t rewind_pos;
 
   uint8_t replay_next_num_keys;
   uint8_t replay_next_keys[k_keyboard_queue_size];
@@ -679,9 +684,15 @@ keyboard_create(struct timing_struct* p_timing, struct bbc_options* p_options) {
   p_keyboard->p_active = p_keyboard->p_physical_keyboard;
 
   p_keyboard->replay_timer_id =
-      timing_register_timer(p_timing, keyboard_replay_timer_tick, p_keyboard);
+      timing_register_timer(p_timing,
+                            "keyboard_replay",
+                            keyboard_replay_timer_tick,
+                            p_keyboard);
   p_keyboard->rewind_timer_id =
-      timing_register_timer(p_timing, keyboard_rewind_timer_fired, p_keyboard);
+      timing_register_timer(p_timing,
+                            "keyboard_rewind",
+                            keyboard_rewind_timer_fired,
+                            p_keyboard);
 
   for (i = 0; i < sizeof(p_keyboard->remap); ++i) {
     p_keyboard->remap[i] = i;
@@ -740,6 +751,8 @@ keyboard_power_on_reset(struct keyboard_struct* p_keyboard) {
   uint32_t i;
   uint8_t keyboard_links = p_keyboard->keyboard_links;
 
+  p_keyboard->rewind_pos = 0;
+
   (void) memset(p_keyboard->p_virtual_keyboard,
                 '\0',
                 sizeof(struct keyboard_state));
@@ -790,6 +803,9 @@ keyboard_start_file_replay(struct keyboard_struct* p_keyboard,
   if (memcmp(buf, k_capture_header, strlen(k_capture_header))) {
     util_bail("capture file has bad header");
   }
+  if (p_keyboard->rewind_pos != 0) {
+    util_file_seek(p_file, p_keyboard->rewind_pos);
+  }
 
   (void) timing_start_timer_with_value(p_keyboard->p_timing,
                                        p_keyboard->replay_timer_id,
@@ -797,6 +813,36 @@ keyboard_start_file_replay(struct keyboard_struct* p_keyboard,
   keyboard_read_replay_frame(p_keyboard);
 }
 
+static void
+keyboard_copy_capture_prefix(struct keyboard_struct* p_keyboard,
+                             const char* p_src_file_name,
+                             uint64_t end_pos) {
+  char buf[4096];
+  uint64_t to_go;
+
+  struct util_file* p_src_file = util_file_open(p_src_file_name, 0, 0);
+
+  util_file_seek(p_src_file, k_capture_header_size);
+  to_go = (end_pos - k_capture_header_size);
+  while (to_go > 0) {
+    uint64_t ret;
+    uint64_t length = sizeof(buf);
+    if (to_go < length) {
+      length = to_go;
+    }
+    ret = util_file_read(p_src_file, buf, length);
+    if (ret != length) {
+      util_bail("capture file truncated");
+    }
+    util_file_write(p_keyboard->p_capture_file, buf, length);
+
+    to_go -= length;
+  }
+  util_file_flush(p_keyboard->p_capture_file);
+
+  util_file_close(p_src_file);
+}
+
 void
 keyboard_set_replay_file_name(struct keyboard_struct* p_keyboard,
                               const char* p_name) {
@@ -899,6 +945,14 @@ keyboard_rewind(struct keyboard_struct* p_keyboard, uint64_t stop_cycles) {
 
     keyboard_set_capture_file_name(p_keyboard, p_capture_file_name);
     util_free(p_capture_file_name);
+    /* Rewinding to a snapshot keeps the capture up to the snapshot, and the
+     * replay picks up from there.
+     */
+    if (p_keyboard->rewind_pos > k_capture_header_size) {
+      keyboard_copy_capture_prefix(p_keyboard,
+                                   p_new_replay_file_name,
+                                   p_keyboard->rewind_pos);
+    }
     keyboard_set_replay_file_name(p_keyboard, p_new_replay_file_name);
     util_free(p_new_replay_file_name);
   } else {
@@ -928,6 +982,35 @@ keyboard_rewind(struct keyboard_struct* p_keyboard, uint64_t stop_cycles) {
   }
 }
 
+void
+keyboard_snapshot(struct keyboard_struct* p_keyboard,
+                  struct snapshot_struct* p_snapshot) {
+  uint64_t pos = 0;
+
+  if (!snapshot_is_load(p_snapshot)) {
+    if (keyboard_is_capturing(p_keyboard)) {
+      pos = util_file_get_pos(p_keyboard->p_capture_file);
+    } else if (keyboard_is_replaying(p_keyboard)) {
+      /* The next replay frame has already been read. */
+      pos = util_file_get_pos(p_keyboard->p_replay_file);
+      pos -= (sizeof(uint64_t) + 1 + (p_keyboard->replay_next_num_keys * 2));
+    }
+  }
+
+  SNAPSHOT_FIELD(p_snapshot, pos);
+  /* A restore resumes via replay, which runs on the virtual keyboard. */
+  if (snapshot_is_load(p_snapshot)) {
+    p_keyboard->rewind_pos = pos;
+    snapshot_io(p_snapshot,
+                p_keyboard->p_virtual_keyboard,
+                sizeof(struct keyboard_state));
+  } else {
+    snapshot_io(p_snapshot,
+                p_keyboard->p_active,
+                sizeof(struct keyboard_state));
+  }
+}
+
 int
 keyboard_bbc_is_key_pressed(struct keyboard_struct* p_keyboard,
                             uint8_t row,
@@ -6,6 +6,7 @@
 struct keyboard_struct;
 
 struct bbc_options;
+struct snapshot_struct;
 struct timing_struct;
 
 enum {
@@ -93,4 +94,7 @@ void keyboard_system_key_pressed(struct keyboard_struct* p_keyboard,
 void keyboard_system_key_released(struct keyboard_struct* p_keyboard,
                                   uint8_t key);
 
+void keyboard_snapshot(struct keyboard_struct* p_keyboard,
+                       struct snapshot_struct* p_snapshot);
+
 #endif /* BEEBJIT_KEYBOARD_H */
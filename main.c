@@ -1,6 +1,8 @@
 #include "bbc.h"
 #include "config.h"
 #include "cpu_driver.h"
+#include "debug.h"
+#include "frame_stream.h"
 #include "keyboard.h"
 #include "log.h"
 #include "os_channel.h"
@@ -65,6 +67,85 @@ main_save_frame(const char* p_frames_dir,
   util_file_close(p_file);
 }
 
+static uint64_t*
+main_load_frame_hashes(const char* p_file_name, uint32_t* p_num_hashes) {
+  uint64_t len;
+  char* p_buf;
+  struct util_file* p_file = util_file_open(p_file_name, 0, 0);
+  uint64_t* p_hashes = NULL;
+
+  len = util_file_get_size(p_file);
+  p_buf = util_malloc(len + 1);
+  len = util_file_read(p_file, p_buf, len);
+  util_file_close(p_file);
+  p_buf[len] = '\0';
+
+  if (!util_parse_frame_hashes(&p_hashes, p_num_hashes, p_buf)) {
+    util_bail("frame hash file %s out of sequence", p_file_name);
+  }
+  util_free(p_buf);
+
+  return p_hashes;
+}
+
+static void
+main_frame_hash(struct util_file* p_file,
+                const uint64_t* p_check_hashes,
+                uint32_t num_check_hashes,
+                uint32_t frame,
+                uint64_t hash) {
+  if (p_file != NULL) {
+    char line[64];
+    int len = snprintf(line,
+                       sizeof(line),
+                       "%"PRIu32" %016"PRIx64"\n",
+                       frame,
+                       hash);
+    util_file_write(p_file, line, len);
+  }
+  if (p_check_hashes == NULL) {
+    return;
+  }
+  if (frame >= num_check_hashes) {
+    util_bail("frame %"PRIu32" has no hash to check against", frame);
+  }
+  if (hash != p_check_hashes[frame]) {
+    util_bail("frame %"PRIu32" hash %016"PRIx64" mismatch, expected %016"PRIx64,
+              frame,
+              hash,
+              p_check_hashes[frame]);
+  }
+}
+
+static uint32_t
+main_crc32_file(uint32_t crc, const char* p_file_name) {
+  uint64_t len;
+  uint8_t* p_buf;
+  struct util_file* p_file = util_file_open(p_file_name, 0, 0);
+
+  len = util_file_get_size(p_file);
+  p_buf = util_malloc(len);
+  len = util_file_read(p_file, p_buf, len);
+  util_file_close(p_file);
+
+  crc = util_crc32_add(crc, p_buf, len);
+  util_free(p_buf);
+
+  return crc;
+}
+
+static void
+main_stop_bbc(struct bbc_struct* p_bbc) {
+  /* Asks the BBC thread to exit; the main loop then sees k_message_exited and
+   * takes the normal shutdown path.
+   */
+  struct cpu_driver* p_cpu_driver = bbc_get_cpu_driver(p_bbc);
+  if (!(p_cpu_driver->p_funcs->get_flags(p_cpu_driver) & k_cpu_flag_exited)) {
+    p_cpu_driver->p_funcs->apply_flags(p_cpu_driver, k_cpu_flag_exited, 0);
+    p_cpu_driver->p_funcs->set_exit_value(p_cpu_driver, 0xFFFFFFFF);
+  }
+}
+
 static void
 beebjit_main(void) {
   int i_args;
@@ -103,7 +184,19 @@ beebjit_main(void) {
   const char* p_create_hfe_file = NULL;
   const char* p_create_hfe_spec = NULL;
   const char* p_frames_dir = ".";
+  const char* p_frames_file = NULL;
+  const char* p_frames_format = NULL;
+  const char* p_frames_hash_name = NULL;
+  const char* p_frames_hash_check_name = NULL;
+  struct util_file* p_frames_hash_file = NULL;
+  uint64_t* p_frames_hash_check = NULL;
+  uint32_t frames_hash_check_count = 0;
+  struct frame_stream_struct* p_frame_stream = NULL;
+  const char* p_profile_dir = NULL;
+  char profile_file_name[256];
+  uint32_t profile_crc = util_crc32_init();
   const char* p_commands = NULL;
+  const char* p_decode_trace_name = NULL;
   int debug_flag = 0;
   int run_flag = 0;
   int print_flag = 0;
@@ -139,6 +232,10 @@ beebjit_main(void) {
   uint64_t frame_cycles = 0;
   uint32_t max_frames = 1;
   int is_exit_on_max_frames_flag = 0;
+  int is_max_frames_exit = 0;
+  int frames_dedup_flag = 0;
+  int frames_hash_flag = 0;
+  int frames_hash_state_flag = 0;
   uint32_t keyboard_num_remaps = 0;
   uint8_t keyboard_remap_from[k_max_keyboard_remaps];
   uint8_t keyboard_remap_to[k_max_keyboard_remaps];
@@ -277,6 +374,23 @@ beebjit_main(void) {
     } else if (has_1 && !strcmp(arg, "-frames-dir")) {
       p_frames_dir = val1;
       ++i_args;
+    } else if (has_1 && !strcmp(arg, "-frames-file")) {
+      p_frames_file = val1;
+      ++i_args;
+    } else if (has_1 && !strcmp(arg, "-frames-format")) {
+      p_frames_format = val1;
+      ++i_args;
+    } else if (has_1 && !strcmp(arg, "-frames-hash")) {
+      p_frames_hash_name = val1;
+      frames_hash_flag = 1;
+      ++i_args;
+    } else if (has_1 && !strcmp(arg, "-frames-check")) {
+      p_frames_hash_check_name = val1;
+      frames_hash_flag = 1;
+      ++i_args;
+    } else if (has_1 && !strcmp(arg, "-profile-dir")) {
+      p_profile_dir = val1;
+      ++i_args;
     } else if (has_1 && !strcmp(arg, "-expect")) {
       (void) sscanf(val1, "%"PRIx32, &expect);
       ++i_args;
@@ -289,6 +403,9 @@ beebjit_main(void) {
     } else if (has_1 && !strcmp(arg, "-commands")) {
       p_commands = val1;
       ++i_args;
+    } else if (has_1 && !strcmp(arg, "-decode-trace")) {
+      p_decode_trace_name = val1;
+      ++i_args;
     } else if (!strcmp(arg, "-debug")) {
       debug_flag = 1;
     } else if (!strcmp(arg, "-run")) {
@@ -334,6 +451,11 @@ beebjit_main(void) {
       extended_roms_flag = 1;
     } else if (!strcmp(arg, "-exit-on-max-frames")) {
       is_exit_on_max_frames_flag = 1;
+    } else if (!strcmp(arg, "-frames-dedup")) {
+      frames_dedup_flag = 1;
+    } else if (!strcmp(arg, "-frames-hash-state")) {
+      frames_hash_flag = 1;
+      frames_hash_state_flag = 1;
     } else if (!strcmp(arg, "-master")) {
       is_master_flag = 1;
       config_apply_master_128_mos320(&os_rom_name,
@@ -387,11 +509,21 @@ beebjit_main(void) {
 "-max-frames     <m>: max frame images to save, default 1.\n"
 "-exit-on-max-frames: exit the process once max-frames is hit.\n"
 "-frames-dir     <d>: directory for frame files, default '.'.\n"
+"-frames-file    <f>: stream frames to a single file or pipe <f> instead.\n"
+"-frames-format  <t>: format for -frames-file: y4m (default) or png.\n"
+"                     y4m is 50Hz, so can't be used with video:frames-skip.\n"
+"-frames-dedup      : with -frames-file, drop repeats of the previous frame.\n"
+"-frames-hash    <f>: log a hash of each frame to <f> instead of saving it.\n"
+"-frames-check   <f>: fail on any frame hash not matching log <f>.\n"
+"-frames-hash-state : hash screen memory and CRTC/ULA state, not pixels.\n"
+"                     Skips rendering. Needs -fast.\n"
+"-profile-dir    <d>: load and save JIT profile files in directory <d>.\n"
 "-watford           : for a model B with a 1770, load Watford DDFS ROM.\n"
 "-opus              : for a model B with a 1770, load Opus DDOS ROM.\n"
 "-dfs12             : for a model B with an 8271, load newer DFS v1.2 ROM.\n"
 "-extended-roms     : disable ROM slot aliasing.\n"
 "-key-remap  <f> <t>: remap physical key from / to. See EXAMPLES.\n"
+"-decode-trace   <f>: print a trace from -debug -opt debug:trace=<f>.\n"
 "");
       exit(0);
     } else {
@@ -402,6 +534,36 @@ beebjit_main(void) {
     }
   }
 
+  if (frames_hash_state_flag && !fast_flag) {
+    util_bail("-frames-hash-state needs -fast");
+  }
+  /* Frame streaming options would otherwise be silently ignored. */
+  if ((p_frames_file != NULL) || (p_frames_format != NULL) ||
+      frames_dedup_flag) {
+    uint32_t frames_skip = 0;
+    if (p_frames_file == NULL) {
+      util_bail("-frames-format and -frames-dedup need -frames-file");
+    }
+    if (frame_cycles == 0) {
+      util_bail("-frames-file needs -frame-cycles");
+    }
+    if (frames_hash_flag) {
+      util_bail("-frames-file can't be used with frame hashing");
+    }
+    if (p_frames_format == NULL) {
+      p_frames_format = "y4m";
+    }
+    if (!frame_stream_is_format_valid(p_frames_format)) {
+      util_bail("unknown -frames-format %s", p_frames_format);
+    }
+    (void) util_get_u32_option(&frames_skip, p_opt_flags, "video:frames-skip=");
+    if (!strcmp(p_frames_format, "y4m") &&
+        ((frames_skip > 0) ||
+         util_has_option(p_opt_flags, "video:frames-skip=auto"))) {
+      util_bail("-frames-format y4m is 50Hz, so can't use video:frames-skip");
+    }
+  }
+
   if (util_has_option(p_log_flags, "os:addrs")) {
     log_do_log(k_log_misc,
                k_log_info,
@@ -411,6 +573,11 @@ beebjit_main(void) {
                p_opt_flags);
   }
 
+  if (p_decode_trace_name != NULL) {
+    debug_decode_trace(p_decode_trace_name);
+    exit(0);
+  }
+
   (void) memset(os_rom, '\0', k_bbc_rom_size);
   (void) memset(load_rom, '\0', k_bbc_rom_size);
 
@@ -578,12 +745,45 @@ beebjit_main(void) {
       (void) memset(load_rom, '\0', k_bbc_rom_size);
       (void) util_file_read_fully(p_rom_name, load_rom, k_bbc_rom_size);
       bbc_load_rom(p_bbc, i, load_rom);
+      profile_crc = util_crc32_add(profile_crc, load_rom, k_bbc_rom_size);
     }
     if (sideways_ram[i]) {
       bbc_make_sideways_ram(p_bbc, i);
     }
   }
 
+  /* The JIT profile, which pre-seeds JIT compiler decisions learned in previous
+   * runs, is keyed by the software loaded: the ROMs plus disc and tape images,
+   * along with the CPU mode and -opt flags.
+   */
+  if (p_profile_dir != NULL) {
+    struct cpu_driver* p_cpu_driver = bbc_get_cpu_driver(p_bbc);
+    profile_crc = util_crc32_add(profile_crc, os_rom, k_bbc_rom_size);
+    /* Different CPU modes and options make different compile decisions. */
+    profile_crc = util_crc32_add(profile_crc, (uint8_t*) &mode, sizeof(mode));
+    profile_crc = util_crc32_add(profile_crc,
+                                 (uint8_t*) p_opt_flags,
+                                 strlen(p_opt_flags));
+    for (i = 0; i <= 1; ++i) {
+      for (j = 0; j < k_max_discs_per_drive; ++j) {
+        if (disc_names[i][j] != NULL) {
+          profile_crc = main_crc32_file(profile_crc, disc_names[i][j]);
+        }
+      }
+    }
+    for (i = 0; i < k_max_tapes; ++i) {
+      if (p_tape_file_names[i] != NULL) {
+        profile_crc = main_crc32_file(profile_crc, p_tape_file_names[i]);
+      }
+    }
+    (void) snprintf(profile_file_name,
+                    sizeof(profile_file_name),
+                    "%s/beebjit_%.8X.jitprof",
+                    p_profile_dir,
+                    util_crc32_finish(profile_crc));
+    p_cpu_driver->p_funcs->load_profile(p_cpu_driver, &profile_file_name[0]);
+  }
+
   /* Set up keyboard capture / replay / links. */
   p_keyboard = bbc_get_keyboard(p_bbc);
   if (capture_name) {
@@ -626,6 +826,24 @@ beebjit_main(void) {
     render_create_internal_buffer(p_render);
   }
 
+  if (frames_hash_flag) {
+    if (p_frames_hash_name != NULL) {
+      p_frames_hash_file = util_file_open(p_frames_hash_name, 1, 1);
+    }
+    if (p_frames_hash_check_name != NULL) {
+      p_frames_hash_check = main_load_frame_hashes(p_frames_hash_check_name,
+                                                   &frames_hash_check_count);
+    }
+    video_set_frame_hash_enabled(bbc_get_video(p_bbc),
+                                 frames_hash_state_flag);
+  } else if (p_frames_file != NULL) {
+    p_frame_stream = frame_stream_create(p_frames_file,
+                                         p_frames_format,
+                                         render_get_width(p_render),
+                                         render_get_height(p_render),
+                                         frames_dedup_flag);
+  }
+
   if (!headless_flag && !util_has_option(p_opt_flags, "sound:off")) {
     int ret;
     char* p_device_name = NULL;
@@ -689,6 +907,7 @@ beebjit_main(void) {
       int save_frame;
       uint64_t cycles;
       int do_ack_rendered;
+      uint64_t frame_hash;
 
       bbc_client_receive_message(p_bbc, &message);
       if (message.data[0] == k_message_exited) {
@@ -701,6 +920,7 @@ beebjit_main(void) {
       do_clear_after_paint = message.data[2];
       cycles = message.data[3];
       do_ack_rendered = message.data[4];
+      frame_hash = message.data[5];
 
       save_frame = 0;
       if ((frame_cycles > 0) &&
@@ -708,26 +928,51 @@ beebjit_main(void) {
           (save_frame_count < max_frames)) {
         save_frame = 1;
       }
-      if (window_open || save_frame) {
+      if (window_open || (save_frame && !frames_hash_state_flag)) {
+        int is_rendered = 1;
         if (do_full_render) {
-          video_render_full_frame(p_video);
+          is_rendered = video_render_full_frame(p_video);
+        }
+        if (is_rendered) {
+          render_process_full_buffer(p_render);
         }
-        render_process_full_buffer(p_render);
         if (window_open) {
           os_window_sync_buffer_to_screen(p_window);
         }
-        if (save_frame) {
-          main_save_frame(p_frames_dir, save_frame_count, p_render);
-          save_frame_count++;
-          if (is_exit_on_max_frames_flag && (save_frame_count == max_frames)) {
-            log_do_log(k_log_misc, k_log_info, "save frame count exit");
-            exit(0);
+        if (save_frame && !frames_hash_state_flag) {
+          if (frames_hash_flag) {
+            frame_hash = util_hash64_add(util_hash64_init(),
+                                         render_get_buffer(p_render),
+                                         render_get_buffer_size(p_render));
+            frame_hash = util_hash64_finish(frame_hash);
+          } else if (p_frame_stream != NULL) {
+            frame_stream_add(p_frame_stream, render_get_buffer(p_render));
+          } else {
+            main_save_frame(p_frames_dir, save_frame_count, p_render);
           }
         }
         if (do_clear_after_paint) {
           render_clear_buffer(p_render);
         }
       }
+      if (save_frame) {
+        if (frames_hash_flag) {
+          if (frames_hash_state_flag && !do_full_render) {
+            util_bail("-frames-hash-state needs -fast");
+          }
+          main_frame_hash(p_frames_hash_file,
+                          p_frames_hash_check,
+                          frames_hash_check_count,
+                          save_frame_count,
+                          frame_hash);
+        }
+        save_frame_count++;
+        if (is_exit_on_max_frames_flag && (save_frame_count == max_frames)) {
+          log_do_log(k_log_misc, k_log_info, "save frame count exit");
+          is_max_frames_exit = 1;
+          main_stop_bbc(p_bbc);
+        }
+      }
       if (do_ack_rendered) {
         message.data[0] = k_message_render_done;
         bbc_client_send_message(p_bbc, &message);
@@ -737,27 +982,37 @@ beebjit_main(void) {
     if (window_open && os_poller_handle_triggered(p_poller, 1)) {
       os_window_process_events(p_window);
       if (os_window_is_closed(p_window)) {
-        struct cpu_driver* p_cpu_driver = bbc_get_cpu_driver(p_bbc);
         log_do_log(k_log_misc, k_log_info, "OS window closed");
         window_open = 0;
-        if (!(p_cpu_driver->p_funcs->get_flags(p_cpu_driver) &
-              k_cpu_flag_exited)) {
-          p_cpu_driver->p_funcs->apply_flags(p_cpu_driver,
-                                             k_cpu_flag_exited,
-                                             0);
-          p_cpu_driver->p_funcs->set_exit_value(p_cpu_driver, 0xFFFFFFFF);
-        }
+        main_stop_bbc(p_bbc);
       }
     }
   }
 
   run_result = bbc_get_run_result(p_bbc);
-  if (expect) {
+  if (expect && !is_max_frames_exit) {
     if (run_result != expect) {
       util_bail("run result %X is not as expected (%X)", run_result, expect);
     }
   }
 
+  if (p_profile_dir != NULL) {
+    struct cpu_driver* p_cpu_driver = bbc_get_cpu_driver(p_bbc);
+    p_cpu_driver->p_funcs->save_profile(p_cpu_driver, &profile_file_name[0]);
+  }
+
+  if (p_frame_stream != NULL) {
+    frame_stream_destroy(p_frame_stream);
+  }
+  if (p_frames_hash_file != NULL) {
+    util_file_close(p_frames_hash_file);
+  }
+  if (save_frame_count < frames_hash_check_count) {
+    util_bail("only %"PRIu32" of %"PRIu32" frames checked",
+              save_frame_count,
+              frames_hash_check_count);
+  }
+  util_free(p_frames_hash_check);
   os_poller_destroy(p_poller);
   if (p_window != NULL) {
     os_window_destroy(p_window);
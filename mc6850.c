@@ -2,6 +2,7 @@
 
 #include "bbc_options.h"
 #include "log.h"
+#include "snapshot.h"
 #include "state_6502.h"
 #include "util.h"
 
@@ -452,3 +453,21 @@ mc6850_write(struct mc6850_struct* p_serial, uint8_t reg, uint8_t val) {
 
   mc6850_update_irq(p_serial);
 }
+
+void
+mc6850_snapshot(struct mc6850_struct* p_serial,
+                struct snapshot_struct* p_snapshot) {
+  SNAPSHOT_FIELD(p_snapshot, p_serial->acia_control);
+  SNAPSHOT_FIELD(p_snapshot, p_serial->acia_status);
+  SNAPSHOT_FIELD(p_snapshot, p_serial->acia_receive);
+  SNAPSHOT_FIELD(p_snapshot, p_serial->acia_transmit);
+  SNAPSHOT_FIELD(p_snapshot, p_serial->state);
+  SNAPSHOT_FIELD(p_snapshot, p_serial->acia_receive_sr);
+  SNAPSHOT_FIELD(p_snapshot, p_serial->acia_receive_sr_count);
+  SNAPSHOT_FIELD(p_snapshot, p_serial->parity_accumulator);
+  SNAPSHOT_FIELD(p_snapshot, p_serial->clock_divide_counter);
+  SNAPSHOT_FIELD(p_snapshot, p_serial->is_sr_parity_error);
+  SNAPSHOT_FIELD(p_snapshot, p_serial->is_sr_framing_error);
+  SNAPSHOT_FIELD(p_snapshot, p_serial->is_sr_overflow);
+  SNAPSHOT_FIELD(p_snapshot, p_serial->is_DCD);
+}
@@ -6,6 +6,7 @@
 struct mc6850_struct;
 
 struct bbc_options;
+struct snapshot_struct;
 struct state_6502;
 struct tape_struct;
 
@@ -33,4 +34,7 @@ void mc6850_receive_bit(struct mc6850_struct* p_serial, int bit);
 int mc6850_receive(struct mc6850_struct* p_serial, uint8_t byte);
 uint8_t mc6850_transmit(struct mc6850_struct* p_serial);
 
+void mc6850_snapshot(struct mc6850_struct* p_serial,
+                     struct snapshot_struct* p_snapshot);
+
 #endif /* BEEBJIT_MC6850_H */
@@ -13,6 +13,11 @@ void os_alloc_free_aligned(void* p);
 
 intptr_t os_alloc_get_memory_handle(size_t size);
 void os_alloc_free_memory_handle(intptr_t handle);
+/* Like os_alloc_get_memory_handle() but backed by the named file, which is
+ * created or truncated to size. Shared mappings of it are written back to
+ * the file, even if the process later crashes.
+ */
+intptr_t os_alloc_get_file_handle(const char* p_file_name, size_t size);
 
 void* os_alloc_get_mapping_addr(struct os_alloc_mapping* p_mapping);
 struct os_alloc_mapping* os_alloc_get_mapping_from_handle(intptr_t handle,
@@ -4,6 +4,7 @@
 #include "util.h"
 
 #include <assert.h>
+#include <fcntl.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
@@ -63,6 +64,22 @@ os_alloc_get_memory_handle(size_t size) {
   return fd;
 }
 
+intptr_t
+os_alloc_get_file_handle(const char* p_file_name, size_t size) {
+  int ret;
+  int fd = open(p_file_name, (O_RDWR | O_CREAT | O_TRUNC), 0644);
+  if (fd < 0) {
+    util_bail("open failed");
+  }
+
+  ret = ftruncate(fd, size);
+  if (ret != 0) {
+    util_bail("ftruncate failed");
+  }
+
+  return fd;
+}
+
 void
 os_alloc_free_memory_handle(intptr_t h) {
   int fd = (int) h;
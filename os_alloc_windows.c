@@ -42,6 +42,35 @@ os_alloc_get_memory_handle(size_t size) {
   return (intptr_t) ret;
 }
 
+intptr_t
+os_alloc_get_file_handle(const char* p_file_name, size_t size) {
+  HANDLE ret;
+  HANDLE file = CreateFileA(p_file_name,
+                            (GENERIC_READ | GENERIC_WRITE),
+                            FILE_SHARE_READ,
+                            NULL,
+                            CREATE_ALWAYS,
+                            FILE_ATTRIBUTE_NORMAL,
+                            NULL);
+  if (file == INVALID_HANDLE_VALUE) {
+    util_bail("CreateFileA failed");
+  }
+
+  ret = CreateFileMapping(file,
+                          NULL,
+                          PAGE_READWRITE,
+                          (size >> 32),
+                          (size & 0xffffffff),
+                          NULL);
+  if (ret == NULL) {
+    util_bail("CreateFileMapping failed");
+  }
+  /* The mapping object keeps the file open. */
+  (void) CloseHandle(file);
+
+  return (intptr_t) ret;
+}
+
 void
 os_alloc_free_memory_handle(intptr_t h) {
   BOOL ret = CloseHandle((HANDLE) h);
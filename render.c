@@ -34,6 +34,7 @@ struct render_struct {
   uint32_t* p_buffer;
   uint32_t* p_buffer_end;
   int is_buffer_owned;
+  uint32_t buffer_generation;
 
   struct teletext_struct* p_teletext;
 
@@ -229,6 +230,11 @@ render_get_buffer(struct render_struct* p_render) {
   return p_render->p_buffer;
 }
 
+uint32_t
+render_get_buffer_generation(struct render_struct* p_render) {
+  return p_render->buffer_generation;
+}
+
 uint32_t
 render_get_buffer_size(struct render_struct* p_render) {
   return (p_render->width * p_render->height * 4);
@@ -244,6 +250,11 @@ render_get_vert_pos(struct render_struct* p_render) {
   return p_render->vert_beam_pos;
 }
 
+int
+render_is_double_size(struct render_struct* p_render) {
+  return p_render->is_double_size;
+}
+
 static inline void
 render_reset_render_pos(struct render_struct* p_render) {
   uint32_t window_horiz_pos;
@@ -1020,6 +1031,7 @@ render_clear_buffer(struct render_struct* p_render) {
   uint32_t size = (render_get_buffer_size(p_render) / 4);
   uint32_t* p_buf = p_render->p_buffer;
 
+  p_render->buffer_generation++;
   for (i = 0; i < size; ++i) {
     /* Full alpha and black. */
     p_buf[i] = 0xff000000;
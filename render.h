@@ -38,10 +38,14 @@ uint32_t render_get_buffer_size(struct render_struct* p_render);
 
 uint32_t render_get_horiz_pos(struct render_struct* p_render);
 uint32_t render_get_vert_pos(struct render_struct* p_render);
+/* If set, render_process_full_buffer() rewrites the buffer in place. */
+int render_is_double_size(struct render_struct* p_render);
 
 uint32_t* render_get_buffer(struct render_struct* p_render);
 void render_set_buffer(struct render_struct* p_render, uint32_t* p_buffer);
 void render_create_internal_buffer(struct render_struct* p_render);
+/* Changes whenever the buffer is cleared. */
+uint32_t render_get_buffer_generation(struct render_struct* p_render);
 
 void render_set_mode(struct render_struct* p_render,
                      int clock_speed,
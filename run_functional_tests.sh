@@ -9,6 +9,12 @@ echo 'Checking Nightshade protection.'
     -headless -fast -accurate -debug \
     -commands 'breakat 1000000;c;writem 03e0 43 48 2e 22 42 2e 4e 49 47 48 54 53 48 22 0d;writem 02e1 ef;b e00;c;q'
 
+echo 'Checking Nightshade protection, sparse JIT debug traps.'
+./beebjit -0 test/misc/protection.ssd \
+    -mode jit \
+    -headless -fast -accurate -debug -opt debug:jit-sparse \
+    -commands 'breakat 1000000;c;writem 03e0 43 48 2e 22 42 2e 4e 49 47 48 54 53 48 22 0d;writem 02e1 ef;b e00;c;q'
+
 echo 'Checking E00 DFS ROM in sideways RAM.'
 # This uses raster-c.ssd for convenience because it has a !BOOT and cleanly
 # executes at $1900 if it loads correctly.
@@ -4,6 +4,7 @@
 #include "log.h"
 #include "mc6850.h"
 #include "os_terminal.h"
+#include "snapshot.h"
 #include "tape.h"
 #include "util.h"
 
@@ -296,3 +297,12 @@ serial_ula_tick(struct serial_ula_struct* p_serial_ula) {
     (void) os_terminal_handle_write_byte(handle_output, val);
   }
 }
+
+void
+serial_ula_snapshot(struct serial_ula_struct* p_serial_ula,
+                    struct snapshot_struct* p_snapshot) {
+  SNAPSHOT_FIELD(p_snapshot, p_serial_ula->is_rs423_selected);
+  SNAPSHOT_FIELD(p_snapshot, p_serial_ula->is_motor_on);
+  SNAPSHOT_FIELD(p_snapshot, p_serial_ula->tape_carrier_count);
+  SNAPSHOT_FIELD(p_snapshot, p_serial_ula->is_tape_DCD);
+}
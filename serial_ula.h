@@ -7,6 +7,7 @@ struct serial_ula_struct;
 
 struct bbc_options;
 struct mc6850_struct;
+struct snapshot_struct;
 struct tape_struct;
 
 struct serial_ula_struct* serial_ula_create(struct mc6850_struct* p_serial,
@@ -34,4 +35,7 @@ void serial_ula_receive_tape_bit(struct serial_ula_struct* p_serial_ula,
 
 void serial_ula_tick(struct serial_ula_struct* p_serial_ula);
 
+void serial_ula_snapshot(struct serial_ula_struct* p_serial_ula,
+                         struct snapshot_struct* p_snapshot);
+
 #endif /* BEEBJIT_SERIAL_ULA__H */
@@ -0,0 +1,145 @@
+#include "snapshot.h"
+
+#include "util.h"
+
+#include <assert.h>
+#include <string.h>
+
+enum {
+  k_snapshot_initial_alloc = 65536,
+};
+
+struct snapshot_struct {
+  uint8_t* p_buf;
+  size_t alloc_length;
+  size_t length;
+  size_t pos;
+  size_t chunk_start;
+  int is_load;
+};
+
+struct snapshot_struct*
+snapshot_create(void) {
+  struct snapshot_struct* p_snapshot =
+      util_mallocz(sizeof(struct snapshot_struct));
+
+  return p_snapshot;
+}
+
+void
+snapshot_destroy(struct snapshot_struct* p_snapshot) {
+  util_free(p_snapshot->p_buf);
+  util_free(p_snapshot);
+}
+
+void
+snapshot_start_save(struct snapshot_struct* p_snapshot) {
+  p_snapshot->is_load = 0;
+  p_snapshot->length = 0;
+  p_snapshot->pos = 0;
+}
+
+void
+snapshot_start_load(struct snapshot_struct* p_snapshot) {
+  p_snapshot->is_load = 1;
+  p_snapshot->pos = 0;
+}
+
+void
+snapshot_finish(struct snapshot_struct* p_snapshot) {
+  if (p_snapshot->is_load) {
+    /* A mismatch means the save and load visits disagree. */
+    if (p_snapshot->pos != p_snapshot->length) {
+      util_bail("snapshot length mismatch");
+    }
+  } else {
+    p_snapshot->length = p_snapshot->pos;
+  }
+}
+
+int
+snapshot_is_load(struct snapshot_struct* p_snapshot) {
+  return p_snapshot->is_load;
+}
+
+size_t
+snapshot_get_length(struct snapshot_struct* p_snapshot) {
+  return p_snapshot->length;
+}
+
+uint8_t*
+snapshot_get_ptr(struct snapshot_struct* p_snapshot) {
+  return p_snapshot->p_buf;
+}
+
+void
+snapshot_set_data(struct snapshot_struct* p_snapshot,
+                  const uint8_t* p_data,
+                  size_t len) {
+  if (len > p_snapshot->alloc_length) {
+    p_snapshot->p_buf = util_realloc(p_snapshot->p_buf, len);
+    p_snapshot->alloc_length = len;
+  }
+  (void) memcpy(p_snapshot->p_buf, p_data, len);
+  p_snapshot->length = len;
+  p_snapshot->pos = 0;
+}
+
+void
+snapshot_io(struct snapshot_struct* p_snapshot, void* p_data, size_t len) {
+  size_t pos = p_snapshot->pos;
+
+  if (p_snapshot->is_load) {
+    if ((pos + len) > p_snapshot->length) {
+      util_bail("snapshot truncated");
+    }
+    (void) memcpy(p_data, (p_snapshot->p_buf + pos), len);
+  } else {
+    size_t alloc_length = p_snapshot->alloc_length;
+    if ((pos + len) > alloc_length) {
+      if (alloc_length == 0) {
+        alloc_length = k_snapshot_initial_alloc;
+      }
+      while ((pos + len) > alloc_length) {
+        alloc_length *= 2;
+      }
+      p_snapshot->p_buf = util_realloc(p_snapshot->p_buf, alloc_length);
+      p_snapshot->alloc_length = alloc_length;
+    }
+    (void) memcpy((p_snapshot->p_buf + pos), p_data, len);
+  }
+
+  p_snapshot->pos = (pos + len);
+}
+
+void
+snapshot_begin_chunk(struct snapshot_struct* p_snapshot, const char* p_tag) {
+  char tag[4];
+  uint32_t chunk_len = 0;
+
+  assert(strlen(p_tag) == sizeof(tag));
+  (void) memcpy(tag, p_tag, sizeof(tag));
+
+  snapshot_io(p_snapshot, tag, sizeof(tag));
+  if (p_snapshot->is_load && memcmp(tag, p_tag, sizeof(tag))) {
+    util_bail("snapshot chunk %s missing", p_tag);
+  }
+  /* The length is patched in by snapshot_end_chunk() on save. */
+  SNAPSHOT_FIELD(p_snapshot, chunk_len);
+
+  p_snapshot->chunk_start = p_snapshot->pos;
+}
+
+void
+snapshot_end_chunk(struct snapshot_struct* p_snapshot) {
+  size_t chunk_start = p_snapshot->chunk_start;
+  uint32_t chunk_len = (p_snapshot->pos - chunk_start);
+  uint8_t* p_len = (p_snapshot->p_buf + chunk_start - sizeof(chunk_len));
+
+  if (!p_snapshot->is_load) {
+    (void) memcpy(p_len, &chunk_len, sizeof(chunk_len));
+  } else if (memcmp(p_len, &chunk_len, sizeof(chunk_len))) {
+    util_bail("snapshot chunk %.4s size mismatch",
+              (const char*) (p_len - 4));
+  }
+}
@@ -0,0 +1,42 @@
+#ifndef BEEBJIT_SNAPSHOT_H
+#define BEEBJIT_SNAPSHOT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* An in-memory image of machine state. Each module provides one function that
+ * visits its state fields in a fixed order; the same function both saves and
+ * loads, depending on the mode the snapshot is in.
+ */
+struct snapshot_struct;
+
+struct snapshot_struct* snapshot_create(void);
+void snapshot_destroy(struct snapshot_struct* p_snapshot);
+
+void snapshot_start_save(struct snapshot_struct* p_snapshot);
+void snapshot_start_load(struct snapshot_struct* p_snapshot);
+void snapshot_finish(struct snapshot_struct* p_snapshot);
+
+int snapshot_is_load(struct snapshot_struct* p_snapshot);
+size_t snapshot_get_length(struct snapshot_struct* p_snapshot);
+uint8_t* snapshot_get_ptr(struct snapshot_struct* p_snapshot);
+
+/* Replaces the contents, e.g. with a snapshot read from a file, ready to load.
+ */
+void snapshot_set_data(struct snapshot_struct* p_snapshot,
+                       const uint8_t* p_data,
+                       size_t len);
+
+void snapshot_io(struct snapshot_struct* p_snapshot, void* p_data, size_t len);
+
+/* Chunks are a 4 character tag and a length, wrapped around a module's state.
+ * A load checks both, so a mismatched or reordered visit fails loudly.
+ */
+void snapshot_begin_chunk(struct snapshot_struct* p_snapshot,
+                          const char* p_tag);
+void snapshot_end_chunk(struct snapshot_struct* p_snapshot);
+
+#define SNAPSHOT_FIELD(p_snapshot, field)                                     \
+  snapshot_io((p_snapshot), &(field), sizeof(field))
+
+#endif /* BEEBJIT_SNAPSHOT_H */
@@ -5,6 +5,7 @@
 #include "os_sound.h"
 #include "os_thread.h"
 #include "os_time.h"
+#include "snapshot.h"
 #include "timing.h"
 #include "util.h"
 
@@ -692,3 +693,17 @@ sound_set_state(struct sound_struct* p_sound,
   p_sound->noise_frequency = noise_frequency;
   p_sound->noise_rng = noise_rng;
 }
+
+void
+sound_snapshot(struct sound_struct* p_sound,
+               struct snapshot_struct* p_snapshot) {
+  SNAPSHOT_FIELD(p_snapshot, p_sound->counter);
+  SNAPSHOT_FIELD(p_snapshot, p_sound->output);
+  SNAPSHOT_FIELD(p_snapshot, p_sound->noise_rng);
+  SNAPSHOT_FIELD(p_snapshot, p_sound->volume);
+  SNAPSHOT_FIELD(p_snapshot, p_sound->period);
+  SNAPSHOT_FIELD(p_snapshot, p_sound->noise_frequency);
+  SNAPSHOT_FIELD(p_snapshot, p_sound->noise_type);
+  SNAPSHOT_FIELD(p_snapshot, p_sound->latched_bits);
+  SNAPSHOT_FIELD(p_snapshot, p_sound->prev_system_ticks);
+}
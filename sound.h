@@ -5,6 +5,7 @@
 
 struct bbc_options;
 struct os_sound_struct;
+struct snapshot_struct;
 struct timing_struct;
 
 struct sound_struct;
@@ -45,4 +46,7 @@ void sound_set_state(struct sound_struct* p_sound,
 
 void sound_sn_write(struct sound_struct* p_sound, uint8_t data);
 
+void sound_snapshot(struct sound_struct* p_sound,
+                    struct snapshot_struct* p_snapshot);
+
 #endif /* BEEBJIT_SOUND_H */
@@ -2,9 +2,11 @@
 
 #include "bbc.h"
 #include "log.h"
+#include "snapshot.h"
 #include "sound.h"
 #include "state_6502.h"
 #include "util.h"
+#include "util_compress.h"
 #include "via.h"
 #include "video.h"
 
@@ -104,6 +106,27 @@ struct bem_v2x {
 
 static const uint64_t k_snapshot_size = 327885;
 
+/* The native format is a header followed by the chunked machine state from
+ * bbc_snapshot(), optionally zlib compressed.
+ */
+struct state_native_header {
+  char magic[16];
+  uint32_t version;
+  uint32_t flags;
+  uint64_t length;
+} __attribute__((packed));
+
+static const char* k_state_native_magic = "beebjit-state";
+enum {
+  k_state_native_version = 1,
+};
+enum {
+  k_state_native_flag_compressed = 1,
+};
+enum {
+  k_state_native_max_ratio = 1032,
+};
+
 static void
 state_read(unsigned char* p_buf, const char* p_file_name) {
   struct bem_v2x* p_bem;
@@ -129,8 +152,8 @@ state_read(unsigned char* p_buf, const char* p_file_name) {
              p_bem->pc);
 }
 
-void
-state_load(struct bbc_struct* p_bbc, const char* p_file_name) {
+static void
+state_load_bem(struct bbc_struct* p_bbc, const char* p_file_name) {
   struct bem_v2x* p_bem;
   uint8_t snapshot[k_snapshot_size];
   uint8_t volumes[4];
@@ -276,8 +299,117 @@ state_load(struct bbc_struct* p_bbc, const char* p_file_name) {
                   p_bem->sn_shift);
 }
 
+static int
+state_read_native(struct snapshot_struct* p_snapshot,
+                  struct state_native_header* p_header,
+                  const char** p_p_error,
+                  const char* p_file_name) {
+  /* Returns 1 with the snapshot data filled in, 0 if this isn't a native
+   * state file, or -1 with an error if it is one but it's damaged.
+   */
+  struct util_file* p_file;
+  uint64_t file_len;
+  uint64_t data_len;
+  uint8_t* p_data;
+  int is_length_ok;
+
+  p_file = util_file_open(p_file_name, 0, 0);
+  file_len = util_file_get_size(p_file);
+  if ((util_file_read(p_file, p_header, sizeof(*p_header)) !=
+          sizeof(*p_header)) ||
+      (strncmp(p_header->magic, k_state_native_magic,
+               sizeof(p_header->magic)))) {
+    util_file_close(p_file);
+    return 0;
+  }
+  if (p_header->version != k_state_native_version) {
+    util_file_close(p_file);
+    *p_p_error = "unsupported state file version";
+    return -1;
+  }
+
+  /* Check the claimed length against what the data can hold before it sizes
+   * any allocation. Deflate can't expand by more than 1032:1.
+   */
+  data_len = (file_len - sizeof(*p_header));
+  if (p_header->flags & k_state_native_flag_compressed) {
+    is_length_ok =
+        (p_header->length <= (data_len * k_state_native_max_ratio));
+  } else {
+    is_length_ok = (p_header->length == data_len);
+  }
+  if (!is_length_ok || (p_header->length == 0)) {
+    util_file_close(p_file);
+    *p_p_error = "state file truncated";
+    return -1;
+  }
+
+  p_data = util_malloc(data_len);
+  if (util_file_read(p_file, p_data, data_len) != data_len) {
+    util_file_close(p_file);
+    util_free(p_data);
+    *p_p_error = "state file read failed";
+    return -1;
+  }
+  util_file_close(p_file);
+
+  if (p_header->flags & k_state_native_flag_compressed) {
+    size_t length = p_header->length;
+    uint8_t* p_uncompressed = util_malloc(length);
+    int ret = util_uncompress(&length, p_data, data_len, p_uncompressed);
+    util_free(p_data);
+    if ((ret != 0) || (length != p_header->length)) {
+      util_free(p_uncompressed);
+      *p_p_error = "state file decompression failed";
+      return -1;
+    }
+    p_data = p_uncompressed;
+  }
+
+  snapshot_set_data(p_snapshot, p_data, p_header->length);
+  util_free(p_data);
+
+  return 1;
+}
+
+static int
+state_load_native(struct bbc_struct* p_bbc, const char* p_file_name) {
+  struct state_native_header header;
+  const char* p_error = NULL;
+  struct snapshot_struct* p_snapshot = snapshot_create();
+  int ret = state_read_native(p_snapshot, &header, &p_error, p_file_name);
+
+  if (ret == 0) {
+    snapshot_destroy(p_snapshot);
+    return 0;
+  } else if (ret < 0) {
+    util_bail("%s: %s", p_file_name, p_error);
+  }
+
+  log_do_log(k_log_misc,
+             k_log_info,
+             "Loading beebjit state, version %"PRIu32", %"PRIu64" bytes",
+             header.version,
+             header.length);
+
+  snapshot_start_load(p_snapshot);
+  bbc_snapshot(p_bbc, p_snapshot);
+  snapshot_finish(p_snapshot);
+  snapshot_destroy(p_snapshot);
+
+  return 1;
+}
+
 void
-state_save(struct bbc_struct* p_bbc, const char* p_file_name) {
+state_load(struct bbc_struct* p_bbc, const char* p_file_name) {
+  if (state_load_native(p_bbc, p_file_name)) {
+    return;
+  }
+  state_load_bem(p_bbc, p_file_name);
+}
+
+void
+state_save_bem(struct bbc_struct* p_bbc, const char* p_file_name) {
   struct bem_v2x* p_bem;
   uint8_t snapshot[k_snapshot_size];
   uint8_t unused_u8;
@@ -428,3 +560,47 @@ state_save(struct bbc_struct* p_bbc, const char* p_file_name) {
 
   util_file_write_fully(p_file_name, snapshot, k_snapshot_size);
 }
+
+void
+state_save(struct bbc_struct* p_bbc,
+           const char* p_file_name,
+           int is_compressed) {
+  struct state_native_header header;
+  struct util_file* p_file;
+  uint8_t* p_data;
+  size_t data_len;
+  uint8_t* p_compressed = NULL;
+  struct snapshot_struct* p_snapshot = snapshot_create();
+
+  snapshot_start_save(p_snapshot);
+  bbc_snapshot(p_bbc, p_snapshot);
+  snapshot_finish(p_snapshot);
+  p_data = snapshot_get_ptr(p_snapshot);
+  data_len = snapshot_get_length(p_snapshot);
+
+  (void) memset(&header, '\0', sizeof(header));
+  (void) strcpy(header.magic, k_state_native_magic);
+  header.version = k_state_native_version;
+  header.length = data_len;
+
+  if (is_compressed) {
+    size_t compressed_len = util_compress_bound(data_len);
+    p_compressed = util_malloc(compressed_len);
+    if (util_compress(&compressed_len, p_data, data_len, p_compressed) != 0) {
+      util_bail("state compression failed");
+    }
+    header.flags |= k_state_native_flag_compressed;
+    p_data = p_compressed;
+    data_len = compressed_len;
+  }
+
+  p_file = util_file_open(p_file_name, 1, 1);
+  util_file_write(p_file, &header, sizeof(header));
+  util_file_write(p_file, p_data, data_len);
+  util_file_close(p_file);
+
+  util_free(p_compressed);
+  snapshot_destroy(p_snapshot);
+}
+
+#include "test-state.c"
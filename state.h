@@ -5,7 +5,11 @@
 
 struct bbc_struct;
 
+/* Loads either a native state file or a b-em v2.x snapshot. */
 void state_load(struct bbc_struct* p_bbc, const char* p_file_name);
-void state_save(struct bbc_struct* p_bbc, const char* p_file_name);
+void state_save(struct bbc_struct* p_bbc,
+                const char* p_file_name,
+                int is_compressed);
+void state_save_bem(struct bbc_struct* p_bbc, const char* p_file_name);
 
 #endif /* BEEBJIT_STATE_H */
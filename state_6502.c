@@ -1,6 +1,7 @@
 #include "state_6502.h"
 
 #include "defs_6502.h"
+#include "snapshot.h"
 #include "timing.h"
 #include "util.h"
 
@@ -199,3 +200,26 @@ int
 state_6502_has_nmi_high(struct state_6502* p_state_6502) {
   return !!(p_state_6502->state.irq_high & k_state_6502_irq_nmi);
 }
+
+void
+state_6502_snapshot(struct state_6502* p_state_6502,
+                    struct snapshot_struct* p_snapshot) {
+  uint8_t a;
+  uint8_t x;
+  uint8_t y;
+  uint8_t s;
+  uint8_t flags;
+  uint16_t pc;
+
+  state_6502_get_registers(p_state_6502, &a, &x, &y, &s, &flags, &pc);
+  SNAPSHOT_FIELD(p_snapshot, a);
+  SNAPSHOT_FIELD(p_snapshot, x);
+  SNAPSHOT_FIELD(p_snapshot, y);
+  SNAPSHOT_FIELD(p_snapshot, s);
+  SNAPSHOT_FIELD(p_snapshot, flags);
+  SNAPSHOT_FIELD(p_snapshot, pc);
+  state_6502_set_registers(p_state_6502, a, x, y, s, flags, pc);
+
+  SNAPSHOT_FIELD(p_snapshot, p_state_6502->abi_state.irq_fire);
+  SNAPSHOT_FIELD(p_snapshot, p_state_6502->state);
+}
@@ -3,6 +3,8 @@
 
 #include <stdint.h>
 
+struct snapshot_struct;
+
 enum {
   k_state_6502_irq_via_1 = 1,
   k_state_6502_irq_via_2 = 2,
@@ -89,4 +91,7 @@ void state_6502_clear_edge_triggered_irq(struct state_6502* p_state_6502,
 int state_6502_has_irq_high(struct state_6502* p_state_6502);
 int state_6502_has_nmi_high(struct state_6502* p_state_6502);
 
+void state_6502_snapshot(struct state_6502* p_state_6502,
+                         struct snapshot_struct* p_snapshot);
+
 #endif /* BEEBJIT_STATE_6502_H */
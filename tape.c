@@ -3,6 +3,7 @@
 #include "bbc_options.h"
 #include "log.h"
 #include "serial_ula.h"
+#include "snapshot.h"
 #include "tape_csw.h"
 #include "tape_uef.h"
 #include "timing.h"
@@ -73,6 +74,7 @@ tape_create(struct timing_struct* p_timing, struct bbc_options* p_options) {
   p_tape->p_timing = p_timing;
 
   p_tape->timer_id = timing_register_timer(p_timing,
+                                           "tape",
                                            tape_timer_callback,
                                            p_tape);
 
@@ -250,3 +252,10 @@ tape_add_byte(struct tape_struct* p_tape, uint8_t byte) {
   /* Stop bit. */
   tape_add_bit(p_tape, k_tape_bit_1);
 }
+
+void
+tape_snapshot(struct tape_struct* p_tape, struct snapshot_struct* p_snapshot) {
+  SNAPSHOT_FIELD(p_snapshot, p_tape->tape_index);
+  SNAPSHOT_FIELD(p_snapshot, p_tape->tape_buffer_pos);
+  (void) timing_snapshot_timer(p_tape->p_timing, p_tape->timer_id, p_snapshot);
+}
@@ -7,6 +7,7 @@ struct tape_struct;
 
 struct bbc_options;
 struct serial_ula_struct;
+struct snapshot_struct;
 struct timing_struct;
 
 enum {
@@ -42,4 +43,7 @@ void tape_add_bits(struct tape_struct* p_tape, int8_t bit, uint32_t num_bits);
 /* Convenience to add a standard 8N1 format byte. */
 void tape_add_byte(struct tape_struct* p_tape, uint8_t byte);
 
+void tape_snapshot(struct tape_struct* p_tape,
+                   struct snapshot_struct* p_snapshot);
+
 #endif /* BEEBJIT_TAPE_H */
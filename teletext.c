@@ -643,3 +643,41 @@ teletext_VSYNC_changed(struct teletext_struct* p_teletext, int value) {
 
   teletext_new_frame_started(p_teletext);
 }
+
+int
+teletext_is_flash_visible(struct teletext_struct* p_teletext) {
+  return p_teletext->flash_visible_this_frame;
+}
+
+void
+teletext_copy_state(struct teletext_struct* p_dst,
+                    struct teletext_struct* p_src) {
+  /* A byte copy, so that teletext_is_same_state() can compare copies. */
+  (void) memcpy(p_dst, p_src, sizeof(struct teletext_struct));
+}
+
+int
+teletext_is_same_state(struct teletext_struct* p_teletext_1,
+                       struct teletext_struct* p_teletext_2) {
+  struct teletext_struct state_1;
+  struct teletext_struct state_2;
+
+  /* The flash counter only shows through flash_visible_this_frame, which is
+   * compared.
+   */
+  (void) memcpy(&state_1, p_teletext_1, sizeof(state_1));
+  (void) memcpy(&state_2, p_teletext_2, sizeof(state_2));
+  state_1.flash_count = 0;
+  state_2.flash_count = 0;
+
+  return !memcmp(&state_1, &state_2, sizeof(state_1));
+}
+
+void
+teletext_restore_state(struct teletext_struct* p_dst,
+                       struct teletext_struct* p_src) {
+  uint32_t flash_count = p_dst->flash_count;
+
+  (void) memcpy(p_dst, p_src, sizeof(struct teletext_struct));
+  p_dst->flash_count = flash_count;
+}
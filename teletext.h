@@ -19,6 +19,16 @@ void teletext_RA_ISV_changed(struct teletext_struct* p_teletext,
                              int is_isv);
 void teletext_DISPEN_changed(struct teletext_struct* p_teletext, int value);
 void teletext_VSYNC_changed(struct teletext_struct* p_teletext, int value);
+int teletext_is_flash_visible(struct teletext_struct* p_teletext);
+void teletext_copy_state(struct teletext_struct* p_dst,
+                         struct teletext_struct* p_src);
+/* For caching rendered output: compares everything that affects rendering,
+ * and restores a saved state while keeping the flash counter running.
+ */
+int teletext_is_same_state(struct teletext_struct* p_teletext_1,
+                           struct teletext_struct* p_teletext_2);
+void teletext_restore_state(struct teletext_struct* p_dst,
+                            struct teletext_struct* p_src);
 
 void teletext_render(struct teletext_struct* p_teletext,
                      struct render_character_1MHz* p_out,
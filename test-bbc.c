@@ -3,7 +3,9 @@
 #include "test.h"
 
 #include "adc.h"
+#include "emit_6502.h"
 #include "mc6850.h"
+#include "snapshot.h"
 #include "state_6502.h"
 
 static void
@@ -54,7 +56,138 @@ bbc_test_power_on_reset(struct bbc_struct* p_bbc) {
   test_expect_u32(0xE0, val);
 }
 
+static void
+bbc_test_snapshot(struct bbc_struct* p_bbc) {
+  uint8_t val;
+  uint8_t reset_val;
+  struct via_struct* p_system_via = bbc_get_sysvia(p_bbc);
+  struct adc_struct* p_adc = bbc_get_adc(p_bbc);
+  uint8_t* p_mem_read = bbc_get_mem_read(p_bbc);
+  struct snapshot_struct* p_snapshot = snapshot_create();
+
+  bbc_power_on_reset(p_bbc);
+  reset_val = p_mem_read[0x1000];
+  val = (reset_val ^ 0xFF);
+  bbc_set_memory_block(p_bbc, 0x1000, 1, &val);
+  via_write_raw(p_system_via, 0xE, 0x82);
+  adc_write(p_adc, 0, 0);
+
+  snapshot_start_save(p_snapshot);
+  bbc_snapshot(p_bbc, p_snapshot);
+  snapshot_finish(p_snapshot);
+
+  bbc_power_on_reset(p_bbc);
+  test_expect_u32(reset_val, p_mem_read[0x1000]);
+  test_expect_u32(0x80, via_read_raw(p_system_via, 0xE));
+  test_expect_u32(0xE0, adc_read(p_adc, 0));
+
+  /* A load puts back everything, and consumes exactly what was saved. */
+  snapshot_start_load(p_snapshot);
+  bbc_snapshot(p_bbc, p_snapshot);
+  snapshot_finish(p_snapshot);
+  test_expect_u32((reset_val ^ 0xFF), p_mem_read[0x1000]);
+  test_expect_u32(0x82, via_read_raw(p_system_via, 0xE));
+  test_expect_u32(0xA0, adc_read(p_adc, 0));
+
+  snapshot_destroy(p_snapshot);
+  bbc_power_on_reset(p_bbc);
+}
+
+struct bbc_test_run_state {
+  uint8_t regs[5];
+  uint16_t pc;
+  uint64_t cycles;
+  uint64_t ticks;
+  int64_t countdown;
+  uint8_t mem[0x101];
+};
+
+static void
+bbc_test_run_code(struct bbc_struct* p_bbc,
+                  struct bbc_test_run_state* p_run_state) {
+  struct cpu_driver* p_cpu_driver = bbc_get_cpu_driver(p_bbc);
+  struct state_6502* p_state_6502 = bbc_get_6502(p_bbc);
+  struct timing_struct* p_timing = bbc_get_timing(p_bbc);
+  uint8_t* p_mem_read = bbc_get_mem_read(p_bbc);
+
+  (void) p_cpu_driver->p_funcs->enter(p_cpu_driver);
+  p_cpu_driver->p_funcs->apply_flags(p_cpu_driver, 0, k_cpu_flag_exited);
+
+  state_6502_get_registers(p_state_6502,
+                           &p_run_state->regs[0],
+                           &p_run_state->regs[1],
+                           &p_run_state->regs[2],
+                           &p_run_state->regs[3],
+                           &p_run_state->regs[4],
+                           &p_run_state->pc);
+  p_run_state->cycles = state_6502_get_cycles(p_state_6502);
+  p_run_state->ticks = timing_get_total_timer_ticks(p_timing);
+  p_run_state->countdown = timing_get_countdown(p_timing);
+  (void) memcpy(&p_run_state->mem[0],
+                (p_mem_read + 0x2000),
+                sizeof(p_run_state->mem));
+}
+
+static void
+bbc_test_snapshot_rerun(struct bbc_struct* p_bbc) {
+  /* Restoring a snapshot and running again must land in the same state, or
+   * rewind by replay drifts.
+   */
+  uint8_t code[32];
+  uint64_t ticks;
+  struct bbc_test_run_state run1;
+  struct bbc_test_run_state run2;
+  struct util_buffer* p_buf = util_buffer_create();
+  struct state_6502* p_state_6502 = bbc_get_6502(p_bbc);
+  struct snapshot_struct* p_snapshot = snapshot_create();
+
+  bbc_power_on_reset(p_bbc);
+
+  /* Sum into a page, then read the system VIA T1 counter, which depends on
+   * exactly how much time passed.
+   */
+  util_buffer_setup(p_buf, &code[0], sizeof(code));
+  emit_LDX(p_buf, k_imm, 0x00);
+  emit_TXA(p_buf);
+  emit_ADC(p_buf, k_abx, 0x2000);
+  emit_STA(p_buf, k_abx, 0x2000);
+  emit_INX(p_buf);
+  emit_BNE(p_buf, -10);
+  emit_LDA(p_buf, k_abs, 0xFE44);
+  emit_STA(p_buf, k_abs, 0x2100);
+  emit_EXIT(p_buf);
+  bbc_set_memory_block(p_bbc,
+                       0x3000,
+                       util_buffer_get_pos(p_buf),
+                       &code[0]);
+  state_6502_set_pc(p_state_6502, 0x3000);
+
+  snapshot_start_save(p_snapshot);
+  bbc_snapshot(p_bbc, p_snapshot);
+  snapshot_finish(p_snapshot);
+
+  (void) memset(&run1, '\0', sizeof(run1));
+  (void) memset(&run2, '\0', sizeof(run2));
+  ticks = timing_get_total_timer_ticks(bbc_get_timing(p_bbc));
+  bbc_test_run_code(p_bbc, &run1);
+  test_expect_neq(ticks, run1.ticks);
+
+  snapshot_start_load(p_snapshot);
+  bbc_snapshot(p_bbc, p_snapshot);
+  snapshot_finish(p_snapshot);
+  test_expect_u32(0x3000, state_6502_get_pc(p_state_6502));
+
+  bbc_test_run_code(p_bbc, &run2);
+  test_expect_binary((uint8_t*) &run1, (uint8_t*) &run2, sizeof(run1));
+
+  snapshot_destroy(p_snapshot);
+  util_buffer_destroy(p_buf);
+  bbc_power_on_reset(p_bbc);
+}
+
 void
 bbc_test(struct bbc_struct* p_bbc) {
   bbc_test_power_on_reset(p_bbc);
+  bbc_test_snapshot(p_bbc);
+  bbc_test_snapshot_rerun(p_bbc);
 }
@@ -0,0 +1,121 @@
+/* Appends at the end of debug.c. */
+
+#include "test.h"
+
+static void
+debug_test_trace_ring(struct bbc_struct* p_bbc, uint32_t num_records) {
+  static const uint64_t s_cycles[5] =
+      { 100, 102, (102 + 0x12345), (102 + 0x12345 + 3),
+        (102 + 0x12345 + 3 + 0x10000) };
+  const struct debug_trace_record* p_decoded_records[8];
+  uint64_t decoded_cycles[8];
+  uint64_t num_decoded;
+  uint32_t i;
+  struct state_6502* p_state_6502 = bbc_get_6502(p_bbc);
+  uint64_t saved_cycles = state_6502_get_cycles(p_state_6502);
+  struct debug_struct* p_debug = util_mallocz(sizeof(struct debug_struct));
+  struct debug_trace_header* p_header =
+      util_mallocz(sizeof(struct debug_trace_header) +
+                   (num_records * sizeof(struct debug_trace_record)));
+
+  p_header->num_records = num_records;
+  p_debug->p_state_6502 = p_state_6502;
+  p_debug->addr_6502 = -1;
+  p_debug->p_trace_header = p_header;
+  p_debug->p_trace_records = (struct debug_trace_record*) (p_header + 1);
+  p_debug->trace_num_records = num_records;
+
+  /* Two of the deltas need a long delta record, for 7 records in all. */
+  for (i = 0; i < 5; ++i) {
+    state_6502_set_cycles(p_state_6502, s_cycles[i]);
+    p_debug->reg_pc = (0x1000 + i);
+    debug_trace_record(p_debug, 0xEA, 0, 0, 0, -1);
+  }
+  test_expect_u32(7, p_header->total_records);
+
+  num_decoded = debug_trace_decode(p_header,
+                                   p_debug->p_trace_records,
+                                   &p_decoded_records[0],
+                                   &decoded_cycles[0]);
+  /* The ring only kept the last 3 instructions. */
+  test_expect_u32(3, num_decoded);
+  for (i = 0; i < 3; ++i) {
+    test_expect_u32((0x1002 + i), p_decoded_records[i]->reg_pc);
+    test_expect_u32(s_cycles[2 + i], decoded_cycles[i]);
+  }
+
+  state_6502_set_cycles(p_state_6502, saved_cycles);
+  util_free(p_header);
+  util_free(p_debug);
+}
+
+static void
+debug_test_trace(struct bbc_struct* p_bbc) {
+  /* Wrapped with a long delta record in the middle. */
+  debug_test_trace_ring(p_bbc, 4);
+  /* Wrapped with a long delta record as the oldest. */
+  debug_test_trace_ring(p_bbc, 5);
+}
+
+static void
+debug_test_sample(void) {
+  char key_buf[16];
+  struct debug_sample_entry* p_entries;
+  uint32_t num_entries;
+  struct util_tree_node_struct* p_node;
+  struct debug_struct* p_debug = util_mallocz(sizeof(struct debug_struct));
+  uint8_t* p_mem_read = util_mallocz(k_6502_addr_space_size);
+  uint32_t rom_key = (k_6502_addr_space_size + (2 * 0x4000) + 0x10);
+
+  p_debug->p_mem_read = p_mem_read;
+  p_debug->p_sample_counts =
+      util_mallocz(k_debug_sample_num_keys * sizeof(uint32_t));
+  p_debug->p_sample_tree = util_tree_alloc();
+  util_tree_set_root(p_debug->p_sample_tree, util_tree_node_alloc(-1));
+
+  /* A return address on the stack, just after a JSR at $2000. */
+  p_mem_read[0x2000] = 0x20;
+  p_mem_read[0x1F1] = 0x02;
+  p_mem_read[0x1F2] = 0x20;
+
+  debug_sample_add(p_debug, 0x4000, 0xFF, 0);
+  debug_sample_add(p_debug, 0x3000, 0xF0, 0);
+  debug_sample_add(p_debug, 0x8010, 0xF0, 2);
+  debug_sample_add(p_debug, 0x3000, 0xF0, 0);
+  debug_sample_add(p_debug, 0x4000, 0xFF, 0);
+  debug_sample_add(p_debug, 0x3000, 0xF0, 0);
+  test_expect_u32(6, p_debug->sample_total);
+
+  p_entries = debug_sample_get_sorted(p_debug->p_sample_counts, &num_entries);
+  test_expect_u32(3, num_entries);
+  test_expect_u32(0x3000, p_entries[0].key);
+  test_expect_u32(3, p_entries[0].count);
+  test_expect_u32(0x4000, p_entries[1].key);
+  test_expect_u32(2, p_entries[1].count);
+  test_expect_u32(rom_key, p_entries[2].key);
+  test_expect_u32(1, p_entries[2].count);
+  util_free(p_entries);
+
+  debug_sample_key_name(key_buf, sizeof(key_buf), rom_key);
+  test_expect_u32(0, strcmp(key_buf, "rom2:8010"));
+
+  /* The stack: $2000 calls into both $3000 and the sideways ROM. */
+  p_node = util_tree_get_root(p_debug->p_sample_tree);
+  test_expect_u32(2, util_tree_node_get_num_children(p_node));
+  p_node = debug_sample_get_child(p_node, 0x2000);
+  test_expect_u32(0, util_tree_node_get_int_value(p_node));
+  test_expect_u32(2, util_tree_node_get_num_children(p_node));
+  p_node = debug_sample_get_child(p_node, 0x3000);
+  test_expect_u32(3, util_tree_node_get_int_value(p_node));
+
+  util_tree_free(p_debug->p_sample_tree);
+  util_free(p_debug->p_sample_counts);
+  util_free(p_mem_read);
+  util_free(p_debug);
+}
+
+void
+debug_test(struct bbc_struct* p_bbc) {
+  debug_test_trace(p_bbc);
+  debug_test_sample();
+}
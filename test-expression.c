@@ -243,6 +243,31 @@ expression_test_assign(void) {
   expression_destroy(p_expression);
 }
 
+static void
+expression_test_short_circuit(void) {
+  struct expression_struct* p_expression = expression_test_get_expression();
+
+  s_test_var = 0;
+  expression_parse(p_expression, "0 && (var = 5)");
+  test_expect_u32(0, expression_execute(p_expression));
+  test_expect_u32(0, s_test_var);
+  expression_parse(p_expression, "1 || (var = 5)");
+  test_expect_u32(1, expression_execute(p_expression));
+  test_expect_u32(0, s_test_var);
+  expression_parse(p_expression, "1 && (var = 5)");
+  test_expect_u32(1, expression_execute(p_expression));
+  test_expect_u32(5, s_test_var);
+  expression_parse(p_expression, "0 || (var = 0)");
+  test_expect_u32(0, expression_execute(p_expression));
+  test_expect_u32(0, s_test_var);
+
+  expression_parse(p_expression, "(1 + 2) * (3 + 4) == 21 && buf[7] == 101");
+  test_expect_u32(1, expression_execute(p_expression));
+  test_expect_u32(1, expression_execute(p_expression));
+
+  expression_destroy(p_expression);
+}
+
 static void
 expression_test_misc(void) {
   struct expression_struct* p_expression = expression_test_get_expression();
@@ -262,5 +287,6 @@ expression_test() {
   expression_test_operators();
   expression_test_array();
   expression_test_assign();
+  expression_test_short_circuit();
   expression_test_misc();
 }
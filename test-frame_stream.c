@@ -0,0 +1,56 @@
+/* Appends at the end of frame_stream.c. */
+
+#include "test.h"
+
+static const char* s_frame_stream_test_file = "beebjit_test_frames.y4m";
+
+static uint64_t
+frame_stream_test_run(uint8_t* p_out, uint64_t out_len, int is_dedup) {
+  /* Streams 3 frames, the last two the same, and reads back the file. */
+  uint32_t frame[4 * 2];
+  uint64_t len;
+  struct frame_stream_struct* p_stream =
+      frame_stream_create(s_frame_stream_test_file, "y4m", 4, 2, is_dedup);
+
+  (void) memset(frame, '\xFF', sizeof(frame));
+  frame_stream_add(p_stream, &frame[0]);
+  (void) memset(frame, '\0', sizeof(frame));
+  frame_stream_add(p_stream, &frame[0]);
+  frame_stream_add(p_stream, &frame[0]);
+  frame_stream_destroy(p_stream);
+
+  len = util_file_read_fully(s_frame_stream_test_file, p_out, out_len);
+  (void) remove(s_frame_stream_test_file);
+  return len;
+}
+
+void
+frame_stream_test(void) {
+  static const char s_header[] = "YUV4MPEG2 W4 H2 F50:1 Ip A1:1 C444\n";
+  static const char s_frame_header[] = "FRAME\n";
+  uint8_t buf[256];
+  uint64_t len;
+  uint32_t header_len = (sizeof(s_header) - 1);
+  uint32_t frame_len = ((sizeof(s_frame_header) - 1) + (4 * 2 * 3));
+
+  test_expect_u32(1, frame_stream_is_format_valid("y4m"));
+  test_expect_u32(1, frame_stream_is_format_valid("png"));
+  test_expect_u32(0, frame_stream_is_format_valid("gif"));
+
+  len = frame_stream_test_run(&buf[0], sizeof(buf), 0);
+  test_expect_u32((header_len + (3 * frame_len)), len);
+  test_expect_u32(0, memcmp(&buf[0], s_header, header_len));
+  test_expect_u32(0,
+                  memcmp(&buf[header_len],
+                         s_frame_header,
+                         (sizeof(s_frame_header) - 1)));
+  /* White, then black, in studio range YUV. */
+  test_expect_u32(235, buf[header_len + 6]);
+  test_expect_u32(128, buf[header_len + 6 + 8]);
+  test_expect_u32(128, buf[header_len + 6 + 16]);
+  test_expect_u32(16, buf[header_len + frame_len + 6]);
+
+  /* The repeated frame is dropped. */
+  len = frame_stream_test_run(&buf[0], sizeof(buf), 1);
+  test_expect_u32((header_len + (2 * frame_len)), len);
+}
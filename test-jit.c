@@ -1449,6 +1449,218 @@ jit_test_compile_binary(void) {
   test_expect_binary(p_expect, p_binary, expect_len);
 }
 
+static void
+jit_test_zero_page_and_stack_code(void) {
+  void* p_jit_ptr;
+  struct util_buffer* p_buf = util_buffer_create();
+
+  /* A block that writes the zero page and a block that doesn't. */
+  util_buffer_setup(p_buf, (s_p_mem + 0x3C00), 0x80);
+  emit_STA(p_buf, k_zpg, 0x70);
+  emit_EXIT(p_buf);
+  util_buffer_setup(p_buf, (s_p_mem + 0x3C80), 0x80);
+  emit_STA(p_buf, k_abs, 0x3CF0);
+  emit_EXIT(p_buf);
+  state_6502_set_pc(s_p_state_6502, 0x3C00);
+  jit_enter(s_p_cpu_driver);
+  interp_testing_unexit(s_p_interp);
+  state_6502_set_pc(s_p_state_6502, 0x3C80);
+  jit_enter(s_p_cpu_driver);
+  interp_testing_unexit(s_p_interp);
+
+  test_expect_u32(1, jit_compiler_is_block_zero_page_writer(s_p_compiler,
+                                                            0x3C00));
+  test_expect_u32(0, jit_compiler_is_block_zero_page_writer(s_p_compiler,
+                                                            0x3C80));
+  jit_test_expect_block_invalidated(0, 0x3C00);
+  jit_test_expect_block_invalidated(0, 0x3C80);
+
+  /* Compiling zero page code only invalidates the zero page writer. */
+  util_buffer_setup(p_buf, (s_p_mem + 0x70), 0x10);
+  emit_NOP(p_buf);
+  emit_EXIT(p_buf);
+  state_6502_set_pc(s_p_state_6502, 0x70);
+  jit_enter(s_p_cpu_driver);
+  interp_testing_unexit(s_p_interp);
+
+  test_expect_u32(1,
+                  jit_compiler_is_compiling_for_code_in_zero_page(
+                      s_p_compiler));
+  jit_test_expect_block_invalidated(1, 0x3C00);
+  jit_test_expect_block_invalidated(0, 0x3C80);
+  test_expect_eq(-1, jit_metadata_get_code_block(s_p_metadata, 0x3C00));
+  test_expect_eq(0x3C80, jit_metadata_get_code_block(s_p_metadata, 0x3C80));
+  jit_test_expect_code_invalidated(0, 0x70);
+
+  /* The recompiled writer checks for self-modified code. */
+  state_6502_set_pc(s_p_state_6502, 0x3C00);
+  jit_enter(s_p_cpu_driver);
+  interp_testing_unexit(s_p_interp);
+  test_expect_u32(0, jit_compiler_is_block_zero_page_writer(s_p_compiler,
+                                                            0x3C00));
+  jit_test_expect_code_invalidated(1, 0x70);
+
+  jit_compiler_set_compiling_for_code_in_zero_page(s_p_compiler, 0);
+
+  /* Stack page code is always compiled as a dynamic opcode. */
+  util_buffer_setup(p_buf, (s_p_mem + 0x180), 0x10);
+  emit_INX(p_buf);
+  emit_EXIT(p_buf);
+  state_6502_set_pc(s_p_state_6502, 0x180);
+  jit_enter(s_p_cpu_driver);
+  interp_testing_unexit(s_p_interp);
+  p_jit_ptr = jit_metadata_get_host_jit_ptr(s_p_metadata, 0x180);
+  test_expect_u32(1, jit_metadata_is_jit_ptr_dynamic(s_p_metadata, p_jit_ptr));
+
+  util_buffer_destroy(p_buf);
+}
+
+static void
+jit_test_stale_code_sweep(void) {
+  void* p_jit_ptr;
+  struct util_buffer* p_buf = util_buffer_create();
+
+  util_buffer_setup(p_buf, (s_p_mem + 0x3D00), 0x80);
+  emit_NOP(p_buf);
+  emit_NOP(p_buf);
+  emit_EXIT(p_buf);
+
+  state_6502_set_pc(s_p_state_6502, 0x3D00);
+  jit_enter(s_p_cpu_driver);
+  interp_testing_unexit(s_p_interp);
+  jit_test_expect_block_invalidated(0, 0x3D00);
+
+  /* A block without invalidations survives any number of laps. */
+  jit_sweep_stale_code(s_p_jit, k_6502_addr_space_size);
+  jit_sweep_stale_code(s_p_jit, k_6502_addr_space_size);
+  jit_test_expect_block_invalidated(0, 0x3D00);
+
+  /* A block with invalidations is marked on the first lap... */
+  jit_test_invalidate_code_at_address(s_p_jit, 0x3D00);
+  jit_sweep_stale_code(s_p_jit, k_6502_addr_space_size);
+  jit_test_expect_block_invalidated(0, 0x3D00);
+
+  /* ... but executing it in between, which recompiles it, resets the mark. */
+  state_6502_set_pc(s_p_state_6502, 0x3D00);
+  jit_enter(s_p_cpu_driver);
+  interp_testing_unexit(s_p_interp);
+  jit_test_expect_code_invalidated(0, 0x3D00);
+  jit_test_invalidate_code_at_address(s_p_jit, 0x3D00);
+  jit_sweep_stale_code(s_p_jit, k_6502_addr_space_size);
+  jit_test_expect_block_invalidated(0, 0x3D00);
+
+  /* Still not executed a lap later, so it is retired. */
+  jit_sweep_stale_code(s_p_jit, k_6502_addr_space_size);
+  jit_test_expect_block_invalidated(1, 0x3D00);
+  p_jit_ptr = jit_metadata_get_host_jit_ptr(s_p_metadata, 0x3D00);
+  test_expect_eq(1, jit_metadata_is_jit_ptr_no_code(s_p_metadata, p_jit_ptr));
+  test_expect_eq(-1, jit_metadata_get_code_block(s_p_metadata, 0x3D00));
+
+  /* Sweeping a lap in small slices is equivalent. */
+  state_6502_set_pc(s_p_state_6502, 0x3D00);
+  jit_enter(s_p_cpu_driver);
+  interp_testing_unexit(s_p_interp);
+  jit_test_expect_block_invalidated(0, 0x3D00);
+  jit_test_invalidate_code_at_address(s_p_jit, 0x3D00);
+  test_expect_eq(0, s_p_jit->sweep_addr);
+  do {
+    jit_sweep_stale_code(s_p_jit, 0x40);
+  } while (s_p_jit->sweep_addr != 0);
+  jit_test_expect_block_invalidated(0, 0x3D00);
+  do {
+    jit_sweep_stale_code(s_p_jit, 0x40);
+  } while (s_p_jit->sweep_addr != 0);
+  jit_test_expect_block_invalidated(1, 0x3D00);
+
+  /* A hard reset or a rewind forgets the sweep history. */
+  test_expect_eq(k_jit_sweep_retired, s_p_jit->sweep_state[0x3D00]);
+  jit_sweep_stale_code(s_p_jit, 0x40);
+  test_expect_neq(0, s_p_jit->sweep_addr);
+  s_p_cpu_driver->p_funcs->power_on_reset(s_p_cpu_driver);
+  test_expect_eq(0, s_p_jit->sweep_state[0x3D00]);
+  test_expect_eq(0, s_p_jit->sweep_addr);
+
+  s_p_jit->sweep_state[0x3D00] = k_jit_sweep_retired;
+  jit_sweep_stale_code(s_p_jit, 0x40);
+  s_p_cpu_driver->p_funcs->apply_flags(s_p_cpu_driver, 0, k_cpu_flag_restore);
+  test_expect_eq(0, s_p_jit->sweep_state[0x3D00]);
+  test_expect_eq(0, s_p_jit->sweep_addr);
+
+  util_buffer_destroy(p_buf);
+}
+
+static void
+jit_test_profile(void) {
+  void* p_jit_ptr;
+  uint8_t* p_profile;
+  uint32_t len;
+  int32_t num_records;
+  struct util_buffer* p_buf = util_buffer_create();
+
+  util_buffer_setup(p_buf, (s_p_mem + 0x3E00), 0x80);
+  emit_NOP(p_buf);
+  emit_EXIT(p_buf);
+
+  jit_compiler_tag_address_as_dynamic(s_p_compiler, 0x3E00);
+  p_profile = jit_compiler_save_profile(s_p_compiler, &len);
+
+  /* Without the profile, the address compiles normally. */
+  s_p_cpu_driver->p_funcs->memory_range_invalidate(s_p_cpu_driver,
+                                                   0x3E00,
+                                                   0x100);
+  state_6502_set_pc(s_p_state_6502, 0x3E00);
+  jit_enter(s_p_cpu_driver);
+  interp_testing_unexit(s_p_interp);
+  p_jit_ptr = jit_metadata_get_host_jit_ptr(s_p_metadata, 0x3E00);
+  test_expect_u32(0, jit_metadata_is_jit_ptr_dynamic(s_p_metadata, p_jit_ptr));
+
+  /* Malformed profiles are rejected. */
+  test_expect_eq(-1, jit_compiler_load_profile(s_p_compiler, p_profile, 4));
+  test_expect_eq(-1,
+                 jit_compiler_load_profile(s_p_compiler, p_profile, (len - 1)));
+
+  /* With the profile, the dynamic tagging is restored. */
+  s_p_cpu_driver->p_funcs->memory_range_invalidate(s_p_cpu_driver,
+                                                   0x3E00,
+                                                   0x100);
+  num_records = jit_compiler_load_profile(s_p_compiler, p_profile, len);
+  test_expect_eq(1, (num_records > 0));
+  state_6502_set_pc(s_p_state_6502, 0x3E00);
+  jit_enter(s_p_cpu_driver);
+  interp_testing_unexit(s_p_interp);
+  p_jit_ptr = jit_metadata_get_host_jit_ptr(s_p_metadata, 0x3E00);
+  test_expect_u32(1, jit_metadata_is_jit_ptr_dynamic(s_p_metadata, p_jit_ptr));
+
+  util_free(p_profile);
+  util_buffer_destroy(p_buf);
+}
+
+static void
+jit_test_precompile_os(void) {
+  uint16_t reset_addr = util_read_le16(&s_p_mem[k_6502_vector_reset]);
+
+  state_6502_set_pc(s_p_state_6502, 0x1234);
+  s_p_jit->option_precompile = 1;
+  /* Only power on arms the precompile, not other OS ROM invalidations. */
+  s_p_cpu_driver->p_funcs->memory_range_invalidate(s_p_cpu_driver,
+                                                   0xC000,
+                                                   0x4000);
+  test_expect_u32(0, s_p_jit->is_precompile_pending);
+  s_p_cpu_driver->p_funcs->power_on_reset(s_p_cpu_driver);
+  test_expect_u32(1, s_p_jit->is_precompile_pending);
+  s_p_jit->is_precompile_pending = 0;
+  s_p_jit->option_precompile = 0;
+  test_expect_u32(0, jit_metadata_is_pc_in_code_block(s_p_metadata,
+                                                      reset_addr));
+
+  jit_precompile_os(s_p_jit);
+  test_expect_u32(reset_addr,
+                  jit_metadata_get_code_block(s_p_metadata, reset_addr));
+  /* Nothing is compiled for the I/O region. */
+  test_expect_u32(0, jit_metadata_is_pc_in_code_block(s_p_metadata, 0xFE00));
+  test_expect_u32(0x1234, state_6502_get_pc(s_p_state_6502));
+}
+
 void
 jit_test(struct bbc_struct* p_bbc) {
   jit_test_init(p_bbc);
@@ -1463,6 +1675,7 @@ jit_test(struct bbc_struct* p_bbc) {
 
   jit_test_block_continuation();
   jit_test_invalidation();
+  jit_test_stale_code_sweep();
 
   jit_compiler_testing_set_dynamic_operand(s_p_compiler, 1);
   jit_test_dynamic_operand();
@@ -1499,6 +1712,13 @@ jit_test(struct bbc_struct* p_bbc) {
   jit_compiler_testing_set_max_ops(s_p_compiler, 4);
   jit_compiler_testing_set_optimizing(s_p_compiler, 0);
 
+  jit_compiler_testing_set_dynamic_opcode(s_p_compiler, 1);
+  jit_test_zero_page_and_stack_code();
+  jit_test_profile();
+  jit_compiler_testing_set_dynamic_opcode(s_p_compiler, 0);
+
+  jit_test_precompile_os();
+
   /* Test this with a JIT space that's been used by all the above tests. */
   jit_cleanup_stale_code(s_p_jit);
 }
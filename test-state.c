@@ -0,0 +1,119 @@
+/* Appends at the end of state.c. */
+
+#include "test.h"
+
+#include <stdio.h>
+
+static const char* s_state_test_file = "beebjit_test_state.bin";
+static const char* s_state_test_damaged_file = "beebjit_test_state_bad.bin";
+
+static int
+state_test_read_damaged(const uint8_t* p_buf, uint64_t len) {
+  struct state_native_header header;
+  const char* p_error = NULL;
+  struct snapshot_struct* p_snapshot = snapshot_create();
+  int ret;
+
+  util_file_write_fully(s_state_test_damaged_file, p_buf, len);
+  ret = state_read_native(p_snapshot,
+                          &header,
+                          &p_error,
+                          s_state_test_damaged_file);
+  (void) remove(s_state_test_damaged_file);
+  if (ret < 0) {
+    test_expect_neq(0, (p_error != NULL));
+  }
+  snapshot_destroy(p_snapshot);
+
+  return ret;
+}
+
+static void
+state_test_save_load(struct bbc_struct* p_bbc, int is_compressed) {
+  static uint8_t s_buf[1024 * 1024];
+  struct state_native_header header;
+  struct state_native_header bad_header;
+  uint64_t len;
+  uint8_t val;
+  uint8_t reset_val;
+  uint8_t* p_mem_read = bbc_get_mem_read(p_bbc);
+
+  bbc_power_on_reset(p_bbc);
+  reset_val = p_mem_read[0x1000];
+  val = (reset_val ^ 0xFF);
+  bbc_set_memory_block(p_bbc, 0x1000, 1, &val);
+
+  state_save(p_bbc, s_state_test_file, is_compressed);
+  len = util_file_read_fully(s_state_test_file, &s_buf[0], sizeof(s_buf));
+  test_expect_neq(0, (len < sizeof(s_buf)));
+
+  /* Header. */
+  (void) memcpy(&header, &s_buf[0], sizeof(header));
+  test_expect_u32(0, strcmp(header.magic, "beebjit-state"));
+  test_expect_u32(1, header.version);
+  test_expect_u32(is_compressed, header.flags);
+  if (is_compressed) {
+    test_expect_neq(0, (len < (sizeof(header) + header.length)));
+  } else {
+    test_expect_u32((sizeof(header) + header.length), len);
+  }
+
+  /* Round trip. */
+  bbc_power_on_reset(p_bbc);
+  test_expect_u32(reset_val, p_mem_read[0x1000]);
+  state_load(p_bbc, s_state_test_file);
+  test_expect_u32((reset_val ^ 0xFF), p_mem_read[0x1000]);
+  (void) remove(s_state_test_file);
+
+  /* Truncated. */
+  test_expect_u32(1, (uint32_t) state_test_read_damaged(&s_buf[0], len));
+  test_expect_u32(-1,
+                  (uint32_t) state_test_read_damaged(&s_buf[0], (len - 16)));
+
+  /* A length the data can't hold bails before it sizes an allocation. */
+  bad_header = header;
+  bad_header.length = (1ull << 48);
+  (void) memcpy(&s_buf[0], &bad_header, sizeof(bad_header));
+  test_expect_u32(-1, (uint32_t) state_test_read_damaged(&s_buf[0], len));
+
+  /* Wrong version. */
+  bad_header = header;
+  bad_header.version = 2;
+  (void) memcpy(&s_buf[0], &bad_header, sizeof(bad_header));
+  test_expect_u32(-1, (uint32_t) state_test_read_damaged(&s_buf[0], len));
+
+  /* Not a native state file at all. */
+  s_buf[0] = 'B';
+  test_expect_u32(0, (uint32_t) state_test_read_damaged(&s_buf[0], len));
+  test_expect_u32(0, (uint32_t) state_test_read_damaged(&s_buf[0], 8));
+
+  bbc_power_on_reset(p_bbc);
+}
+
+static void
+state_test_bem_fallback(struct bbc_struct* p_bbc) {
+  uint8_t val;
+  uint8_t reset_val;
+  uint8_t* p_mem_read = bbc_get_mem_read(p_bbc);
+
+  bbc_power_on_reset(p_bbc);
+  reset_val = p_mem_read[0x1000];
+  val = (reset_val ^ 0xFF);
+  bbc_set_memory_block(p_bbc, 0x1000, 1, &val);
+  state_save_bem(p_bbc, s_state_test_file);
+
+  bbc_power_on_reset(p_bbc);
+  test_expect_u32(reset_val, p_mem_read[0x1000]);
+  state_load(p_bbc, s_state_test_file);
+  test_expect_u32((reset_val ^ 0xFF), p_mem_read[0x1000]);
+  (void) remove(s_state_test_file);
+
+  bbc_power_on_reset(p_bbc);
+}
+
+void
+state_test(struct bbc_struct* p_bbc) {
+  state_test_save_load(p_bbc, 0);
+  state_test_save_load(p_bbc, 1);
+  state_test_bem_fallback(p_bbc);
+}
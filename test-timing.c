@@ -15,9 +15,12 @@ timing_test_stop_timers(void* p) {
 
   struct timing_struct* p_timing = (struct timing_struct*) p;
 
-  for (i = 0; i < k_timing_num_timers; ++i) {
-    struct timer_struct* p_timer = &p_timing->timers[i];
-    if (p_timer->firing && (p_timer->value == 0)) {
+  for (i = 0; i < p_timing->max_timers; ++i) {
+    struct timer_struct* p_timer = &p_timing->p_timers[i];
+    if (!p_timer->ticking || !p_timer->firing) {
+      continue;
+    }
+    if (timing_get_timer_value(p_timing, i) == 0) {
       test_expect_u32(0, timing_get_timer_value(p_timing, i));
       (void) timing_stop_timer(p_timing, i);
     }
@@ -69,9 +72,11 @@ timing_test_counting() {
   struct timing_struct* p_timing = timing_create(1);
 
   uint32_t t1 = timing_register_timer(p_timing,
+                                      "t1",
                                       timing_test_timer_fired_basic,
                                       p_timing);
   uint32_t t2 = timing_register_timer(p_timing,
+                                      "t2",
                                       timing_test_timer_fired_basic,
                                       p_timing);
   (void) t2;
@@ -88,14 +93,14 @@ timing_test_counting() {
    * advance that didn't update all timer baselines.
    */
   test_expect_u32(98, p_timing->countdown);
-  test_expect_u32(100, p_timing->timers[0].value);
+  test_expect_u32(100, p_timing->p_timers[0].value);
   test_expect_u32(98, timing_get_timer_value(p_timing, t1));
 
   countdown = timing_start_timer_with_value(p_timing, t2, 50);
   test_expect_u32(50, countdown);
   test_expect_u32(50, p_timing->countdown);
-  test_expect_u32(100, p_timing->timers[0].value);
-  test_expect_u32(52, p_timing->timers[1].value);
+  test_expect_u32(100, p_timing->p_timers[0].value);
+  test_expect_u32(52, p_timing->p_timers[1].value);
   test_expect_u32(98, timing_get_timer_value(p_timing, t1));
   test_expect_u32(50, timing_get_timer_value(p_timing, t2));
 
@@ -110,14 +115,14 @@ timing_test_counting() {
   countdown = timing_set_timer_value(p_timing, t2, 40);
   test_expect_u32(40, countdown);
   test_expect_u32(40, p_timing->countdown);
-  test_expect_u32(100, p_timing->timers[0].value);
-  test_expect_u32(42, p_timing->timers[1].value);
+  test_expect_u32(100, p_timing->p_timers[0].value);
+  test_expect_u32(42, p_timing->p_timers[1].value);
 
   countdown = timing_adjust_timer_value(p_timing, NULL, t2, -10);
   test_expect_u32(30, countdown);
   test_expect_u32(30, p_timing->countdown);
-  test_expect_u32(100, p_timing->timers[0].value);
-  test_expect_u32(32, p_timing->timers[1].value);
+  test_expect_u32(100, p_timing->p_timers[0].value);
+  test_expect_u32(32, p_timing->p_timers[1].value);
 
   countdown = timing_set_firing(p_timing, t2, 0);
   test_expect_u32(98, countdown);
@@ -149,12 +154,15 @@ timing_test_basics() {
   struct timing_struct* p_timing = timing_create(1);
 
   uint32_t t1 = timing_register_timer(p_timing,
+                                      "t1",
                                       timing_test_timer_fired_basic,
                                       p_timing);
   uint32_t t2 = timing_register_timer(p_timing,
+                                      "t2",
                                       timing_test_timer_fired_basic,
                                       p_timing);
   uint32_t t3 = timing_register_timer(p_timing,
+                                      "t3",
                                       timing_test_timer_fired_basic,
                                       p_timing);
 
@@ -255,12 +263,15 @@ timing_test_multi_expiry() {
   struct timing_struct* p_timing = timing_create(1);
 
   uint32_t t1 = timing_register_timer(p_timing,
+                                      "t1",
                                       timing_test_timer_fired_multi,
                                       p_timing);
   uint32_t t2 = timing_register_timer(p_timing,
+                                      "t2",
                                       timing_test_timer_fired_multi,
                                       p_timing);
   uint32_t t3 = timing_register_timer(p_timing,
+                                      "t3",
                                       timing_test_timer_fired_multi,
                                       p_timing);
 
@@ -292,9 +303,11 @@ timing_test_scaling() {
   struct timing_struct* p_timing = timing_create(3);
 
   uint32_t t1 = timing_register_timer(p_timing,
+                                      "t1",
                                       timing_test_timer_fired_basic,
                                       p_timing);
   uint32_t t2 = timing_register_timer(p_timing,
+                                      "t2",
                                       timing_test_timer_fired_basic,
                                       p_timing);
 
@@ -308,14 +321,14 @@ timing_test_scaling() {
 
   /* Peek at the internals to make sure we really have a scaled timer. */
   test_expect_u32(299, p_timing->countdown);
-  test_expect_u32(300, p_timing->timers[0].value);
+  test_expect_u32(300, p_timing->p_timers[0].value);
   test_expect_u32(99, timing_get_timer_value(p_timing, t1));
 
   countdown = timing_start_timer_with_value(p_timing, t2, 50);
   test_expect_u32(150, countdown);
   test_expect_u32(150, p_timing->countdown);
-  test_expect_u32(300, p_timing->timers[0].value);
-  test_expect_u32(151, p_timing->timers[1].value);
+  test_expect_u32(300, p_timing->p_timers[0].value);
+  test_expect_u32(151, p_timing->p_timers[1].value);
   test_expect_u32(99, timing_get_timer_value(p_timing, t1));
   test_expect_u32(50, timing_get_timer_value(p_timing, t2));
 
@@ -331,14 +344,14 @@ timing_test_scaling() {
   test_expect_u32(40, timing_get_timer_value(p_timing, t2));
   test_expect_u32(120, countdown);
   test_expect_u32(120, p_timing->countdown);
-  test_expect_u32(300, p_timing->timers[0].value);
-  test_expect_u32(121, p_timing->timers[1].value);
+  test_expect_u32(300, p_timing->p_timers[0].value);
+  test_expect_u32(121, p_timing->p_timers[1].value);
 
   countdown = timing_adjust_timer_value(p_timing, NULL, t2, -10);
   test_expect_u32(90, countdown);
   test_expect_u32(90, p_timing->countdown);
-  test_expect_u32(300, p_timing->timers[0].value);
-  test_expect_u32(91, p_timing->timers[1].value);
+  test_expect_u32(300, p_timing->p_timers[0].value);
+  test_expect_u32(91, p_timing->p_timers[1].value);
 
   countdown = timing_set_firing(p_timing, t2, 0);
   test_expect_u32(299, countdown);
@@ -368,12 +381,15 @@ timing_test_simultaneous() {
   struct timing_struct* p_timing = timing_create(1);
 
   uint32_t t1 = timing_register_timer(p_timing,
+                                      "t1",
                                       timing_test_timer_fired_order_t1,
                                       p_timing);
   uint32_t t2 = timing_register_timer(p_timing,
+                                      "t2",
                                       timing_test_timer_fired_order_t2,
                                       p_timing);
   uint32_t t3 = timing_register_timer(p_timing,
+                                      "t3",
                                       timing_test_timer_fired_order_t3,
                                       p_timing);
   (void) timing_start_timer_with_value(p_timing, t1, 50);
@@ -384,6 +400,38 @@ timing_test_simultaneous() {
   test_expect_u32(0, s_timing_test_order_t1);
   test_expect_u32(1, s_timing_test_order_t3);
   test_expect_u32(2, s_timing_test_order_t2);
+
+  timing_destroy(p_timing);
+}
+
+static void
+timing_test_instrumentation() {
+  /* Fires and re-arms are always counted; host time only when instrumented.
+   */
+  struct timing_struct* p_timing = timing_create(1);
+
+  uint32_t t1 = timing_register_timer(p_timing,
+                                      "t1",
+                                      timing_test_timer_fired_order_t1,
+                                      p_timing);
+  uint32_t t2 = timing_register_timer(p_timing,
+                                      "t2",
+                                      timing_test_timer_fired_order_t2,
+                                      p_timing);
+  (void) timing_start_timer_with_value(p_timing, t1, 50);
+  (void) timing_start_timer_with_value(p_timing, t2, 50);
+
+  (void) timing_advance_time_delta(p_timing, 50);
+  test_expect_u32(1, p_timing->p_timers[t1].stats.num_fires);
+  test_expect_u32(1, p_timing->p_timers[t1].stats.num_rearms);
+
+  (void) timing_start_timer_with_value(p_timing, t2, 10);
+  (void) timing_set_timer_value(p_timing, t2, 20);
+  test_expect_u32(1, p_timing->p_timers[t2].stats.num_fires);
+  test_expect_u32(3, p_timing->p_timers[t2].stats.num_rearms);
+  test_expect_u32(0, p_timing->p_timers[t2].stats.fire_ns);
+
+  timing_destroy(p_timing);
 }
 
 static void
@@ -391,6 +439,7 @@ timing_test_reset() {
   struct timing_struct* p_timing = timing_create(1);
 
   uint32_t t1 = timing_register_timer(p_timing,
+                                      "t1",
                                       timing_test_timer_fired_basic,
                                       p_timing);
   (void) timing_start_timer_with_value(p_timing, t1, 100);
@@ -412,6 +461,43 @@ timing_test_reset() {
   test_expect_u32(80, timing_get_timer_value(p_timing, t1));
 }
 
+static void
+timing_test_many_timers() {
+  /* Test many more timers than the original fixed array held, expiring out
+   * of registration order.
+   */
+  uint32_t i;
+  uint32_t num_timers = 100;
+  struct timing_struct* p_timing = timing_create(1);
+
+  s_timing_test_timer_hits_basic = 0;
+
+  for (i = 0; i < num_timers; ++i) {
+    uint32_t id = timing_register_timer(p_timing,
+                                        "many",
+                                        timing_test_timer_fired_basic,
+                                        p_timing);
+    test_expect_u32(i, id);
+    (void) timing_start_timer_with_value(p_timing,
+                                         id,
+                                         (1000 - ((i * 7) % 500)));
+  }
+  test_expect_u32(503, timing_get_countdown(p_timing));
+
+  (void) timing_advance_time_delta(p_timing, 600);
+  test_expect_u32(14, s_timing_test_timer_hits_basic);
+  test_expect_u32(0, timing_timer_is_running(p_timing, 71));
+  test_expect_u32(1, timing_timer_is_running(p_timing, 43));
+  test_expect_u32(99, timing_get_timer_value(p_timing, 43));
+  test_expect_u32(1, timing_get_countdown(p_timing));
+
+  (void) timing_advance_time_delta(p_timing, 400);
+  test_expect_u32(num_timers, s_timing_test_timer_hits_basic);
+  test_expect_u32(0, timing_timer_is_running(p_timing, 0));
+
+  timing_destroy(p_timing);
+}
+
 void
 timing_test() {
   timing_test_counting();
@@ -419,5 +505,7 @@ timing_test() {
   timing_test_multi_expiry();
   timing_test_scaling();
   timing_test_simultaneous();
+  timing_test_instrumentation();
   timing_test_reset();
+  timing_test_many_timers();
 }
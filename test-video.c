@@ -392,6 +392,60 @@ video_test_out_of_frame() {
   test_expect_u32(40000, video_test_get_timer());
 }
 
+static uint32_t
+video_test_get_updated_timer() {
+  /* The timer as it would be if recalculated now, rather than left stale. */
+  if (g_p_video->is_timer_stale) {
+    video_update_timer(g_p_video);
+  }
+  return video_test_get_timer();
+}
+
+static void
+video_test_lazy_timer() {
+  /* Framing register writes leave the timer stale, due at the next point the
+   * timer could need to stop at. It's recalculated there, once.
+   */
+  uint32_t stale_timer;
+  int64_t countdown = timing_get_countdown(g_p_timing);
+  countdown = timing_advance_time(g_p_timing, (countdown - 20));
+
+  /* Vertical total. */
+  video_crtc_write(g_p_video, 0, 4);
+  video_crtc_write(g_p_video, 1, 60);
+  test_expect_u32(10, g_p_video->horiz_counter);
+  test_expect_u32(1, g_p_video->is_timer_stale);
+  /* MODE7 is interlaced, so that's half R0. */
+  test_expect_u32(((32 - 10) * 2), video_test_get_timer());
+  /* Vertical sync position. The timer isn't moved again. */
+  video_crtc_write(g_p_video, 0, 7);
+  video_crtc_write(g_p_video, 1, 40);
+  test_expect_u32(((32 - 10) * 2), video_test_get_timer());
+
+  countdown = timing_advance_time(g_p_timing, 0);
+  test_expect_u32(32, g_p_video->horiz_counter);
+  test_expect_u32(0, g_p_video->is_timer_stale);
+  test_expect_u32(((64 - 32) * 2), video_test_get_timer());
+
+  /* At C0=0, it's calculated right away. */
+  countdown = timing_advance_time(g_p_timing, 0);
+  test_expect_u32(0, g_p_video->horiz_counter);
+  video_crtc_write(g_p_video, 0, 7);
+  video_crtc_write(g_p_video, 1, 41);
+  test_expect_u32(0, g_p_video->is_timer_stale);
+
+  /* A stale timer never fires later than a recalculated one would. */
+  countdown = timing_get_countdown(g_p_timing);
+  countdown = timing_advance_time(g_p_timing, (countdown - 20));
+  video_crtc_write(g_p_video, 0, 7);
+  video_crtc_write(g_p_video, 1, 40);
+  test_expect_u32(10, g_p_video->horiz_counter);
+  test_expect_u32(1, g_p_video->is_timer_stale);
+  stale_timer = video_test_get_timer();
+  test_expect_u32(1, (stale_timer <= video_test_get_updated_timer()));
+  test_expect_u32(0, g_p_video->is_timer_stale);
+}
+
 static void
 video_test_6845_corner_cases() {
   /* Tests corner cases, expecting Hitachi 6845 behavior. */
@@ -1242,6 +1296,468 @@ video_test_inactive_non_interlace() {
   test_expect_u32(8, g_p_video->num_crtc_advances);
 }
 
+static int
+video_test_paint_and_render() {
+  video_force_paint(g_p_video, 0);
+  return video_render_full_frame(g_p_video);
+}
+
+static void
+video_test_skip_unchanged_frame() {
+  /* Full frame rendering, as used in non-accurate mode, should skip frames
+   * that would come out identical to what's already in the buffer.
+   */
+  video_destroy(g_p_video);
+  g_p_video = video_create(g_p_bbc_mem,
+                           NULL,
+                           1,
+                           g_p_timing,
+                           g_p_render,
+                           g_p_teletext,
+                           NULL,
+                           video_test_framebuffer_ready_callback,
+                           NULL,
+                           &g_test_fast_flag,
+                           &g_p_options);
+  video_power_on_reset(g_p_video);
+  render_create_internal_buffer(g_p_render);
+
+  /* Nothing to render until a frame is captured at paint time. */
+  test_expect_u32(0, video_render_full_frame(g_p_video));
+  test_expect_u32(1, video_test_paint_and_render());
+  test_expect_u32(0, video_test_paint_and_render());
+
+  /* Screen memory. The power on CRTC start address is 0, bitmap addressing. */
+  g_p_bbc_mem[8] = 'A';
+  test_expect_u32(1, video_test_paint_and_render());
+  test_expect_u32(0, video_test_paint_and_render());
+  /* Memory outside the screen doesn't matter. */
+  g_p_bbc_mem[0x3000] = 'A';
+  test_expect_u32(0, video_test_paint_and_render());
+
+  /* CRTC register. */
+  video_crtc_write(g_p_video, 0, k_crtc_reg_mem_addr_low);
+  video_crtc_write(g_p_video, 1, 0x01);
+  test_expect_u32(1, video_test_paint_and_render());
+  test_expect_u32(0, video_test_paint_and_render());
+
+  /* Palette. */
+  video_ula_write(g_p_video, 1, 0x00);
+  test_expect_u32(1, video_test_paint_and_render());
+  test_expect_u32(0, video_test_paint_and_render());
+
+  /* The captured frame is rendered, not the live state. */
+  video_force_paint(g_p_video, 0);
+  g_p_bbc_mem[16] = 'A';
+  test_expect_u32(0, video_render_full_frame(g_p_video));
+  test_expect_u32(1, video_test_paint_and_render());
+
+  /* Buffer clear. */
+  render_clear_buffer(g_p_render);
+  test_expect_u32(1, video_test_paint_and_render());
+  test_expect_u32(0, video_test_paint_and_render());
+}
+
+static struct video_struct*
+video_test_create_mode7_video(const char* p_opt_flags,
+                              struct teletext_struct** p_p_teletext) {
+  /* An externally clocked video with its own renderer and SAA5050. */
+  struct bbc_options options;
+  struct teletext_struct* p_teletext;
+  struct render_struct* p_render;
+  struct video_struct* p_video;
+
+  options = g_p_options;
+  options.p_opt_flags = p_opt_flags;
+  p_teletext = teletext_create();
+  p_render = render_create(p_teletext, &options);
+  render_create_internal_buffer(p_render);
+  p_video = video_create(g_p_bbc_mem,
+                         NULL,
+                         1,
+                         g_p_timing,
+                         p_render,
+                         p_teletext,
+                         NULL,
+                         video_test_framebuffer_ready_callback,
+                         NULL,
+                         &g_test_fast_flag,
+                         &options);
+  video_power_on_reset(p_video);
+  video_crtc_write(p_video, 0, k_crtc_reg_mem_addr_high);
+  video_crtc_write(p_video, 1, 0x28);
+
+  *p_p_teletext = p_teletext;
+  return p_video;
+}
+
+static void
+video_test_destroy_mode7_video(struct video_struct* p_video,
+                               struct teletext_struct* p_teletext) {
+  struct render_struct* p_render = video_get_render(p_video);
+
+  video_destroy(p_video);
+  render_destroy(p_render);
+  teletext_destroy(p_teletext);
+}
+
+static uint32_t*
+video_test_render_mode7_frame(const char* p_opt_flags) {
+  struct video_struct* p_video;
+  struct render_struct* p_render;
+  struct teletext_struct* p_teletext;
+  uint32_t size;
+  uint32_t* p_copy;
+
+  p_video = video_test_create_mode7_video(p_opt_flags, &p_teletext);
+  p_render = video_get_render(p_video);
+  video_force_paint(p_video, 0);
+  test_expect_u32(1, video_render_full_frame(p_video));
+
+  size = render_get_buffer_size(p_render);
+  p_copy = util_malloc(size);
+  (void) memcpy(p_copy, render_get_buffer(p_render), size);
+
+  video_test_destroy_mode7_video(p_video, p_teletext);
+
+  return p_copy;
+}
+
+static void
+video_test_render_bands() {
+  /* Rendering in bands on worker threads should give the same pixels as a
+   * serial render, including SAA5050 state carried across band boundaries.
+   */
+  static const uint8_t s_row[] = {
+    0x8D, 0x81, 'D', 'o', 'u', 'b', 'l', 'e', 0x97, 0x9E, 0xFF, 0x20,
+    0xB5, 0x88, 'F', 'l', 'a', 's', 'h', 0x9D, 0x83, 0x89, 'X', 0x8C,
+  };
+  uint32_t i;
+  uint32_t* p_serial;
+  uint32_t* p_banded;
+
+  for (i = 0; i < 1000; ++i) {
+    g_p_bbc_mem[0x7C00 + i] = s_row[(i + (i / 40)) % sizeof(s_row)];
+  }
+  /* Some double height rows back to back, where only every other row is the
+   * bottom half.
+   */
+  for (i = 0; i < 6; ++i) {
+    g_p_bbc_mem[0x7C00 + ((i + 5) * 40)] = 0x8D;
+  }
+
+  p_serial = video_test_render_mode7_frame("");
+  p_banded = video_test_render_mode7_frame("video:render-threads=4");
+  test_expect_u32(0,
+                  memcmp(p_serial,
+                         p_banded,
+                         render_get_buffer_size(g_p_render)));
+  util_free(p_serial);
+  util_free(p_banded);
+
+  /* Bands that don't fall on even row boundaries. */
+  p_banded = video_test_render_mode7_frame("video:render-threads=7");
+  p_serial = video_test_render_mode7_frame("");
+  test_expect_u32(0,
+                  memcmp(p_serial,
+                         p_banded,
+                         render_get_buffer_size(g_p_render)));
+  util_free(p_serial);
+  util_free(p_banded);
+}
+
+static void
+video_test_teletext_row_cache() {
+  /* Rows reused from the teletext row cache should give the same pixels as
+   * rendering every row, across edits, double height changes and flashing.
+   */
+  struct video_struct* p_cached;
+  struct video_struct* p_uncached;
+  struct teletext_struct* p_cached_teletext;
+  struct teletext_struct* p_uncached_teletext;
+  uint32_t* p_cached_buffer;
+  uint32_t* p_uncached_buffer;
+  uint32_t size;
+  uint32_t i;
+
+  p_cached = video_test_create_mode7_video("", &p_cached_teletext);
+  p_uncached = video_test_create_mode7_video("video:no-teletext-cache",
+                                             &p_uncached_teletext);
+  p_cached_buffer = render_get_buffer(video_get_render(p_cached));
+  p_uncached_buffer = render_get_buffer(video_get_render(p_uncached));
+  size = render_get_buffer_size(video_get_render(p_cached));
+
+  /* Enough frames to see the flash phase change. */
+  for (i = 0; i < 80; ++i) {
+    if (i == 10) {
+      /* A plain edit on an otherwise unchanged screen. */
+      g_p_bbc_mem[0x7C00 + (15 * 40) + 20] ^= 0x01;
+    } else if (i == 20) {
+      /* The row below this one changes from the bottom half of a double
+       * height row to a top half, without its own data changing.
+       */
+      g_p_bbc_mem[0x7C00 + (5 * 40)] = ' ';
+    } else if (i == 30) {
+      g_p_bbc_mem[0x7C00 + (5 * 40)] = 0x8D;
+    }
+    video_force_paint(p_cached, 0);
+    video_force_paint(p_uncached, 0);
+    (void) video_render_full_frame(p_cached);
+    (void) video_render_full_frame(p_uncached);
+    test_expect_u32(0, memcmp(p_cached_buffer, p_uncached_buffer, size));
+  }
+
+  video_test_destroy_mode7_video(p_cached, p_cached_teletext);
+  video_test_destroy_mode7_video(p_uncached, p_uncached_teletext);
+}
+
+struct video_test_span_video {
+  struct timing_struct* p_timing;
+  struct teletext_struct* p_teletext;
+  struct render_struct* p_render;
+  struct video_struct* p_video;
+};
+
+static void
+video_test_span_create(struct video_test_span_video* p_span_video,
+                       const char* p_opt_flags) {
+  /* A CPU clocked video with its own timing, so it can be advanced in step
+   * with another.
+   */
+  struct bbc_options options;
+
+  options = g_p_options;
+  options.p_opt_flags = p_opt_flags;
+  p_span_video->p_timing = timing_create(1);
+  p_span_video->p_teletext = teletext_create();
+  p_span_video->p_render = render_create(p_span_video->p_teletext, &options);
+  render_create_internal_buffer(p_span_video->p_render);
+  p_span_video->p_video = video_create(g_p_bbc_mem,
+                                       NULL,
+                                       0,
+                                       p_span_video->p_timing,
+                                       p_span_video->p_render,
+                                       p_span_video->p_teletext,
+                                       NULL,
+                                       video_test_framebuffer_ready_callback,
+                                       NULL,
+                                       &g_test_fast_flag,
+                                       &options);
+  video_power_on_reset(p_span_video->p_video);
+}
+
+static void
+video_test_span_destroy(struct video_test_span_video* p_span_video) {
+  video_destroy(p_span_video->p_video);
+  render_destroy(p_span_video->p_render);
+  teletext_destroy(p_span_video->p_teletext);
+  timing_destroy(p_span_video->p_timing);
+}
+
+static void
+video_test_span_advance(struct video_test_span_video* p_span_video,
+                        int64_t ticks) {
+  struct timing_struct* p_timing = p_span_video->p_timing;
+  int64_t countdown = timing_get_countdown(p_timing);
+
+  (void) timing_advance_time(p_timing, (countdown - ticks));
+  video_advance_crtc_timing(p_span_video->p_video);
+}
+
+static void
+video_test_span_crtc_write(struct video_test_span_video* p_span_video,
+                           uint8_t reg,
+                           uint8_t val) {
+  video_crtc_write(p_span_video->p_video, 0, reg);
+  video_crtc_write(p_span_video->p_video, 1, val);
+}
+
+static void
+video_test_span_compare(struct video_test_span_video* p_span_video_1,
+                        struct video_test_span_video* p_span_video_2,
+                        int is_buffer_compared) {
+  struct video_struct* p_video_1 = p_span_video_1->p_video;
+  struct video_struct* p_video_2 = p_span_video_2->p_video;
+  struct render_struct* p_render_1 = p_span_video_1->p_render;
+  struct render_struct* p_render_2 = p_span_video_2->p_render;
+
+  test_expect_u32(p_video_1->horiz_counter, p_video_2->horiz_counter);
+  test_expect_u32(p_video_1->address_counter, p_video_2->address_counter);
+  test_expect_u32(p_video_1->scanline_counter, p_video_2->scanline_counter);
+  test_expect_u32(p_video_1->vert_counter, p_video_2->vert_counter);
+  test_expect_u32(p_video_1->crtc_frames, p_video_2->crtc_frames);
+  test_expect_u32(p_video_1->in_hsync, p_video_2->in_hsync);
+  test_expect_u32(p_video_1->hsync_tick_counter,
+                  p_video_2->hsync_tick_counter);
+  test_expect_u32(p_video_1->cursor_skew_counter,
+                  p_video_2->cursor_skew_counter);
+  test_expect_u32(p_video_1->display_enable_bits,
+                  p_video_2->display_enable_bits);
+  test_expect_u32(0,
+                  memcmp(&p_video_1->dispen_shifts[0],
+                         &p_video_2->dispen_shifts[0],
+                         sizeof(p_video_1->dispen_shifts)));
+  test_expect_u32(render_get_horiz_pos(p_render_1),
+                  render_get_horiz_pos(p_render_2));
+  test_expect_u32(render_get_vert_pos(p_render_1),
+                  render_get_vert_pos(p_render_2));
+  if (is_buffer_compared) {
+    test_expect_u32(0,
+                    memcmp(render_get_buffer(p_render_1),
+                           render_get_buffer(p_render_2),
+                           render_get_buffer_size(p_render_1)));
+  }
+}
+
+static void
+video_test_span_setup(struct video_test_span_video* p_span_video,
+                      uint8_t ula_control,
+                      const uint8_t* p_regs) {
+  uint32_t i;
+
+  video_ula_write(p_span_video->p_video, 0, ula_control);
+  for (i = 0; i < 16; ++i) {
+    video_ula_write(p_span_video->p_video, 1, ((i << 4) | (i ^ 0x7)));
+  }
+  for (i = 0; i < 16; ++i) {
+    video_test_span_crtc_write(p_span_video, i, p_regs[i]);
+  }
+}
+
+static void
+video_test_span_run(struct video_test_span_video* p_span_video_1,
+                    struct video_test_span_video* p_span_video_2,
+                    uint32_t num_steps) {
+  /* Uneven steps, so that advances stop part way through spans. */
+  uint32_t i;
+
+  for (i = 0; i < num_steps; ++i) {
+    int64_t ticks = (1 + ((i * 97) % 523));
+    video_test_span_advance(p_span_video_1, ticks);
+    video_test_span_advance(p_span_video_2, ticks);
+    video_test_span_compare(p_span_video_1,
+                            p_span_video_2,
+                            ((i % 50) == 0));
+  }
+  video_test_span_compare(p_span_video_1, p_span_video_2, 1);
+}
+
+static void
+video_test_quiet_span() {
+  /* Advancing over quiet spans in bulk must give exactly the same counters
+   * and pixels as advancing one character at a time.
+   * First, MODE1-like, with a steady cursor on screen. MA12 is set, for the
+   * screen wrap.
+   */
+  static const uint8_t s_bitmap_regs[16] = {
+    127, 80, 98, 0x28, 38, 0, 32, 34, 0x00, 7, 0x00, 7, 0x1F, 0x00, 0x1F, 0xA5,
+  };
+  /* MODE7-like, with display and cursor skew. The start address is below
+   * MA13, so the SAA5050 DISPEN turns on part way along the sixth row.
+   */
+  static const uint8_t s_teletext_regs[16] = {
+    63, 40, 51, 0x24, 30, 2, 25, 27, 0x90, 9, 0x00, 9, 0x1F, 0x20, 0x20, 0x35,
+  };
+  struct video_test_span_video span_video;
+  struct video_test_span_video char_video;
+  uint32_t i;
+
+  for (i = 0; i < 0x8000; ++i) {
+    g_p_bbc_mem[i] = (uint8_t) ((i * 37) ^ (i >> 7));
+  }
+
+  video_test_span_create(&span_video, "");
+  video_test_span_create(&char_video, "video:no-quiet-span");
+  test_expect_u32(1, span_video.p_video->is_opt_quiet_span);
+  test_expect_u32(0, char_video.p_video->is_opt_quiet_span);
+
+  video_test_span_setup(&span_video, 0xD8, &s_bitmap_regs[0]);
+  video_test_span_setup(&char_video, 0xD8, &s_bitmap_regs[0]);
+  test_expect_u32(0, span_video.p_video->cursor_disabled);
+  video_test_span_run(&span_video, &char_video, 250);
+
+  /* Mid-frame R1 and R2 changes move the span boundaries. */
+  video_test_span_crtc_write(&span_video, k_crtc_reg_horiz_displayed, 60);
+  video_test_span_crtc_write(&char_video, k_crtc_reg_horiz_displayed, 60);
+  video_test_span_crtc_write(&span_video, k_crtc_reg_horiz_position, 90);
+  video_test_span_crtc_write(&char_video, k_crtc_reg_horiz_position, 90);
+  video_test_span_run(&span_video, &char_video, 250);
+  test_expect_neq(0, (span_video.p_video->crtc_frames >= 3));
+
+  /* Plain printable characters, so a DISPEN change a character out shows. */
+  for (i = 0x7C00; i < 0x8000; ++i) {
+    g_p_bbc_mem[i] = (0x40 | (g_p_bbc_mem[i] & 0x3F));
+  }
+  video_test_span_setup(&span_video, 0x4B, &s_teletext_regs[0]);
+  video_test_span_setup(&char_video, 0x4B, &s_teletext_regs[0]);
+  video_test_span_run(&span_video, &char_video, 400);
+
+  /* And off again, as the address counter wraps from 0x3FFF to 0. The SAA5050
+   * sees DISPEN a clock late, so a late change would show the last MA13
+   * character.
+   */
+  video_test_span_crtc_write(&span_video, k_crtc_reg_mem_addr_high, 0x3F);
+  video_test_span_crtc_write(&char_video, k_crtc_reg_mem_addr_high, 0x3F);
+  video_test_span_run(&span_video, &char_video, 400);
+  test_expect_neq(0, (span_video.p_video->crtc_frames >= 8));
+
+  video_test_span_destroy(&span_video);
+  video_test_span_destroy(&char_video);
+}
+
+static void
+video_test_adaptive_frame_skip() {
+  /* Busy windows raise frame skip at once, up to the maximum, but it only
+   * drops back after consecutive idle windows.
+   */
+  struct video_struct* p_video;
+  struct teletext_struct* p_teletext;
+  uint32_t i;
+
+  p_video = video_test_create_mode7_video(
+      "video:frames-skip=auto,video:frames-skip-max=3", &p_teletext);
+  test_expect_u32(0, video_get_frames_skip(p_video));
+
+  /* 19ms of work per 20ms wakeup; half a second is one window. */
+  for (i = 0; i < 25; ++i) {
+    video_apply_host_load(p_video, 19000, 20000);
+  }
+  test_expect_u32(1, video_get_frames_skip(p_video));
+  for (i = 0; i < (25 * 5); ++i) {
+    video_apply_host_load(p_video, 19000, 20000);
+  }
+  test_expect_u32(3, video_get_frames_skip(p_video));
+
+  /* Moderate load holds the level. */
+  for (i = 0; i < (25 * 4); ++i) {
+    video_apply_host_load(p_video, 15000, 20000);
+  }
+  test_expect_u32(3, video_get_frames_skip(p_video));
+
+  for (i = 0; i < 25; ++i) {
+    video_apply_host_load(p_video, 5000, 20000);
+  }
+  test_expect_u32(3, video_get_frames_skip(p_video));
+  for (i = 0; i < 25; ++i) {
+    video_apply_host_load(p_video, 5000, 20000);
+  }
+  test_expect_u32(2, video_get_frames_skip(p_video));
+  for (i = 0; i < (25 * 4); ++i) {
+    video_apply_host_load(p_video, 5000, 20000);
+  }
+  test_expect_u32(0, video_get_frames_skip(p_video));
+
+  video_test_destroy_mode7_video(p_video, p_teletext);
+
+  /* Without the option, the static skip level is left alone. */
+  p_video = video_test_create_mode7_video("video:frames-skip=2", &p_teletext);
+  for (i = 0; i < (25 * 4); ++i) {
+    video_apply_host_load(p_video, 19000, 20000);
+  }
+  test_expect_u32(2, video_get_frames_skip(p_video));
+  video_test_destroy_mode7_video(p_video, p_teletext);
+}
+
 void
 video_test() {
   video_test_init();
@@ -1264,6 +1780,10 @@ video_test() {
   video_test_out_of_frame();
   video_test_end();
 
+  video_test_init();
+  video_test_lazy_timer();
+  video_test_end();
+
   video_test_init();
   video_test_6845_corner_cases();
   video_test_end();
@@ -1327,4 +1847,21 @@ video_test() {
   video_test_init();
   video_test_inactive_non_interlace();
   video_test_end();
+
+  video_test_init();
+  video_test_skip_unchanged_frame();
+  video_test_end();
+
+  video_test_init();
+  video_test_render_bands();
+  video_test_teletext_row_cache();
+  video_test_end();
+
+  video_test_init();
+  video_test_adaptive_frame_skip();
+  video_test_end();
+
+  video_test_init();
+  video_test_quiet_span();
+  video_test_end();
 }
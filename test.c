@@ -1,6 +1,7 @@
 #include "test.h"
 
 #include "bbc.h"
+#include "util.h"
 
 #include <assert.h>
 #include <stdio.h>
@@ -12,17 +13,65 @@ extern void video_test(void);
 extern void jit_test(struct bbc_struct* p_bbc);
 extern void expression_test(void);
 extern void bbc_test(struct bbc_struct* p_bbc);
+extern void debug_test(struct bbc_struct* p_bbc);
+extern void frame_stream_test(void);
+extern void state_test(struct bbc_struct* p_bbc);
+
+static void
+test_util_hash64(void) {
+  /* The hash must stay stable, or saved frame hash logs stop matching. */
+  static const char s_data[] = "beebjit frame hash";
+  uint64_t hash;
+
+  hash = util_hash64_finish(util_hash64_init());
+  test_expect_u32(0xEF46DB37, (uint32_t) (hash >> 32));
+  test_expect_u32(0x51D8E999, (uint32_t) hash);
+
+  /* A full 8-byte step plus a byte-wise tail. */
+  hash = util_hash64_add(util_hash64_init(), s_data, (sizeof(s_data) - 1));
+  hash = util_hash64_finish(hash);
+  test_expect_u32(0xA8438447, (uint32_t) (hash >> 32));
+  test_expect_u32(0xF37550CD, (uint32_t) hash);
+}
+
+static void
+test_util_frame_hashes(void) {
+  uint64_t* p_hashes = NULL;
+  uint32_t num_hashes = 0;
+
+  test_expect_u32(1,
+                  util_parse_frame_hashes(&p_hashes,
+                                          &num_hashes,
+                                          "0 00000000000000ff\n"
+                                          "1 a8438447f37550cd\n"));
+  test_expect_u32(2, num_hashes);
+  test_expect_u32(0xFF, (uint32_t) p_hashes[0]);
+  test_expect_u32(0xA8438447, (uint32_t) (p_hashes[1] >> 32));
+  util_free(p_hashes);
+
+  /* A skipped frame number is rejected. */
+  test_expect_u32(0,
+                  util_parse_frame_hashes(&p_hashes,
+                                          &num_hashes,
+                                          "0 00000000000000ff\n"
+                                          "2 a8438447f37550cd\n"));
+}
 
 void
 test_do_tests(struct bbc_struct* p_bbc) {
   bbc_power_on_reset(p_bbc);
   bbc_power_on_reset(p_bbc);
 
+  test_util_hash64();
+  test_util_frame_hashes();
   timing_test();
   video_test();
   jit_test(p_bbc);
   expression_test();
   bbc_test(p_bbc);
+  debug_test(p_bbc);
+  frame_stream_test();
+  state_test(p_bbc);
   (void) printf("Tests OK!\n");
 }
 
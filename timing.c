@@ -1,36 +1,70 @@
 #include "timing.h"
 
+#include "log.h"
+#include "os_time.h"
+#include "snapshot.h"
 #include "util.h"
 
 #include <assert.h>
+#include <inttypes.h>
+#include <string.h>
 
 enum {
-  k_timing_num_timers = 24,
+  k_timing_initial_max_timers = 32,
+};
+
+struct timing_timer_stats {
+  uint64_t num_fires;
+  uint64_t num_rearms;
+  uint64_t fire_ns;
 };
 
 struct timer_struct {
   void (*p_callback)(void*);
   void* p_object;
+  const char* p_name;
+  /* While ticking, this is the absolute expiry time on the timing timeline.
+   * While stopped, it is the remaining time.
+   */
   int64_t value;
   int ticking;
   int firing;
-  struct timer_struct* p_expiry_prev;
-  struct timer_struct* p_expiry_next;
-  struct timer_struct* p_ticking_prev;
-  struct timer_struct* p_ticking_next;
+  /* Position in the expiry heap, valid while ticking and firing. */
+  uint32_t heap_index;
+  /* Breaks ties between equal expiry times, so simultaneous expiries fire
+   * in the order they were scheduled.
+   */
+  uint64_t sequence;
+  /* Instrumentation. Host time spent in the callback is only measured if
+   * instrumentation is enabled.
+   */
+  struct timing_timer_stats stats;
+  struct timing_timer_stats last_stats;
 };
 
 struct timing_struct {
   uint32_t scale_factor;
-  struct timer_struct timers[k_timing_num_timers];
+  struct timer_struct* p_timers;
+  uint32_t max_timers;
 
   uint64_t total_timer_ticks;
-  struct timer_struct* p_expiry_head;
-  struct timer_struct* p_ticking_head;
+  /* The timeline position as of the last time advance that was processed.
+   * Timer expiries are absolute on this timeline, so advancing time doesn't
+   * need to touch every ticking timer.
+   */
+  int64_t timeline;
+  /* Binary min-heap of the ids of timers that are ticking and firing, ordered
+   * by expiry time.
+   */
+  uint32_t* p_expiry_heap;
+  uint32_t expiry_heap_size;
+  uint64_t next_sequence;
 
   uint64_t next_timer_expiry;
   uint64_t countdown;
   uint32_t num_timers;
+
+  int is_instrumented;
 };
 
 struct timing_struct*
@@ -39,8 +73,13 @@ timing_create(uint32_t scale_factor) {
 
   p_timing->scale_factor = scale_factor;
   p_timing->total_timer_ticks = 0;
-  p_timing->p_expiry_head = NULL;
-  p_timing->p_ticking_head = NULL;
+  p_timing->timeline = 0;
+  p_timing->max_timers = k_timing_initial_max_timers;
+  p_timing->p_timers = util_mallocz(p_timing->max_timers *
+                                    sizeof(struct timer_struct));
+  p_timing->p_expiry_heap = util_malloc(p_timing->max_timers *
+                                        sizeof(uint32_t));
+  p_timing->expiry_heap_size = 0;
 
   p_timing->next_timer_expiry = INT64_MAX;
   p_timing->countdown = INT64_MAX;
@@ -50,6 +89,8 @@ timing_create(uint32_t scale_factor) {
 
 void
 timing_destroy(struct timing_struct* p_timing) {
+  util_free(p_timing->p_timers);
+  util_free(p_timing->p_expiry_heap);
   util_free(p_timing);
 }
 
@@ -69,13 +110,14 @@ timing_update_counts(struct timing_struct* p_timing) {
   uint64_t countdown;
   uint64_t next_timer_expiry;
 
-  struct timer_struct* p_expiry_head = p_timing->p_expiry_head;
   uint64_t adjustment = timing_get_countdown_adjustment(p_timing);
 
-  if (p_expiry_head == NULL) {
+  if (p_timing->expiry_heap_size == 0) {
     next_timer_expiry = INT64_MAX;
   } else {
-    next_timer_expiry = p_expiry_head->value;
+    struct timer_struct* p_expiry_head =
+        &p_timing->p_timers[p_timing->p_expiry_heap[0]];
+    next_timer_expiry = (p_expiry_head->value - p_timing->timeline);
   }
 
   countdown = (next_timer_expiry - adjustment);
@@ -111,6 +153,7 @@ timing_has_scaled_ticks_passed(struct timing_struct* p_timing,
 
 uint32_t
 timing_register_timer(struct timing_struct* p_timing,
+                      const char* p_name,
                       void* p_callback,
                       void* p_object) {
   uint32_t i;
@@ -118,113 +161,138 @@ timing_register_timer(struct timing_struct* p_timing,
 
   assert(p_callback != NULL);
 
-  for (i = 0; i < k_timing_num_timers; ++i) {
-    if (p_timing->timers[i].p_callback == NULL) {
+  for (i = 0; i < p_timing->max_timers; ++i) {
+    if (p_timing->p_timers[i].p_callback == NULL) {
       break;
     }
   }
-  if (i == k_timing_num_timers) {
-    util_bail("out of timer ids");
+  if (i == p_timing->max_timers) {
+    uint32_t max_timers = (p_timing->max_timers * 2);
+    p_timing->p_timers = util_realloc(p_timing->p_timers,
+                                      (max_timers *
+                                       sizeof(struct timer_struct)));
+    (void) memset(&p_timing->p_timers[i],
+                  '\0',
+                  ((max_timers - i) * sizeof(struct timer_struct)));
+    p_timing->p_expiry_heap = util_realloc(p_timing->p_expiry_heap,
+                                           (max_timers * sizeof(uint32_t)));
+    p_timing->max_timers = max_timers;
   }
 
-  p_timer = &p_timing->timers[i];
+  p_timer = &p_timing->p_timers[i];
 
   p_timer->p_callback = p_callback;
   p_timer->p_object = p_object;
+  p_timer->p_name = p_name;
   p_timer->value = INT64_MAX;
   p_timer->ticking = 0;
   p_timer->firing = 1;
-  p_timer->p_expiry_prev = NULL;
-  p_timer->p_expiry_next = NULL;
 
   p_timing->num_timers++;
 
   return i;
 }
 
-static void
-timing_insert_expiring_timer(struct timing_struct* p_timing,
-                             struct timer_struct* p_timer) {
-  struct timer_struct* p_iter = p_timing->p_expiry_head;
-  struct timer_struct* p_prev = NULL;
+static inline int
+timing_is_expiry_before(struct timer_struct* p_timer1,
+                        struct timer_struct* p_timer2) {
+  if (p_timer1->value != p_timer2->value) {
+    return (p_timer1->value < p_timer2->value);
+  }
+  return (p_timer1->sequence < p_timer2->sequence);
+}
 
-  assert(p_timer->p_expiry_prev == NULL);
-  assert(p_timer->p_expiry_next == NULL);
-  assert(p_timer->ticking);
-  assert(p_timer->firing);
+static inline void
+timing_heap_set(struct timing_struct* p_timing, uint32_t index, uint32_t id) {
+  p_timing->p_expiry_heap[index] = id;
+  p_timing->p_timers[id].heap_index = index;
+}
 
-  while ((p_iter != NULL) && (p_timer->value >= p_iter->value)) {
-    assert((p_prev == NULL) || (p_iter->value >= p_prev->value));
-    if (p_iter->p_expiry_next) {
-      assert(p_iter->p_expiry_next->p_expiry_prev == p_iter);
+static void
+timing_heap_sift_up(struct timing_struct* p_timing, uint32_t index) {
+  uint32_t* p_heap = p_timing->p_expiry_heap;
+  uint32_t id = p_heap[index];
+  struct timer_struct* p_timer = &p_timing->p_timers[id];
+
+  while (index > 0) {
+    uint32_t parent_index = ((index - 1) / 2);
+    uint32_t parent_id = p_heap[parent_index];
+    if (!timing_is_expiry_before(p_timer, &p_timing->p_timers[parent_id])) {
+      break;
     }
-    p_prev = p_iter;
-    p_iter = p_iter->p_expiry_next;
+    timing_heap_set(p_timing, index, parent_id);
+    index = parent_index;
   }
+  timing_heap_set(p_timing, index, id);
+}
 
-  p_timer->p_expiry_prev = p_prev;
-  if (p_prev == NULL) {
-    p_timer->p_expiry_next = p_timing->p_expiry_head;
-    if (p_timing->p_expiry_head) {
-      p_timing->p_expiry_head->p_expiry_prev = p_timer;
+static void
+timing_heap_sift_down(struct timing_struct* p_timing, uint32_t index) {
+  uint32_t* p_heap = p_timing->p_expiry_heap;
+  uint32_t size = p_timing->expiry_heap_size;
+  uint32_t id = p_heap[index];
+  struct timer_struct* p_timer = &p_timing->p_timers[id];
+
+  while (1) {
+    uint32_t child_index = ((index * 2) + 1);
+    uint32_t child_id;
+    if (child_index >= size) {
+      break;
     }
-    p_timing->p_expiry_head = p_timer;
-  } else {
-    p_timer->p_expiry_next = p_prev->p_expiry_next;
-    if (p_prev->p_expiry_next) {
-      p_prev->p_expiry_next->p_expiry_prev = p_timer;
+    child_id = p_heap[child_index];
+    if ((child_index + 1) < size) {
+      uint32_t right_id = p_heap[child_index + 1];
+      if (timing_is_expiry_before(&p_timing->p_timers[right_id],
+                                  &p_timing->p_timers[child_id])) {
+        child_index++;
+        child_id = right_id;
+      }
+    }
+    if (!timing_is_expiry_before(&p_timing->p_timers[child_id], p_timer)) {
+      break;
     }
-    p_prev->p_expiry_next = p_timer;
+    timing_heap_set(p_timing, index, child_id);
+    index = child_index;
   }
+  timing_heap_set(p_timing, index, id);
 }
 
 static void
-timing_remove_expiring_timer(struct timing_struct* p_timing,
-                             struct timer_struct* p_timer) {
-  if (p_timer->p_expiry_prev) {
-    p_timer->p_expiry_prev->p_expiry_next = p_timer->p_expiry_next;
-  } else {
-    assert(p_timer == p_timing->p_expiry_head);
-    p_timing->p_expiry_head = p_timer->p_expiry_next;
-  }
-  if (p_timer->p_expiry_next) {
-    p_timer->p_expiry_next->p_expiry_prev = p_timer->p_expiry_prev;
-  }
+timing_heap_insert(struct timing_struct* p_timing,
+                   struct timer_struct* p_timer) {
+  uint32_t index = p_timing->expiry_heap_size;
 
-  p_timer->p_expiry_prev = NULL;
-  p_timer->p_expiry_next = NULL;
+  assert(p_timer->ticking);
+  assert(p_timer->firing);
+  assert(index < p_timing->max_timers);
+
+  p_timing->expiry_heap_size++;
+  timing_heap_set(p_timing, index, (p_timer - p_timing->p_timers));
+  timing_heap_sift_up(p_timing, index);
 }
 
 static void
-timing_insert_ticking_timer(struct timing_struct* p_timing,
-                            struct timer_struct* p_timer) {
-  struct timer_struct* p_old_head = p_timing->p_ticking_head;
-
-  assert(p_timer->p_ticking_prev == NULL);
-  assert(p_timer->p_ticking_next == NULL);
-
-  p_timing->p_ticking_head = p_timer;
-  p_timer->p_ticking_next = p_old_head;
-  if (p_old_head) {
-    p_old_head->p_ticking_prev = p_timer;
-  }
+timing_insert_expiring_timer(struct timing_struct* p_timing,
+                             struct timer_struct* p_timer) {
+  p_timer->sequence = p_timing->next_sequence++;
+  timing_heap_insert(p_timing, p_timer);
 }
 
 static void
-timing_remove_ticking_timer(struct timing_struct* p_timing,
-                            struct timer_struct* p_timer) {
-  if (p_timer->p_ticking_prev) {
-    p_timer->p_ticking_prev->p_ticking_next = p_timer->p_ticking_next;
-  } else {
-    assert(p_timer == p_timing->p_ticking_head);
-    p_timing->p_ticking_head = p_timer->p_ticking_next;
-  }
-  if (p_timer->p_ticking_next) {
-    p_timer->p_ticking_next->p_ticking_prev = p_timer->p_ticking_prev;
-  }
+timing_remove_expiring_timer(struct timing_struct* p_timing,
+                             struct timer_struct* p_timer) {
+  uint32_t index = p_timer->heap_index;
+  uint32_t last_index = (p_timing->expiry_heap_size - 1);
+
+  assert(p_timing->p_expiry_heap[index] == (p_timer - p_timing->p_timers));
 
-  p_timer->p_ticking_prev = NULL;
-  p_timer->p_ticking_next = NULL;
+  p_timing->expiry_heap_size--;
+  if (index == last_index) {
+    return;
+  }
+  timing_heap_set(p_timing, index, p_timing->p_expiry_heap[last_index]);
+  timing_heap_sift_down(p_timing, index);
+  timing_heap_sift_up(p_timing, index);
 }
 
 static int64_t
@@ -234,12 +302,12 @@ timing_start_timer_with_internal_value(struct timing_struct* p_timing,
   assert(p_timer->p_callback != NULL);
   assert(!p_timer->ticking);
 
-  value += timing_get_countdown_adjustment(p_timing);
+  value += (p_timing->timeline + timing_get_countdown_adjustment(p_timing));
 
   p_timer->value = value;
   p_timer->ticking = 1;
+  p_timer->stats.num_rearms++;
 
-  timing_insert_ticking_timer(p_timing, p_timer);
   if (p_timer->firing) {
     timing_insert_expiring_timer(p_timing, p_timer);
   }
@@ -251,8 +319,8 @@ int64_t
 timing_start_timer(struct timing_struct* p_timing, uint32_t id) {
   struct timer_struct* p_timer;
 
-  assert(id < k_timing_num_timers);
-  p_timer = &p_timing->timers[id];
+  assert(id < p_timing->max_timers);
+  p_timer = &p_timing->p_timers[id];
   return timing_start_timer_with_internal_value(p_timing,
                                                 p_timer,
                                                 p_timer->value);
@@ -264,9 +332,9 @@ timing_start_timer_with_value(struct timing_struct* p_timing,
                               int64_t time) {
   struct timer_struct* p_timer;
 
-  assert(id < k_timing_num_timers);
+  assert(id < p_timing->max_timers);
 
-  p_timer = &p_timing->timers[id];
+  p_timer = &p_timing->p_timers[id];
 
   time *= p_timing->scale_factor;
 
@@ -277,15 +345,14 @@ int64_t
 timing_stop_timer(struct timing_struct* p_timing, uint32_t id) {
   struct timer_struct* p_timer;
 
-  assert(id < k_timing_num_timers);
+  assert(id < p_timing->max_timers);
 
-  p_timer = &p_timing->timers[id];
+  p_timer = &p_timing->p_timers[id];
   assert(p_timer->p_callback != NULL);
   assert(p_timer->ticking);
 
   p_timer->ticking = 0;
 
-  timing_remove_ticking_timer(p_timing, p_timer);
   if (p_timer->firing) {
     timing_remove_expiring_timer(p_timing, p_timer);
   }
@@ -293,16 +360,17 @@ timing_stop_timer(struct timing_struct* p_timing, uint32_t id) {
   /* While the timer is not ticking, store the timer value directly. This
    * avoids having to update it while the countdown ticks.
    */
-  p_timer->value -= timing_get_countdown_adjustment(p_timing);
+  p_timer->value -= (p_timing->timeline +
+                     timing_get_countdown_adjustment(p_timing));
 
   return timing_update_counts(p_timing);
 }
 
 int
 timing_timer_is_running(struct timing_struct* p_timing, uint32_t id) {
-  assert(id < k_timing_num_timers);
+  assert(id < p_timing->max_timers);
 
-  return p_timing->timers[id].ticking;
+  return p_timing->p_timers[id].ticking;
 }
 
 int64_t
@@ -310,12 +378,12 @@ timing_get_timer_value(struct timing_struct* p_timing, uint32_t id) {
   struct timer_struct* p_timer;
   int64_t ret;
 
-  assert(id < k_timing_num_timers);
+  assert(id < p_timing->max_timers);
 
-  p_timer = &p_timing->timers[id];
+  p_timer = &p_timing->p_timers[id];
   ret = p_timer->value;
   if (p_timer->ticking) {
-    ret -= timing_get_countdown_adjustment(p_timing);
+    ret -= (p_timing->timeline + timing_get_countdown_adjustment(p_timing));
   }
   ret /= p_timing->scale_factor;
   return ret;
@@ -327,17 +395,18 @@ timing_set_timer_value(struct timing_struct* p_timing,
                        int64_t time) {
   struct timer_struct* p_timer;
 
-  assert(id < k_timing_num_timers);
+  assert(id < p_timing->max_timers);
 
-  p_timer = &p_timing->timers[id];
+  p_timer = &p_timing->p_timers[id];
   assert(p_timer->p_callback != NULL);
 
   time *= p_timing->scale_factor;
   if (p_timer->ticking) {
-    time += timing_get_countdown_adjustment(p_timing);
+    time += (p_timing->timeline + timing_get_countdown_adjustment(p_timing));
   }
 
   p_timer->value = time;
+  p_timer->stats.num_rearms++;
 
   if (p_timer->ticking && p_timer->firing) {
     timing_remove_expiring_timer(p_timing, p_timer);
@@ -357,9 +426,9 @@ timing_adjust_timer_value(struct timing_struct* p_timing,
 
   uint32_t scale_factor = p_timing->scale_factor;
 
-  assert(id < k_timing_num_timers);
+  assert(id < p_timing->max_timers);
 
-  p_timer = &p_timing->timers[id];
+  p_timer = &p_timing->p_timers[id];
   assert(p_timer->p_callback != NULL);
 
   delta *= scale_factor;
@@ -367,10 +436,15 @@ timing_adjust_timer_value(struct timing_struct* p_timing,
   new_time = (p_timer->value + delta);
 
   if (p_new_value) {
-    *p_new_value = (new_time / scale_factor);
+    int64_t new_value = new_time;
+    if (p_timer->ticking) {
+      new_value -= p_timing->timeline;
+    }
+    *p_new_value = (new_value / scale_factor);
   }
 
   p_timer->value = new_time;
+  p_timer->stats.num_rearms++;
 
   if (p_timer->ticking && p_timer->firing) {
     timing_remove_expiring_timer(p_timing, p_timer);
@@ -382,9 +456,9 @@ timing_adjust_timer_value(struct timing_struct* p_timing,
 
 int
 timing_get_firing(struct timing_struct* p_timing, uint32_t id) {
-  assert(id < k_timing_num_timers);
+  assert(id < p_timing->max_timers);
 
-  return p_timing->timers[id].firing;
+  return p_timing->p_timers[id].firing;
 }
 
 int64_t
@@ -393,9 +467,9 @@ timing_set_firing(struct timing_struct* p_timing, uint32_t id, int firing) {
 
   int firing_changed = 0;
 
-  assert(id < k_timing_num_timers);
+  assert(id < p_timing->max_timers);
 
-  p_timer = &p_timing->timers[id];
+  p_timer = &p_timing->p_timers[id];
   if (firing != p_timer->firing) {
     firing_changed = 1;
     p_timer->firing = firing;
@@ -412,50 +486,177 @@ timing_set_firing(struct timing_struct* p_timing, uint32_t id, int firing) {
   return timing_update_counts(p_timing);
 }
 
-static uint64_t
-timing_do_advance_time(struct timing_struct* p_timing, uint64_t delta) {
+void
+timing_snapshot(struct timing_struct* p_timing,
+                struct snapshot_struct* p_snapshot) {
+  SNAPSHOT_FIELD(p_snapshot, p_timing->total_timer_ticks);
+}
+
+int64_t
+timing_snapshot_timer(struct timing_struct* p_timing,
+                      uint32_t id,
+                      struct snapshot_struct* p_snapshot) {
   struct timer_struct* p_timer;
+  int64_t value;
+  int ticking;
+  int firing;
+  uint64_t sequence;
 
-  delta += timing_get_countdown_adjustment(p_timing);
+  int64_t now = (p_timing->timeline +
+                 timing_get_countdown_adjustment(p_timing));
 
-  /* Pass 1: update all timers with their correct new value. */
-  p_timer = p_timing->p_ticking_head;
-  while (p_timer != NULL) {
-    assert(p_timer->ticking);
-    if (p_timer->p_expiry_next) {
-      assert(p_timer->p_expiry_next->p_expiry_prev == p_timer);
+  assert(id < p_timing->max_timers);
+  p_timer = &p_timing->p_timers[id];
+  assert(p_timer->p_callback != NULL);
+
+  /* Ticking timers are stored relative to the current time, because the
+   * timeline itself is never rewound.
+   */
+  value = p_timer->value;
+  if (p_timer->ticking) {
+    value -= now;
+  }
+  ticking = p_timer->ticking;
+  firing = p_timer->firing;
+  sequence = p_timer->sequence;
+
+  SNAPSHOT_FIELD(p_snapshot, value);
+  SNAPSHOT_FIELD(p_snapshot, ticking);
+  SNAPSHOT_FIELD(p_snapshot, firing);
+  SNAPSHOT_FIELD(p_snapshot, sequence);
+
+  if (!snapshot_is_load(p_snapshot)) {
+    return p_timing->countdown;
+  }
+
+  if (p_timer->ticking && p_timer->firing) {
+    timing_remove_expiring_timer(p_timing, p_timer);
+  }
+  if (ticking) {
+    value += now;
+  }
+  p_timer->value = value;
+  p_timer->ticking = ticking;
+  p_timer->firing = firing;
+  /* Keep the original sequence so that ties between restored timers break
+   * the same way they did when the snapshot was taken.
+   */
+  p_timer->sequence = sequence;
+  if (sequence >= p_timing->next_sequence) {
+    p_timing->next_sequence = (sequence + 1);
+  }
+  if (ticking && firing) {
+    timing_heap_insert(p_timing, p_timer);
+  }
+
+  return timing_update_counts(p_timing);
+}
+
+void
+timing_set_instrumented(struct timing_struct* p_timing,
+                        int is_instrumented) {
+  p_timing->is_instrumented = is_instrumented;
+}
+
+void
+timing_log_timer_rates(struct timing_struct* p_timing, double delta_s) {
+  uint32_t i;
+
+  for (i = 0; i < p_timing->max_timers; ++i) {
+    uint64_t delta_fires;
+    uint64_t delta_rearms;
+    uint64_t delta_ns;
+    struct timer_struct* p_timer = &p_timing->p_timers[i];
+
+    if (p_timer->p_callback == NULL) {
+      continue;
     }
-    if (p_timer->p_ticking_next) {
-      assert(p_timer->p_ticking_next->p_ticking_prev == p_timer);
+    delta_fires = (p_timer->stats.num_fires - p_timer->last_stats.num_fires);
+    delta_rearms = (p_timer->stats.num_rearms - p_timer->last_stats.num_rearms);
+    delta_ns = (p_timer->stats.fire_ns - p_timer->last_stats.fire_ns);
+    p_timer->last_stats = p_timer->stats;
+    if ((delta_fires == 0) && (delta_rearms == 0)) {
+      continue;
     }
+    log_do_log(k_log_perf,
+               k_log_info,
+               " timer %s: %.1f fires/s %.1f rearms/s %.1f us/s",
+               p_timer->p_name,
+               (delta_fires / delta_s),
+               (delta_rearms / delta_s),
+               ((delta_ns / 1000.0) / delta_s));
+  }
+}
+
+void
+timing_log_timer_totals(struct timing_struct* p_timing) {
+  uint32_t i;
 
-    p_timer->value -= delta;
+  for (i = 0; i < p_timing->max_timers; ++i) {
+    struct timer_struct* p_timer = &p_timing->p_timers[i];
 
-    p_timer = p_timer->p_ticking_next;
+    if (p_timer->p_callback == NULL) {
+      continue;
+    }
+    log_do_log(k_log_perf,
+               k_log_info,
+               "timer %s total: %"PRIu64" fires %"PRIu64" rearms %.1f ms",
+               p_timer->p_name,
+               p_timer->stats.num_fires,
+               p_timer->stats.num_rearms,
+               (p_timer->stats.fire_ns / 1000000.0));
   }
+}
+
+static uint64_t
+timing_do_advance_time(struct timing_struct* p_timing, uint64_t delta) {
+  int64_t timeline;
+
+  delta += timing_get_countdown_adjustment(p_timing);
+
+  /* Timer expiries are absolute, so advancing time is just moving the
+   * timeline.
+   */
+  timeline = (p_timing->timeline + delta);
+  p_timing->timeline = timeline;
 
   /* Clear the countdown adjustment. */
   p_timing->next_timer_expiry = 0;
   p_timing->countdown = 0;
 
-  /* Pass 2: fire any timers. */
-  p_timer = p_timing->p_expiry_head;
-  while ((p_timer != NULL) && (p_timer->value <= 0)) {
-    struct timer_struct* p_old_timer = p_timer;
+  /* Fire any timers. Callbacks may reschedule any timer, so re-examine the
+   * head of the heap each time.
+   */
+  while (p_timing->expiry_heap_size > 0) {
+    uint64_t fire_ns;
+    uint32_t id = p_timing->p_expiry_heap[0];
+    struct timer_struct* p_timer = &p_timing->p_timers[id];
+    if (p_timer->value > timeline) {
+      break;
+    }
 
-    assert(p_old_timer->ticking);
-    assert(p_old_timer->firing);
+    assert(p_timer->ticking);
+    assert(p_timer->firing);
 
     /* Callers of timing_do_advance_time() are required to expire active timers
      * exactly on time.
      */
-    assert(p_timer->value == 0);
-    /* Load the next timer, as calling the callback is likely to trash it. */
-    p_timer = p_timer->p_expiry_next;
-    p_old_timer->p_callback(p_old_timer->p_object);
-    assert(!p_old_timer->ticking ||
-           !p_old_timer->firing ||
-           (p_old_timer->value > 0));
+    assert(p_timer->value == timeline);
+    p_timer->stats.num_fires++;
+    if (!p_timing->is_instrumented) {
+      p_timer->p_callback(p_timer->p_object);
+      fire_ns = 0;
+    } else {
+      uint64_t start_ns = os_time_get_ns();
+      p_timer->p_callback(p_timer->p_object);
+      fire_ns = (os_time_get_ns() - start_ns);
+    }
+    /* The callback may have registered a timer and moved the timer array. */
+    p_timer = &p_timing->p_timers[id];
+    p_timer->stats.fire_ns += fire_ns;
+    assert(!p_timer->ticking ||
+           !p_timer->firing ||
+           (p_timer->value > timeline));
   }
 
   return timing_update_counts(p_timing);
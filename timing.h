@@ -4,6 +4,7 @@
 #include <stddef.h>
 #include <stdint.h>
 
+struct snapshot_struct;
 struct timing_struct;
 
 struct timing_struct* timing_create(uint32_t scale_factor);
@@ -18,6 +19,7 @@ int timing_has_scaled_ticks_passed(struct timing_struct* p_timing,
                                    uint64_t scaled_ticks);
 
 uint32_t timing_register_timer(struct timing_struct* p_timing,
+                               const char* p_name,
                                void* p_callback,
                                void* p_object);
 void timing_free_timer(struct timing_struct* p_timing, uint32_t id);
@@ -41,6 +43,17 @@ int64_t timing_set_firing(struct timing_struct* p_timing,
                           uint32_t id,
                           int firing);
 
+void timing_snapshot(struct timing_struct* p_timing,
+                     struct snapshot_struct* p_snapshot);
+int64_t timing_snapshot_timer(struct timing_struct* p_timing,
+                              uint32_t id,
+                              struct snapshot_struct* p_snapshot);
+
+void timing_set_instrumented(struct timing_struct* p_timing,
+                             int is_instrumented);
+void timing_log_timer_rates(struct timing_struct* p_timing, double delta_s);
+void timing_log_timer_totals(struct timing_struct* p_timing);
+
 int64_t timing_get_countdown(struct timing_struct* p_timing);
 int64_t timing_advance_time(struct timing_struct* p_timing, int64_t countdown);
 int64_t timing_advance_time_delta(struct timing_struct* p_timing,
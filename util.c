@@ -685,3 +685,85 @@ uint32_t
 util_crc32_finish(uint32_t crc) {
   return ~crc;
 }
+
+static const uint64_t k_util_hash64_prime1 = 0x9E3779B185EBCA87ull;
+static const uint64_t k_util_hash64_prime2 = 0xC2B2AE3D27D4EB4Full;
+static const uint64_t k_util_hash64_prime3 = 0x165667B19E3779F9ull;
+static const uint64_t k_util_hash64_prime4 = 0x85EBCA77C2B2AE63ull;
+static const uint64_t k_util_hash64_prime5 = 0x27D4EB2F165667C5ull;
+
+static inline uint64_t
+util_hash64_rotl(uint64_t val, uint32_t bits) {
+  return ((val << bits) | (val >> (64 - bits)));
+}
+
+uint64_t
+util_hash64_init() {
+  return k_util_hash64_prime5;
+}
+
+uint64_t
+util_hash64_add(uint64_t hash, const void* p_buf, size_t len) {
+  const uint8_t* p_bytes = (const uint8_t*) p_buf;
+
+  while (len >= 8) {
+    uint64_t val;
+    (void) memcpy(&val, p_bytes, sizeof(val));
+    val *= k_util_hash64_prime2;
+    val = util_hash64_rotl(val, 31);
+    val *= k_util_hash64_prime1;
+    hash ^= val;
+    hash = util_hash64_rotl(hash, 27);
+    hash = ((hash * k_util_hash64_prime1) + k_util_hash64_prime4);
+    p_bytes += 8;
+    len -= 8;
+  }
+  while (len > 0) {
+    hash ^= (*p_bytes * k_util_hash64_prime5);
+    hash = util_hash64_rotl(hash, 11);
+    hash *= k_util_hash64_prime1;
+    p_bytes++;
+    len--;
+  }
+
+  return hash;
+}
+
+uint64_t
+util_hash64_finish(uint64_t hash) {
+  hash ^= (hash >> 33);
+  hash *= k_util_hash64_prime2;
+  hash ^= (hash >> 29);
+  hash *= k_util_hash64_prime3;
+  hash ^= (hash >> 32);
+  return hash;
+}
+
+int
+util_parse_frame_hashes(uint64_t** p_p_hashes,
+                        uint32_t* p_num_hashes,
+                        const char* p_str) {
+  uint64_t* p_hashes = NULL;
+  uint32_t num_hashes = 0;
+
+  while (1) {
+    uint32_t frame;
+    uint64_t hash;
+    int consumed;
+    if (sscanf(p_str, "%"SCNu32" %"SCNx64"%n", &frame, &hash, &consumed) != 2) {
+      break;
+    }
+    if (frame != num_hashes) {
+      util_free(p_hashes);
+      return 0;
+    }
+    p_hashes = util_realloc(p_hashes, ((num_hashes + 1) * sizeof(uint64_t)));
+    p_hashes[num_hashes] = hash;
+    num_hashes++;
+    p_str += consumed;
+  }
+
+  *p_p_hashes = p_hashes;
+  *p_num_hashes = num_hashes;
+  return 1;
+}
@@ -112,5 +112,17 @@ uint32_t util_read_le32(uint8_t* p_buf);
 uint32_t util_crc32_init();
 uint32_t util_crc32_add(uint32_t crc, uint8_t* p_buf, uint32_t len);
 uint32_t util_crc32_finish(uint32_t crc);
+/* A fast, non-cryptographic 64-bit hash along the lines of xxHash64. Results
+ * depend on how the data is split across calls.
+ */
+uint64_t util_hash64_init();
+uint64_t util_hash64_add(uint64_t hash, const void* p_buf, size_t len);
+uint64_t util_hash64_finish(uint64_t hash);
+/* Parses "<frame> <hex hash>" lines, as written by -frames-hash. Returns 0 if
+ * the frames don't count up from 0.
+ */
+int util_parse_frame_hashes(uint64_t** p_p_hashes,
+                            uint32_t* p_num_hashes,
+                            const char* p_str);
 
 #endif /* BEEBJIT_UTIL_H */
@@ -5,6 +5,8 @@
 
 #include "util_compress.h"
 
+#include "util.h"
+
 #include <string.h>
 
 static int
@@ -115,6 +117,28 @@ util_gunzip(size_t* p_dst_len, uint8_t* p_src, size_t src_len, uint8_t* p_dst) {
   return ret;
 }
 
+size_t
+util_compress_bound(size_t src_len) {
+  return compressBound(src_len);
+}
+
+int
+util_compress(size_t* p_dst_len,
+              uint8_t* p_src,
+              size_t src_len,
+              uint8_t* p_dst) {
+  mz_ulong dst_len = *p_dst_len;
+  int ret = compress2(p_dst, &dst_len, p_src, src_len, MZ_BEST_SPEED);
+
+  if (ret != Z_OK) {
+    return -1;
+  }
+
+  *p_dst_len = dst_len;
+
+  return 0;
+}
+
 int
 util_uncompress(size_t* p_dst_len,
                 uint8_t* p_src,
@@ -132,3 +156,22 @@ util_uncompress(size_t* p_dst_len,
 
   return 0;
 }
+
+uint8_t*
+util_compress_png(size_t* p_dst_len,
+                  const uint8_t* p_src,
+                  uint32_t width,
+                  uint32_t height) {
+  void* p_png = tdefl_write_image_to_png_file_in_memory_ex(p_src,
+                                                           width,
+                                                           height,
+                                                           3,
+                                                           p_dst_len,
+                                                           MZ_BEST_SPEED,
+                                                           MZ_FALSE);
+  if (p_png == NULL) {
+    util_bail("PNG compression failed");
+  }
+
+  return (uint8_t*) p_png;
+}
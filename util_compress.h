@@ -6,9 +6,23 @@ int util_gunzip(size_t* p_dst_len,
                 size_t src_len,
                 uint8_t* p_dst);
 
+/* Fast zlib compression, for data written often such as state files. */
+size_t util_compress_bound(size_t src_len);
+int util_compress(size_t* p_dst_len,
+                  uint8_t* p_src,
+                  size_t src_len,
+                  uint8_t* p_dst);
+
 int util_uncompress(size_t* p_dst_len,
                     uint8_t* p_src,
                     size_t src_len,
                     uint8_t* p_dst);
 
+/* Fast PNG compression of packed 8-bit RGB. Free the result with util_free().
+ */
+uint8_t* util_compress_png(size_t* p_dst_len,
+                           const uint8_t* p_src,
+                           uint32_t width,
+                           uint32_t height);
+
 #endif /* BEEBJIT_UTIL_COMPRESS_H */
@@ -3,6 +3,7 @@
 #include "bbc.h"
 #include "cmos.h"
 #include "keyboard.h"
+#include "snapshot.h"
 #include "sound.h"
 #include "state_6502.h"
 #include "timing.h"
@@ -316,8 +317,16 @@ via_create(int id,
   p_via->p_bbc = p_bbc;
   p_via->p_timing = p_timing;
 
-  p_via->t1_timer_id = timing_register_timer(p_timing, via_t1_fired, p_via);
-  p_via->t2_timer_id = timing_register_timer(p_timing, via_t2_fired, p_via);
+  p_via->t1_timer_id = timing_register_timer(
+      p_timing,
+      ((id == k_via_system) ? "sysvia_t1" : "uservia_t1"),
+      via_t1_fired,
+      p_via);
+  p_via->t2_timer_id = timing_register_timer(
+      p_timing,
+      ((id == k_via_system) ? "sysvia_t2" : "uservia_t2"),
+      via_t2_fired,
+      p_via);
 
   return p_via;
 }
@@ -1156,3 +1165,32 @@ void via_set_registers(struct via_struct* p_via,
   timing_set_firing(p_timing, p_via->t2_timer_id, !t2_oneshot_fired);
   p_via->t1_pb7 = t1_pb7;
 }
+
+void
+via_snapshot(struct via_struct* p_via, struct snapshot_struct* p_snapshot) {
+  struct timing_struct* p_timing = p_via->p_timing;
+
+  SNAPSHOT_FIELD(p_snapshot, p_via->IRA);
+  SNAPSHOT_FIELD(p_snapshot, p_via->IRB);
+  SNAPSHOT_FIELD(p_snapshot, p_via->ORB);
+  SNAPSHOT_FIELD(p_snapshot, p_via->ORA);
+  SNAPSHOT_FIELD(p_snapshot, p_via->DDRB);
+  SNAPSHOT_FIELD(p_snapshot, p_via->DDRA);
+  SNAPSHOT_FIELD(p_snapshot, p_via->SR);
+  SNAPSHOT_FIELD(p_snapshot, p_via->ACR);
+  SNAPSHOT_FIELD(p_snapshot, p_via->PCR);
+  SNAPSHOT_FIELD(p_snapshot, p_via->IFR);
+  SNAPSHOT_FIELD(p_snapshot, p_via->IER);
+  SNAPSHOT_FIELD(p_snapshot, p_via->peripheral_b);
+  SNAPSHOT_FIELD(p_snapshot, p_via->peripheral_a);
+  SNAPSHOT_FIELD(p_snapshot, p_via->T1L);
+  SNAPSHOT_FIELD(p_snapshot, p_via->T2L);
+  SNAPSHOT_FIELD(p_snapshot, p_via->t1_pb7);
+  SNAPSHOT_FIELD(p_snapshot, p_via->CA1);
+  SNAPSHOT_FIELD(p_snapshot, p_via->CA2);
+  SNAPSHOT_FIELD(p_snapshot, p_via->CB1);
+  SNAPSHOT_FIELD(p_snapshot, p_via->CB2);
+  /* The counters and one-shot state live in the timers. */
+  (void) timing_snapshot_timer(p_timing, p_via->t1_timer_id, p_snapshot);
+  (void) timing_snapshot_timer(p_timing, p_via->t2_timer_id, p_snapshot);
+}
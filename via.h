@@ -6,6 +6,7 @@
 struct via_struct;
 
 struct bbc_struct;
+struct snapshot_struct;
 struct timing_struct;
 struct video_struct;
 
@@ -100,4 +101,6 @@ void via_set_registers(struct via_struct* p_via,
                        uint8_t t2_oneshot_fired,
                        uint8_t t1_pb7);
 
+void via_snapshot(struct via_struct* p_via, struct snapshot_struct* p_snapshot);
+
 #endif /* BEEBJIT_VIA_H */
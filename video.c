@@ -2,7 +2,11 @@
 
 #include "bbc_options.h"
 #include "log.h"
+#include "os_channel.h"
+#include "os_lock.h"
+#include "os_thread.h"
 #include "render.h"
+#include "snapshot.h"
 #include "teletext.h"
 #include "timing.h"
 #include "util.h"
@@ -76,6 +80,99 @@ enum {
   k_video_timer_expect_vsync_lower = 4,
 };
 
+enum {
+  /* Enough for any standard mode; bigger frames are always rendered. */
+  k_video_frame_data_max = 32768,
+  /* One being filled, one published and one being rendered. */
+  k_video_num_frames = 3,
+  k_video_frame_mem_size = 0x8000,
+  /* R6 is 7 bits, and R1 is 8 bits. */
+  k_video_teletext_rows = 128,
+  k_video_teletext_row_cols = 256,
+  /* Adaptive frame skip looks at host load over windows of this length. */
+  k_video_host_load_window_us = 500000,
+  k_video_frames_skip_max_default = 4,
+};
+
+/* Everything other than screen memory that a full frame render depends on. */
+struct video_frame_state {
+  uint8_t crtc_registers[k_video_crtc_num_registers];
+  uint8_t video_ula_control;
+  uint8_t teletext_flash;
+  uint32_t palette[16];
+  uint32_t screen_wrap_add;
+  uint32_t buffer_generation;
+  uint32_t data_len;
+};
+
+/* A copy of everything a full frame render reads, taken on the BBC thread at
+ * paint time so that the render thread never looks at live state.
+ */
+struct video_frame {
+  uint8_t crtc_registers[k_video_crtc_num_registers];
+  uint8_t video_ula_control;
+  uint8_t hsync_pulse_width;
+  uint32_t clock_tick_multiplier;
+  uint32_t screen_wrap_add;
+  uint32_t palette[16];
+  uint8_t mem[k_video_frame_mem_size];
+};
+
+struct video_frame_geometry {
+  uint32_t crtc_start_address;
+  uint32_t num_rows;
+  uint32_t num_lines;
+  uint32_t num_cols;
+  uint32_t num_pre_lines;
+  uint32_t num_pre_cols;
+  uint32_t hsync_pulse_ticks;
+  int is_teletext;
+  int is_teletext_row_cached;
+};
+
+enum {
+  k_video_band_render = 1,
+  k_video_band_exit = 2,
+};
+
+/* A horizontal band of character rows, rendered by its own renderer on a
+ * worker thread. Band 0 is the main renderer, run on the calling thread.
+ */
+struct video_render_band {
+  struct video_struct* p_video;
+  struct render_struct* p_render;
+  struct teletext_struct* p_teletext;
+  struct os_thread_struct* p_thread;
+  intptr_t handle_main_read;
+  intptr_t handle_main_write;
+  intptr_t handle_worker_read;
+  intptr_t handle_worker_write;
+  struct video_frame* p_frame;
+  struct video_frame_geometry geometry;
+  uint32_t row_start;
+  uint32_t row_end;
+};
+
+/* Everything, other than its own data bytes and SAA5050 state, that decides
+ * the pixels of a MODE7 character row and where they go in the buffer.
+ */
+struct video_teletext_rows_key {
+  uint8_t crtc_registers[k_video_crtc_num_registers];
+  uint8_t video_ula_control;
+  uint32_t hsync_pulse_ticks;
+  uint32_t buffer_generation;
+};
+
+/* A MODE7 character row as last rendered. While its inputs are unchanged,
+ * its pixels are still in the buffer.
+ */
+struct video_teletext_row {
+  int is_valid;
+  uint8_t data[k_video_teletext_row_cols];
+  struct teletext_struct* p_start_state;
+  struct teletext_struct* p_end_state;
+};
+
 enum {
   k_video_display_enable_horiz = 1,
   k_video_display_enable_vert = 2,
@@ -109,17 +206,38 @@ struct video_struct {
   uint64_t last_wall_time_vsync_hit_cycles;
   int is_rendering_active;
   int has_paint_timer_triggered;
+  struct video_frame_state frame_state;
+  int has_frame_state;
+  uint8_t* p_frame_data;
+  struct video_frame* p_frames;
+  struct os_lock_struct* p_frames_lock;
+  int32_t frame_latest;
+  int32_t frame_in_use;
+  uint32_t num_render_bands;
+  struct video_render_band* p_render_bands;
+  struct video_teletext_rows_key teletext_rows_key;
+  struct video_teletext_row* p_teletext_rows;
 
   /* Options. */
   uint32_t frames_skip;
   uint32_t frame_skip_counter;
+  int is_opt_frames_skip_auto;
+  uint32_t frames_skip_max;
+  uint64_t host_busy_us;
+  uint64_t host_budget_us;
+  uint32_t host_idle_windows;
+  int is_frame_hash_enabled;
   int is_opt_always_clear_frame_buffer;
+  int is_opt_skip_unchanged_frames;
+  int is_opt_teletext_row_cache;
+  int is_opt_quiet_span;
 
   /* Timing. */
   uint64_t wall_time;
   uint64_t vsync_next_time;
   uint64_t prev_system_ticks;
   int timer_fire_mode;
+  int is_timer_stale;
   uint64_t num_vsyncs;
   uint64_t num_crtc_advances;
   uint64_t paint_start_cycles;
@@ -186,12 +304,12 @@ struct video_struct {
   int dispen_shifts[4];
 };
 
-static inline uint8_t
-video_read_data_byte(struct video_struct* p_video,
-                     uint64_t ticks,
-                     uint32_t address_counter,
-                     uint8_t scanline_counter,
-                     uint32_t screen_wrap_add) {
+static inline uint32_t
+video_get_data_address(struct video_struct* p_video,
+                       uint64_t ticks,
+                       uint32_t address_counter,
+                       uint8_t scanline_counter,
+                       uint32_t screen_wrap_add) {
   uint32_t address;
 
   /* If MA13 set => MODE7 style addressing. */
@@ -220,6 +338,21 @@ video_read_data_byte(struct video_struct* p_video,
     address &= 0x7FFF;
   }
 
+  return address;
+}
+
+static inline uint8_t
+video_read_data_byte(struct video_struct* p_video,
+                     uint64_t ticks,
+                     uint32_t address_counter,
+                     uint8_t scanline_counter,
+                     uint32_t screen_wrap_add) {
+  uint32_t address = video_get_data_address(p_video,
+                                            ticks,
+                                            address_counter,
+                                            scanline_counter,
+                                            screen_wrap_add);
+
   if (p_video->is_shadow_displayed) {
     /* TODO: won't display correctly for ANDY / HAZEL if they are paged in. */
     return p_video->p_shadow_mem[address];
@@ -272,10 +405,85 @@ video_get_clock_speed(struct video_struct* p_video) {
   return !!(p_video->video_ula_control & k_ula_clock_speed);
 }
 
+static inline int
+video_get_flash(struct video_struct* p_video) {
+  return !!(p_video->video_ula_control & k_ula_flash);
+}
+
+static uint32_t
+video_get_real_color(struct video_struct* p_video, uint8_t index) {
+  uint32_t color;
+
+  uint8_t rgbf = p_video->ula_palette[index];
+
+  /* The actual color displayed depends on the flash bit. */
+  if ((rgbf & 0x8) && video_get_flash(p_video)) {
+    rgbf ^= 0x7;
+  }
+  /* Alpha. */
+  color = 0xff000000;
+  /* Red. */
+  if (rgbf & 0x1) {
+    color |= 0x00ff0000;
+  }
+  /* Green. */
+  if (rgbf & 0x2) {
+    color |= 0x0000ff00;
+  }
+  /* Blue. */
+  if (rgbf & 0x4) {
+    color |= 0x000000ff;
+  }
+
+  return color;
+}
+
+static void
+video_capture_frame(struct video_struct* p_video) {
+  struct video_frame* p_frame;
+  uint8_t* p_mem;
+  int32_t i;
+
+  os_lock_lock(p_video->p_frames_lock);
+  for (i = 0; i < k_video_num_frames; ++i) {
+    if ((i != p_video->frame_latest) && (i != p_video->frame_in_use)) {
+      break;
+    }
+  }
+  os_lock_unlock(p_video->p_frames_lock);
+  assert(i < k_video_num_frames);
+
+  p_frame = &p_video->p_frames[i];
+  (void) memcpy(&p_frame->crtc_registers[0],
+                &p_video->crtc_registers[0],
+                sizeof(p_frame->crtc_registers));
+  p_frame->video_ula_control = p_video->video_ula_control;
+  p_frame->hsync_pulse_width = p_video->hsync_pulse_width;
+  p_frame->clock_tick_multiplier = p_video->clock_tick_multiplier;
+  p_frame->screen_wrap_add = p_video->screen_wrap_add;
+  for (i = 0; i < 16; ++i) {
+    p_frame->palette[i] = video_get_real_color(p_video, i);
+  }
+  if (p_video->is_shadow_displayed) {
+    p_mem = p_video->p_shadow_mem;
+  } else {
+    p_mem = p_video->p_bbc_mem;
+  }
+  (void) memcpy(&p_frame->mem[0], p_mem, sizeof(p_frame->mem));
+
+  os_lock_lock(p_video->p_frames_lock);
+  p_video->frame_latest = (p_frame - p_video->p_frames);
+  os_lock_unlock(p_video->p_frames_lock);
+}
+
 void
 video_force_paint(struct video_struct* p_video, int do_clear_after_paint) {
   int do_full_render = p_video->externally_clocked;
 
+  if (do_full_render) {
+    video_capture_frame(p_video);
+  }
+
   /* NOTE: in accurate mode, it would be more correct to clear the
    * buffer from the framing change to the end of that frame, as well
    * as for the next frame.
@@ -464,6 +672,127 @@ video_update_VSYNC(struct video_struct* p_video) {
   }
 }
 
+static inline uint32_t
+video_min_span(uint32_t span, uint32_t limit) {
+  if (limit < span) {
+    return limit;
+  }
+  return span;
+}
+
+static inline uint32_t
+video_get_quiet_span(struct video_struct* p_video,
+                     uint32_t r0,
+                     uint32_t r1,
+                     uint32_t r2,
+                     int r7_hit,
+                     uint32_t cursor_addr,
+                     int pushed_dispen,
+                     int pushed_teletext_dispen) {
+  /* Returns how many character clocks, starting at the current one, would
+   * do nothing but advance the counters and render a character. Those can be
+   * run in bulk, with the full per-character logic only run at the span
+   * boundaries.
+   */
+  uint32_t span;
+  int dispen;
+  int external_dispen;
+  uint8_t horiz_counter = p_video->horiz_counter;
+  uint32_t address_counter = p_video->address_counter;
+
+  if (p_video->start_of_line_state_checks || !p_video->is_opt_quiet_span) {
+    return 0;
+  }
+  span = (uint8_t) (r0 - horiz_counter);
+  span = video_min_span(span, (uint8_t) (r1 - horiz_counter));
+  if (r7_hit || p_video->is_even_vsync) {
+    span = video_min_span(span,
+                          (uint8_t) (p_video->half_r0 - horiz_counter - 1));
+  }
+
+  if (!p_video->is_rendering_active || (span == 0)) {
+    return span;
+  }
+
+  if (p_video->in_hsync) {
+    span = video_min_span(span, (p_video->hsync_tick_counter - 1));
+  } else if (p_video->hsync_pulse_width > 0) {
+    span = video_min_span(span, (uint8_t) (r2 - horiz_counter));
+  }
+
+  /* DISPEN must be settled, and already passed on in this advance. The
+   * teletext copy is gated by MA13, so the span can't cross a change of that
+   * either.
+   */
+  dispen = (p_video->display_enable_bits == k_video_display_enable_all);
+  if ((p_video->dispen_shifts[0] != dispen) ||
+      (p_video->dispen_shifts[1] != dispen) ||
+      (p_video->dispen_shifts[2] != dispen)) {
+    return 0;
+  }
+  external_dispen = p_video->dispen_shifts[p_video->skew_dispen_index];
+  if ((external_dispen != pushed_dispen) ||
+      ((external_dispen & !!(address_counter & 0x2000)) !=
+          pushed_teletext_dispen)) {
+    return 0;
+  }
+  if (external_dispen) {
+    span = video_min_span(span, (0x2000 - (address_counter & 0x1FFF)));
+  }
+
+  if (!p_video->cursor_disabled) {
+    if (p_video->cursor_skew_counter >= 0) {
+      return 0;
+    }
+    if (p_video->has_hit_cursor_line_start &&
+        !p_video->has_hit_cursor_line_end &&
+        (!p_video->cursor_flashing || (p_video->crtc_frames &
+                                       p_video->cursor_flash_mask))) {
+      span = video_min_span(span,
+                            ((cursor_addr - address_counter) & 0x3FFF));
+    }
+  }
+
+  return span;
+}
+
+static inline uint64_t
+video_advance_quiet_span(struct video_struct* p_video,
+                         uint32_t span,
+                         uint64_t ticks,
+                         uint64_t ticks_inc) {
+  uint32_t i;
+
+  if (p_video->is_rendering_active) {
+    struct render_struct* p_render = p_video->p_render;
+    uint32_t address_counter = p_video->address_counter;
+    uint8_t scanline_counter = p_video->scanline_counter;
+    uint32_t screen_wrap_add = p_video->screen_wrap_add;
+
+    if (p_video->in_hsync) {
+      p_video->hsync_tick_counter -= span;
+    }
+    for (i = 0; i < span; ++i) {
+      uint8_t data = video_read_data_byte(p_video,
+                                          ticks,
+                                          address_counter,
+                                          scanline_counter,
+                                          screen_wrap_add);
+      render_render(p_render, data, address_counter, ticks);
+      address_counter = ((address_counter + 1) & 0x3FFF);
+      ticks += ticks_inc;
+    }
+  } else {
+    ticks += (span * ticks_inc);
+  }
+
+  /* Wraps 0xFF -> 0; uint8_t type. */
+  p_video->horiz_counter += span;
+  p_video->address_counter = ((p_video->address_counter + span) & 0x3FFF);
+
+  return ticks;
+}
+
 void
 video_advance_crtc_timing(struct video_struct* p_video) {
   uint8_t data;
@@ -471,6 +800,8 @@ video_advance_crtc_timing(struct video_struct* p_video) {
   uint64_t ticks_target;
   uint64_t ticks_inc;
 
+  uint32_t span;
+
   int r0_hit;
   int r1_hit;
   int r2_hit;
@@ -500,6 +831,8 @@ video_advance_crtc_timing(struct video_struct* p_video) {
        p_video->crtc_registers[k_crtc_reg_cursor_low]);
   int last_external_dispen = -1;
   int this_external_dispen;
+  int pushed_dispen = -1;
+  int pushed_teletext_dispen = -1;
 
   if (p_video->externally_clocked) {
     return;
@@ -544,6 +877,20 @@ video_advance_crtc_timing(struct video_struct* p_video) {
   goto check_r6;
 
   while (ticks < ticks_target) {
+    span = video_get_quiet_span(p_video,
+                                r0,
+                                r1,
+                                r2,
+                                r7_hit,
+                                cursor_addr,
+                                pushed_dispen,
+                                pushed_teletext_dispen);
+    if (span > 0) {
+      span = video_min_span(span, ((ticks_target - ticks) / ticks_inc));
+      ticks = video_advance_quiet_span(p_video, span, ticks, ticks_inc);
+      continue;
+    }
+
     r0_hit = (p_video->horiz_counter == r0);
     r1_hit = (p_video->horiz_counter == r1);
 
@@ -645,11 +992,13 @@ video_advance_crtc_timing(struct video_struct* p_video) {
       this_external_dispen = p_video->dispen_shifts[p_video->skew_dispen_index];
       if (this_external_dispen != last_external_dispen) {
         render_set_DISPEN(p_video->p_render, this_external_dispen);
+        pushed_dispen = this_external_dispen;
         /* The IC15 latch only lets DISPEN through if teletext linear addressing
          * is in effect.
          */
         this_external_dispen &= !!(address_counter & 0x2000);
         teletext_DISPEN_changed(p_video->p_teletext, this_external_dispen);
+        pushed_teletext_dispen = this_external_dispen;
       }
 
       if (!p_video->cursor_disabled) {
@@ -825,11 +1174,6 @@ video_init_timer(struct video_struct* p_video) {
   (void) timing_start_timer_with_value(p_video->p_timing, p_video->timer_id, 0);
 }
 
-static inline int
-video_get_flash(struct video_struct* p_video) {
-  return !!(p_video->video_ula_control & k_ula_flash);
-}
-
 static int
 video_is_full_vsync_state_match(struct video_struct* p_video, int is_raise) {
   int is_even_field = (p_video->is_interlace && (p_video->crtc_frames & 1));
@@ -993,6 +1337,8 @@ video_update_timer(struct video_struct* p_video) {
     return;
   }
 
+  p_video->is_timer_stale = 0;
+
   clock_speed = video_get_clock_speed(p_video);
 
   timer_value = video_calculate_timer(p_video, clock_speed);
@@ -1012,6 +1358,49 @@ video_update_timer(struct video_struct* p_video) {
                                 timer_value);
 }
 
+static void
+video_mark_timer_stale(struct video_struct* p_video) {
+  /* Raster effects write several framing registers back to back. Part way
+   * along a scanline, video_calculate_timer() would stop no later than the
+   * next C0=0 (or half R0 in interlace), so rather than recalculate after
+   * each write, fire no later than that and recalculate once, there.
+   */
+  uint64_t timer_value;
+
+  uint32_t r0 = p_video->crtc_registers[k_crtc_reg_horiz_total];
+  uint32_t horiz_counter = p_video->horiz_counter;
+
+  /* As for video_calculate_timer(), an odd cycle at 1MHz needs a half tick
+   * to re-catch the 1MHz train.
+   */
+  if ((video_get_clock_speed(p_video) == 0) &&
+      (timing_get_scaled_total_timer_ticks(p_video->p_timing) & 1)) {
+    timer_value = 1;
+  } else {
+    if (horiz_counter > r0) {
+      timer_value = (256 - horiz_counter);
+    } else if (p_video->is_interlace && (horiz_counter < p_video->half_r0)) {
+      timer_value = (p_video->half_r0 - horiz_counter);
+    } else {
+      timer_value = ((r0 + 1) - horiz_counter);
+    }
+    timer_value *= p_video->clock_tick_multiplier;
+  }
+
+  /* Any vsync expectation no longer holds. */
+  p_video->timer_fire_mode = k_video_timer_null;
+
+  if (p_video->is_timer_stale &&
+      (timing_get_timer_value(p_video->p_timing, p_video->timer_id) <=
+           (int64_t) timer_value)) {
+    return;
+  }
+  p_video->is_timer_stale = 1;
+  (void) timing_set_timer_value(p_video->p_timing,
+                                p_video->timer_id,
+                                timer_value);
+}
+
 static void
 video_jump_to_vsync_start(struct video_struct* p_video) {
   uint32_t timer_value;
@@ -1147,14 +1536,24 @@ video_timer_fired(void* p) {
 }
 
 static void
-video_mode_updated(struct video_struct* p_video) {
-  /* Let the renderer know about the new mode. */
-  int is_teletext = (p_video->video_ula_control & k_ula_teletext);
-  int chars_per_line = (p_video->video_ula_control & k_ula_chars_per_line);
-  int clock_speed = video_get_clock_speed(p_video);
+video_set_render_mode(struct render_struct* p_render, uint8_t ula_control) {
+  int is_teletext = (ula_control & k_ula_teletext);
+  int chars_per_line = (ula_control & k_ula_chars_per_line);
+  int clock_speed = !!(ula_control & k_ula_clock_speed);
   chars_per_line >>= k_ula_chars_per_line_shift;
 
-  render_set_mode(p_video->p_render, clock_speed, chars_per_line, is_teletext);
+  render_set_mode(p_render, clock_speed, chars_per_line, is_teletext);
+}
+
+static void
+video_mode_updated(struct video_struct* p_video) {
+  /* For full frame rendering, the mode goes across with each frame. */
+  if (p_video->externally_clocked) {
+    return;
+  }
+
+  /* Let the renderer know about the new mode. */
+  video_set_render_mode(p_video->p_render, p_video->video_ula_control);
 }
 
 static void
@@ -1287,6 +1686,401 @@ video_paint_timer_fired(void* p) {
   video_do_custom_paint_event(p_video);
 }
 
+static void
+video_get_frame_geometry(struct video_frame_geometry* p_geometry,
+                         struct video_frame* p_frame) {
+  uint8_t* p_regs = &p_frame->crtc_registers[0];
+  uint32_t num_lines = p_regs[k_crtc_reg_lines_per_character];
+  uint32_t vert_total = (p_regs[k_crtc_reg_vert_total] + 1);
+  uint32_t horiz_total = (p_regs[k_crtc_reg_horiz_total] + 1);
+  uint32_t num_pre_lines = 0;
+  uint32_t num_pre_cols = 0;
+
+  if ((p_regs[k_crtc_reg_interlace] & 0x03) == 0x03) {
+    num_lines += 2;
+    num_lines /= 2;
+  } else {
+    num_lines += 1;
+  }
+  if (vert_total > p_regs[k_crtc_reg_vert_sync_position]) {
+    num_pre_lines = (vert_total - p_regs[k_crtc_reg_vert_sync_position]);
+    num_pre_lines *= num_lines;
+  }
+  num_pre_lines += p_regs[k_crtc_reg_vert_adjust];
+  if (horiz_total > p_regs[k_crtc_reg_horiz_position]) {
+    num_pre_cols = (horiz_total - p_regs[k_crtc_reg_horiz_position]);
+  }
+
+  p_geometry->crtc_start_address = ((p_regs[k_crtc_reg_mem_addr_high] << 8) |
+                                    p_regs[k_crtc_reg_mem_addr_low]);
+  p_geometry->num_rows = p_regs[k_crtc_reg_vert_displayed];
+  p_geometry->num_lines = num_lines;
+  p_geometry->num_cols = p_regs[k_crtc_reg_horiz_displayed];
+  p_geometry->num_pre_lines = num_pre_lines;
+  p_geometry->num_pre_cols = num_pre_cols;
+  p_geometry->hsync_pulse_ticks = (p_frame->hsync_pulse_width *
+                                   p_frame->clock_tick_multiplier);
+  p_geometry->is_teletext = !!(p_frame->video_ula_control & k_ula_teletext);
+  p_geometry->is_teletext_row_cached = 0;
+}
+
+static void
+video_invalidate_teletext_rows(struct video_struct* p_video) {
+  uint32_t i;
+
+  if (p_video->p_teletext_rows == NULL) {
+    return;
+  }
+  for (i = 0; i < k_video_teletext_rows; ++i) {
+    p_video->p_teletext_rows[i].is_valid = 0;
+  }
+}
+
+static int
+video_is_teletext_row_cache_usable(struct video_struct* p_video,
+                                   struct video_frame* p_frame,
+                                   struct video_frame_geometry* p_geometry) {
+  struct video_teletext_rows_key key;
+  uint32_t num_total_lines;
+  int is_usable;
+
+  struct render_struct* p_render = p_video->p_render;
+
+  if (p_video->p_teletext_rows == NULL) {
+    return 0;
+  }
+
+  (void) memset(&key, '\0', sizeof(key));
+  (void) memcpy(&key.crtc_registers[0],
+                &p_frame->crtc_registers[0],
+                sizeof(key.crtc_registers));
+  /* Rows are keyed by their data, so scrolling by start address is fine. */
+  key.crtc_registers[k_crtc_reg_mem_addr_high] = 0;
+  key.crtc_registers[k_crtc_reg_mem_addr_low] = 0;
+  key.crtc_registers[k_crtc_reg_cursor_high] = 0;
+  key.crtc_registers[k_crtc_reg_cursor_low] = 0;
+  key.video_ula_control = p_frame->video_ula_control;
+  key.hsync_pulse_ticks = p_geometry->hsync_pulse_ticks;
+  key.buffer_generation = render_get_buffer_generation(p_render);
+
+  /* Double size rewrites the buffer after each render, and a frame tall
+   * enough to fly back overwrites its own rows.
+   */
+  num_total_lines = (p_geometry->num_pre_lines +
+                     (p_geometry->num_rows * p_geometry->num_lines));
+  is_usable = (p_geometry->is_teletext &&
+               !render_is_double_size(p_render) &&
+               (num_total_lines < 384));
+
+  if (!is_usable ||
+      memcmp(&key, &p_video->teletext_rows_key, sizeof(key))) {
+    video_invalidate_teletext_rows(p_video);
+  }
+  p_video->teletext_rows_key = key;
+
+  return is_usable;
+}
+
+static void
+video_get_teletext_row_data(struct video_struct* p_video,
+                            uint8_t* p_data,
+                            struct video_frame* p_frame,
+                            struct video_frame_geometry* p_geometry,
+                            uint32_t row,
+                            uint32_t line) {
+  uint32_t i_cols;
+  uint32_t num_cols = p_geometry->num_cols;
+  uint32_t crtc_line_address = (p_geometry->crtc_start_address +
+                                (row * num_cols));
+
+  for (i_cols = 0; i_cols < num_cols; ++i_cols) {
+    uint8_t data = 0;
+    crtc_line_address &= 0x3FFF;
+    /* Matches the renderer: chunky addressing delivers zeros. */
+    if (crtc_line_address & 0x2000) {
+      uint32_t address = video_get_data_address(p_video,
+                                                0,
+                                                crtc_line_address,
+                                                line,
+                                                p_frame->screen_wrap_add);
+      data = p_frame->mem[address];
+    }
+    p_data[i_cols] = data;
+    crtc_line_address++;
+  }
+}
+
+static void
+video_replay_teletext_line(struct video_struct* p_video,
+                           struct teletext_struct* p_teletext,
+                           struct video_frame* p_frame,
+                           struct video_frame_geometry* p_geometry,
+                           uint32_t row,
+                           uint32_t line) {
+  /* Feeds the SAA5050 exactly what rendering the line would, minus the
+   * pixels, so a band can pick up the state from the rows above it.
+   */
+  uint8_t data[k_video_teletext_row_cols];
+  uint32_t i_cols;
+
+  video_get_teletext_row_data(p_video,
+                              &data[0],
+                              p_frame,
+                              p_geometry,
+                              row,
+                              line);
+  for (i_cols = 0; i_cols < p_geometry->num_pre_cols; ++i_cols) {
+    teletext_data(p_teletext, 0x00);
+  }
+  teletext_DISPEN_changed(p_teletext, 1);
+  for (i_cols = 0; i_cols < p_geometry->num_cols; ++i_cols) {
+    teletext_data(p_teletext, data[i_cols]);
+  }
+  for (i_cols = 0; i_cols < 3; ++i_cols) {
+    teletext_data(p_teletext, 0x00);
+  }
+  teletext_DISPEN_changed(p_teletext, 0);
+  teletext_DISPEN_changed(p_teletext, 1);
+  teletext_DISPEN_changed(p_teletext, 0);
+}
+
+static void
+video_render_frame_row(struct video_struct* p_video,
+                       struct render_struct* p_render,
+                       struct teletext_struct* p_teletext,
+                       struct video_frame* p_frame,
+                       struct video_frame_geometry* p_geometry,
+                       uint32_t row) {
+  uint32_t i_cols;
+  uint32_t i_lines;
+  uint32_t crtc_line_address;
+
+  uint32_t screen_wrap_add = p_frame->screen_wrap_add;
+  uint32_t num_cols = p_geometry->num_cols;
+  uint32_t num_pre_cols = p_geometry->num_pre_cols;
+
+  for (i_lines = 0; i_lines < p_geometry->num_lines; ++i_lines) {
+    render_set_RA(p_render, i_lines);
+    crtc_line_address = (p_geometry->crtc_start_address + (row * num_cols));
+    for (i_cols = 0; i_cols < num_pre_cols; ++i_cols) {
+      render_render(p_render, 0x00, 0, 0);
+    }
+    render_set_DISPEN(p_render, 1);
+    teletext_DISPEN_changed(p_teletext, 1);
+    for (i_cols = 0; i_cols < num_cols; ++i_cols) {
+      uint32_t address;
+      crtc_line_address &= 0x3FFF;
+      address = video_get_data_address(p_video,
+                                       0,
+                                       crtc_line_address,
+                                       i_lines,
+                                       screen_wrap_add);
+      render_render(p_render,
+                    p_frame->mem[address],
+                    crtc_line_address,
+                    0);
+      crtc_line_address++;
+    }
+    if (p_geometry->is_teletext) {
+      /* Send along three extra characters, because the teletext display
+       * path is pipelined, and three behind.
+       */
+      for (i_cols = 0; i_cols < 3; ++i_cols) {
+        render_render(p_render, 0x00, 0, 0);
+      }
+    }
+    render_set_DISPEN(p_render, 0);
+    teletext_DISPEN_changed(p_teletext, 0);
+    (void) render_hsync(p_render, p_geometry->hsync_pulse_ticks);
+    teletext_DISPEN_changed(p_teletext, 1);
+    teletext_DISPEN_changed(p_teletext, 0);
+  }
+}
+
+static void
+video_render_teletext_row(struct video_struct* p_video,
+                          struct render_struct* p_render,
+                          struct teletext_struct* p_teletext,
+                          struct video_frame* p_frame,
+                          struct video_frame_geometry* p_geometry,
+                          uint32_t row) {
+  /* MODE7 screens are mostly static text. A row with the same data bytes,
+   * entered with the same SAA5050 state (which covers the flash phase and
+   * double height), renders the same pixels to the same place, so the
+   * render can be skipped.
+   */
+  uint8_t data[k_video_teletext_row_cols];
+  uint32_t i_lines;
+
+  struct video_teletext_row* p_row = &p_video->p_teletext_rows[row];
+  uint32_t num_cols = p_geometry->num_cols;
+
+  /* With MODE7 addressing, every scanline fetches the same bytes. */
+  video_get_teletext_row_data(p_video,
+                              &data[0],
+                              p_frame,
+                              p_geometry,
+                              row,
+                              0);
+
+  if (p_row->is_valid &&
+      !memcmp(&p_row->data[0], &data[0], num_cols) &&
+      teletext_is_same_state(p_teletext, p_row->p_start_state)) {
+    teletext_restore_state(p_teletext, p_row->p_end_state);
+    for (i_lines = 0; i_lines < p_geometry->num_lines; ++i_lines) {
+      (void) render_hsync(p_render, p_geometry->hsync_pulse_ticks);
+    }
+    return;
+  }
+
+  if (p_row->p_start_state == NULL) {
+    p_row->p_start_state = teletext_create();
+    p_row->p_end_state = teletext_create();
+  }
+  teletext_copy_state(p_row->p_start_state, p_teletext);
+  video_render_frame_row(p_video,
+                         p_render,
+                         p_teletext,
+                         p_frame,
+                         p_geometry,
+                         row);
+  teletext_copy_state(p_row->p_end_state, p_teletext);
+  (void) memcpy(&p_row->data[0], &data[0], num_cols);
+  p_row->is_valid = 1;
+}
+
+static void
+video_render_frame_rows(struct video_struct* p_video,
+                        struct render_struct* p_render,
+                        struct teletext_struct* p_teletext,
+                        struct video_frame* p_frame,
+                        struct video_frame_geometry* p_geometry,
+                        uint32_t row_start,
+                        uint32_t row_end) {
+  uint32_t i_lines;
+  uint32_t i_rows;
+  uint32_t i;
+
+  uint32_t num_lines = p_geometry->num_lines;
+  uint32_t hsync_pulse_ticks = p_geometry->hsync_pulse_ticks;
+  int is_teletext = p_geometry->is_teletext;
+
+  video_set_render_mode(p_render, p_frame->video_ula_control);
+  for (i = 0; i < 16; ++i) {
+    render_set_palette(p_render, i, p_frame->palette[i]);
+  }
+  render_prepare(p_render);
+  render_vsync(p_render);
+  render_set_DISPEN(p_render, 0);
+  teletext_RA_ISV_changed(p_teletext, 0, 1);
+
+  for (i_lines = 0; i_lines < p_geometry->num_pre_lines; ++i_lines) {
+    (void) render_hsync(p_render, hsync_pulse_ticks);
+  }
+  /* Rows above the band just move the beam down. */
+  for (i_rows = 0; i_rows < row_start; ++i_rows) {
+    for (i_lines = 0; i_lines < num_lines; ++i_lines) {
+      if (is_teletext) {
+        video_replay_teletext_line(p_video,
+                                   p_teletext,
+                                   p_frame,
+                                   p_geometry,
+                                   i_rows,
+                                   i_lines);
+      }
+      (void) render_hsync(p_render, hsync_pulse_ticks);
+    }
+  }
+  for (i_rows = row_start; i_rows < row_end; ++i_rows) {
+    if (p_geometry->is_teletext_row_cached &&
+        (i_rows < k_video_teletext_rows)) {
+      video_render_teletext_row(p_video,
+                                p_render,
+                                p_teletext,
+                                p_frame,
+                                p_geometry,
+                                i_rows);
+    } else {
+      video_render_frame_row(p_video,
+                             p_render,
+                             p_teletext,
+                             p_frame,
+                             p_geometry,
+                             i_rows);
+    }
+  }
+}
+
+static void*
+video_render_band_thread(void* p) {
+  struct video_render_band* p_band = (struct video_render_band*) p;
+
+  while (1) {
+    uint32_t message;
+    os_channel_read(p_band->handle_worker_read, &message, sizeof(message));
+    if (message == k_video_band_exit) {
+      break;
+    }
+    assert(message == k_video_band_render);
+    video_render_frame_rows(p_band->p_video,
+                            p_band->p_render,
+                            p_band->p_teletext,
+                            p_band->p_frame,
+                            &p_band->geometry,
+                            p_band->row_start,
+                            p_band->row_end);
+    os_channel_write(p_band->handle_worker_write, &message, sizeof(message));
+  }
+
+  return NULL;
+}
+
+static void
+video_create_render_bands(struct video_struct* p_video,
+                          struct bbc_options* p_options,
+                          uint32_t num_bands) {
+  uint32_t i;
+  struct video_render_band* p_bands =
+      util_mallocz(num_bands * sizeof(struct video_render_band));
+
+  p_video->num_render_bands = num_bands;
+  p_video->p_render_bands = p_bands;
+
+  p_bands[0].p_video = p_video;
+  p_bands[0].p_render = p_video->p_render;
+  p_bands[0].p_teletext = p_video->p_teletext;
+  for (i = 1; i < num_bands; ++i) {
+    struct video_render_band* p_band = &p_bands[i];
+    p_band->p_video = p_video;
+    p_band->p_teletext = teletext_create();
+    p_band->p_render = render_create(p_band->p_teletext, p_options);
+    os_channel_get_handles(&p_band->handle_main_read,
+                           &p_band->handle_worker_write,
+                           &p_band->handle_worker_read,
+                           &p_band->handle_main_write);
+    p_band->p_thread = os_thread_create(video_render_band_thread, p_band);
+  }
+}
+
+static void
+video_destroy_render_bands(struct video_struct* p_video) {
+  uint32_t i;
+
+  for (i = 1; i < p_video->num_render_bands; ++i) {
+    struct video_render_band* p_band = &p_video->p_render_bands[i];
+    uint32_t message = k_video_band_exit;
+    os_channel_write(p_band->handle_main_write, &message, sizeof(message));
+    (void) os_thread_destroy(p_band->p_thread);
+    os_channel_free_handles(p_band->handle_main_read,
+                            p_band->handle_worker_write,
+                            p_band->handle_worker_read,
+                            p_band->handle_main_write);
+    render_destroy(p_band->p_render);
+    teletext_destroy(p_band->p_teletext);
+  }
+  util_free(p_video->p_render_bands);
+}
+
 struct video_struct*
 video_create(uint8_t* p_bbc_mem,
              uint8_t* p_shadow_mem,
@@ -1325,6 +2119,7 @@ video_create(uint8_t* p_bbc_mem,
   p_video->has_paint_timer_triggered = 0;
 
   p_video->timer_id = timing_register_timer(p_timing,
+                                            "video",
                                             video_timer_fired,
                                             p_video);
 
@@ -1340,15 +2135,25 @@ video_create(uint8_t* p_bbc_mem,
 
   p_video->frames_skip = 0;
   p_video->frame_skip_counter = 0;
-  (void) util_get_u32_option(&p_video->frames_skip,
+  /* Either "auto", which starts at 0, or a fixed number. */
+  p_video->is_opt_frames_skip_auto = util_has_option(
+      p_options->p_opt_flags, "video:frames-skip=auto");
+  if (!p_video->is_opt_frames_skip_auto) {
+    (void) util_get_u32_option(&p_video->frames_skip,
+                               p_options->p_opt_flags,
+                               "video:frames-skip=");
+  }
+  p_video->frames_skip_max = k_video_frames_skip_max_default;
+  (void) util_get_u32_option(&p_video->frames_skip_max,
                              p_options->p_opt_flags,
-                             "video:frames-skip=");
+                             "video:frames-skip-max=");
   p_video->paint_start_cycles = 0;
   (void) util_get_u64_option(&p_video->paint_start_cycles,
                              p_options->p_opt_flags,
                              "video:paint-start-cycles=");
   if (p_video->paint_start_cycles > 0) {
     p_video->paint_timer_id = timing_register_timer(p_timing,
+                                                    "video_paint",
                                                     video_paint_timer_fired,
                                                     p_video);
     (void) timing_start_timer_with_value(p_timing,
@@ -1364,6 +2169,32 @@ video_create(uint8_t* p_bbc_mem,
                              "video:paint-cycles=");
   p_video->is_opt_always_clear_frame_buffer = util_has_option(
       p_options->p_opt_flags, "video:always-clear");
+  p_video->is_opt_skip_unchanged_frames = !util_has_option(
+      p_options->p_opt_flags, "video:no-skip-unchanged");
+  p_video->is_opt_teletext_row_cache = !util_has_option(
+      p_options->p_opt_flags, "video:no-teletext-cache");
+  p_video->is_opt_quiet_span = !util_has_option(
+      p_options->p_opt_flags, "video:no-quiet-span");
+  if (externally_clocked) {
+    uint32_t num_bands = 1;
+    (void) util_get_u32_option(&num_bands,
+                               p_options->p_opt_flags,
+                               "video:render-threads=");
+    if ((num_bands < 1) || (num_bands > 16)) {
+      util_bail("render-threads must be 1 to 16");
+    }
+    p_video->p_frame_data = util_malloc(k_video_frame_data_max);
+    p_video->p_frames = util_malloc(k_video_num_frames *
+                                    sizeof(struct video_frame));
+    p_video->p_frames_lock = os_lock_create();
+    video_create_render_bands(p_video, p_options, num_bands);
+    if (p_video->is_opt_teletext_row_cache) {
+      p_video->p_teletext_rows = util_mallocz(
+          k_video_teletext_rows * sizeof(struct video_teletext_row));
+    }
+  }
+  p_video->frame_latest = -1;
+  p_video->frame_in_use = -1;
 
   if (p_system_via) {
     via_set_CB2_changed_callback(p_system_via,
@@ -1383,6 +2214,25 @@ video_create(uint8_t* p_bbc_mem,
 void
 video_destroy(struct video_struct* p_video) {
   render_set_flyback_callback(p_video->p_render, NULL, NULL);
+  if (p_video->p_render_bands != NULL) {
+    video_destroy_render_bands(p_video);
+  }
+  if (p_video->p_frames_lock != NULL) {
+    os_lock_destroy(p_video->p_frames_lock);
+  }
+  if (p_video->p_teletext_rows != NULL) {
+    uint32_t i;
+    for (i = 0; i < k_video_teletext_rows; ++i) {
+      struct video_teletext_row* p_row = &p_video->p_teletext_rows[i];
+      if (p_row->p_start_state != NULL) {
+        teletext_destroy(p_row->p_start_state);
+        teletext_destroy(p_row->p_end_state);
+      }
+    }
+    util_free(p_video->p_teletext_rows);
+  }
+  util_free(p_video->p_frames);
+  util_free(p_video->p_frame_data);
   util_free(p_video);
 }
 
@@ -1629,124 +2479,328 @@ video_apply_wall_time_delta(struct video_struct* p_video, uint64_t delta) {
 }
 
 void
-video_render_full_frame(struct video_struct* p_video) {
-  uint32_t i_cols;
-  uint32_t i_lines;
-  uint32_t i_rows;
-  uint32_t crtc_line_address;
-
-  struct render_struct* p_render = p_video->p_render;
-
-  /* This render function is typically called on a different thread to the
-   * BBC thread, so make sure to reload register values from memory.
+video_apply_host_load(struct video_struct* p_video,
+                      uint64_t busy_us,
+                      uint64_t budget_us) {
+  /* Emulation speed comes first: skip more frames as soon as a window runs
+   * close to budget, but only skip fewer after two windows with plenty to
+   * spare, so as not to flap between levels.
    */
-  volatile uint8_t* p_regs = (volatile uint8_t*) &p_video->crtc_registers;
-  volatile uint8_t* p_ula_control = &p_video->video_ula_control;
+  uint64_t busy_percent;
 
-  uint32_t crtc_start_address = ((p_regs[k_crtc_reg_mem_addr_high] << 8) |
-                                 p_regs[k_crtc_reg_mem_addr_low]);
-  uint32_t screen_wrap_add = p_video->screen_wrap_add;
-  uint32_t num_rows = p_regs[k_crtc_reg_vert_displayed];
-  uint32_t num_lines = p_regs[k_crtc_reg_lines_per_character];
-  uint32_t num_cols = p_regs[k_crtc_reg_horiz_displayed];
-  uint32_t vert_total = (p_regs[k_crtc_reg_vert_total] + 1);
-  uint32_t horiz_total = (p_regs[k_crtc_reg_horiz_total] + 1);
-  uint32_t num_pre_lines = 0;
-  uint32_t num_pre_cols = 0;
-  struct teletext_struct* p_teletext = p_video->p_teletext;
-  uint32_t hsync_pulse_ticks = (p_video->hsync_pulse_width *
-                                p_video->clock_tick_multiplier);
-  int is_teletext = (*p_ula_control & k_ula_teletext);
+  if (!p_video->is_opt_frames_skip_auto) {
+    return;
+  }
 
-  assert(p_video->externally_clocked);
+  p_video->host_busy_us += busy_us;
+  p_video->host_budget_us += budget_us;
+  if (p_video->host_budget_us < k_video_host_load_window_us) {
+    return;
+  }
 
-  if ((p_regs[k_crtc_reg_interlace] & 0x03) == 0x03) {
-    num_lines += 2;
-    num_lines /= 2;
+  busy_percent = ((p_video->host_busy_us * 100) / p_video->host_budget_us);
+  p_video->host_busy_us = 0;
+  p_video->host_budget_us = 0;
+
+  if (busy_percent >= 90) {
+    p_video->host_idle_windows = 0;
+    if (p_video->frames_skip < p_video->frames_skip_max) {
+      p_video->frames_skip++;
+    }
+  } else if (busy_percent < 60) {
+    p_video->host_idle_windows++;
+    if ((p_video->host_idle_windows >= 2) && (p_video->frames_skip > 0)) {
+      p_video->host_idle_windows = 0;
+      p_video->frames_skip--;
+    }
   } else {
-    num_lines += 1;
-  }
-  if (vert_total > p_regs[k_crtc_reg_vert_sync_position]) {
-    num_pre_lines = (vert_total - p_regs[k_crtc_reg_vert_sync_position]);
-    num_pre_lines *= num_lines;
-  }
-  num_pre_lines += p_regs[k_crtc_reg_vert_adjust];
-  if (horiz_total > p_regs[k_crtc_reg_horiz_position]) {
-    num_pre_cols = (horiz_total - p_regs[k_crtc_reg_horiz_position]);
+    p_video->host_idle_windows = 0;
   }
+}
 
-  render_prepare(p_render);
-  render_vsync(p_render);
-  render_set_DISPEN(p_render, 0);
-  teletext_VSYNC_changed(p_teletext, 0);
-  teletext_RA_ISV_changed(p_teletext, 0, 1);
+uint32_t
+video_get_frames_skip(struct video_struct* p_video) {
+  return p_video->frames_skip;
+}
 
-  for (i_lines = 0; i_lines < num_pre_lines; ++i_lines) {
-    (void) render_hsync(p_render, hsync_pulse_ticks);
+static int
+video_is_full_frame_changed(struct video_struct* p_video,
+                            struct video_frame* p_frame,
+                            uint32_t crtc_start_address,
+                            uint32_t num_rows,
+                            uint32_t num_lines,
+                            uint32_t num_cols) {
+  struct video_frame_state frame_state;
+  uint32_t i_cols;
+  uint32_t i_lines;
+  uint32_t i_rows;
+  uint32_t i;
+  int is_changed;
+
+  uint32_t screen_wrap_add = p_frame->screen_wrap_add;
+  uint8_t* p_frame_data = p_video->p_frame_data;
+
+  (void) memset(&frame_state, '\0', sizeof(frame_state));
+  (void) memcpy(&frame_state.crtc_registers[0],
+                &p_frame->crtc_registers[0],
+                sizeof(frame_state.crtc_registers));
+  frame_state.video_ula_control = p_frame->video_ula_control;
+  frame_state.teletext_flash = teletext_is_flash_visible(p_video->p_teletext);
+  (void) memcpy(&frame_state.palette[0],
+                &p_frame->palette[0],
+                sizeof(frame_state.palette));
+  frame_state.screen_wrap_add = screen_wrap_add;
+  frame_state.buffer_generation =
+      render_get_buffer_generation(p_video->p_render);
+  frame_state.data_len = (num_rows * num_lines * num_cols);
+
+  if (!p_video->is_opt_skip_unchanged_frames ||
+      (frame_state.data_len > k_video_frame_data_max)) {
+    p_video->has_frame_state = 0;
+    return 1;
   }
+
+  is_changed = (!p_video->has_frame_state ||
+                memcmp(&frame_state,
+                       &p_video->frame_state,
+                       sizeof(frame_state)));
+
+  /* Screen memory is compared against a copy of what was last rendered. The
+   * copy is refreshed in full even after a difference is found.
+   */
+  i = 0;
   for (i_rows = 0; i_rows < num_rows; ++i_rows) {
     for (i_lines = 0; i_lines < num_lines; ++i_lines) {
-      render_set_RA(p_render, i_lines);
-      crtc_line_address = (crtc_start_address + (i_rows * num_cols));
-      for (i_cols = 0; i_cols < num_pre_cols; ++i_cols) {
-        render_render(p_render, 0x00, 0, 0);
-      }
-      render_set_DISPEN(p_render, 1);
-      teletext_DISPEN_changed(p_teletext, 1);
+      uint32_t crtc_line_address = (crtc_start_address + (i_rows * num_cols));
       for (i_cols = 0; i_cols < num_cols; ++i_cols) {
+        uint32_t address;
         uint8_t data;
         crtc_line_address &= 0x3FFF;
-        data = video_read_data_byte(p_video,
-                                    0,
-                                    crtc_line_address,
-                                    i_lines,
-                                    screen_wrap_add);
-        render_render(p_render, data, crtc_line_address, 0);
-        crtc_line_address++;
-      }
-      if (is_teletext) {
-        /* Send along three extra characters, because the teletext display
-         * path is pipelined, and three behind.
-         */
-        for (i_cols = 0; i_cols < 3; ++i_cols) {
-          render_render(p_render, 0x00, 0, 0);
+        address = video_get_data_address(p_video,
+                                         0,
+                                         crtc_line_address,
+                                         i_lines,
+                                         screen_wrap_add);
+        data = p_frame->mem[address];
+        if (p_frame_data[i] != data) {
+          p_frame_data[i] = data;
+          is_changed = 1;
         }
+        crtc_line_address++;
+        i++;
       }
-      render_set_DISPEN(p_render, 0);
-      teletext_DISPEN_changed(p_teletext, 0);
-      (void) render_hsync(p_render, hsync_pulse_ticks);
-      teletext_DISPEN_changed(p_teletext, 1);
-      teletext_DISPEN_changed(p_teletext, 0);
     }
   }
+
+  p_video->frame_state = frame_state;
+  p_video->has_frame_state = 1;
+
+  return is_changed;
 }
 
-static void
-video_update_real_color(struct video_struct* p_video, uint8_t index) {
-  uint32_t color;
+static int
+video_render_frame_bands(struct video_struct* p_video,
+                         struct video_frame* p_frame,
+                         struct video_frame_geometry* p_geometry) {
+  uint32_t i;
+  uint32_t num_total_lines;
+  uint32_t num_total_cols;
 
-  uint8_t rgbf = p_video->ula_palette[index];
+  struct video_render_band* p_bands = p_video->p_render_bands;
+  uint32_t num_bands = p_video->num_render_bands;
+  uint32_t num_rows = p_geometry->num_rows;
+  uint32_t* p_buffer = render_get_buffer(p_video->p_render);
 
-  /* The actual color displayed depends on the flash bit. */
-  if ((rgbf & 0x8) && video_get_flash(p_video)) {
-    rgbf ^= 0x7;
+  if (num_rows < num_bands) {
+    num_bands = num_rows;
   }
-  /* Alpha. */
-  color = 0xff000000;
-  /* Red. */
-  if (rgbf & 0x1) {
-    color |= 0x00ff0000;
+  if ((num_bands < 2) || (p_buffer == NULL)) {
+    return 0;
   }
-  /* Green. */
-  if (rgbf & 0x2) {
-    color |= 0x0000ff00;
+  /* Bands must not wrap: no flyback from the beam running off the bottom,
+   * and no early hsync from a line running off the right.
+   */
+  num_total_lines = (p_geometry->num_pre_lines +
+                     (num_rows * p_geometry->num_lines));
+  num_total_cols = (p_geometry->num_pre_cols + p_geometry->num_cols + 3);
+  if ((num_total_lines >= 384) || (num_total_cols >= 96)) {
+    return 0;
   }
-  /* Blue. */
-  if (rgbf & 0x4) {
-    color |= 0x000000ff;
+
+  for (i = 1; i < num_bands; ++i) {
+    /* NOTE: this clears the buffer, so it must all happen before any band
+     * starts rendering.
+     */
+    if (render_get_buffer(p_bands[i].p_render) == NULL) {
+      render_set_buffer(p_bands[i].p_render, p_buffer);
+      video_invalidate_teletext_rows(p_video);
+    }
+  }
+  for (i = 1; i < num_bands; ++i) {
+    struct video_render_band* p_band = &p_bands[i];
+    uint32_t message = k_video_band_render;
+    /* The SAA5050 state at the start of the frame. The band replays the rows
+     * above it to get to its own first row.
+     */
+    teletext_copy_state(p_band->p_teletext, p_video->p_teletext);
+    p_band->p_frame = p_frame;
+    p_band->geometry = *p_geometry;
+    p_band->row_start = ((num_rows * i) / num_bands);
+    p_band->row_end = ((num_rows * (i + 1)) / num_bands);
+    os_channel_write(p_band->handle_main_write, &message, sizeof(message));
+  }
+
+  video_render_frame_rows(p_video,
+                          p_video->p_render,
+                          p_video->p_teletext,
+                          p_frame,
+                          p_geometry,
+                          0,
+                          (num_rows / num_bands));
+
+  for (i = 1; i < num_bands; ++i) {
+    uint32_t message;
+    os_channel_read(p_bands[i].handle_main_read, &message, sizeof(message));
+    assert(message == k_video_band_render);
+  }
+
+  return 1;
+}
+
+static int
+video_render_frame(struct video_struct* p_video, struct video_frame* p_frame) {
+  struct video_frame_geometry geometry;
+
+  video_get_frame_geometry(&geometry, p_frame);
+
+  /* The teletext flash phase advances whether or not the frame renders. */
+  teletext_VSYNC_changed(p_video->p_teletext, 0);
+  if (!video_is_full_frame_changed(p_video,
+                                   p_frame,
+                                   geometry.crtc_start_address,
+                                   geometry.num_rows,
+                                   geometry.num_lines,
+                                   geometry.num_cols)) {
+    /* The buffer already holds this exact frame. */
+    return 0;
+  }
+  geometry.is_teletext_row_cached =
+      video_is_teletext_row_cache_usable(p_video, p_frame, &geometry);
+
+  if (!video_render_frame_bands(p_video, p_frame, &geometry)) {
+    video_render_frame_rows(p_video,
+                            p_video->p_render,
+                            p_video->p_teletext,
+                            p_frame,
+                            &geometry,
+                            0,
+                            geometry.num_rows);
+  }
+
+  return 1;
+}
+
+int
+video_render_full_frame(struct video_struct* p_video) {
+  int32_t index;
+  int ret;
+
+  assert(p_video->externally_clocked);
+
+  /* This is typically called on a different thread to the BBC thread. It
+   * renders the most recently captured frame; any older ones are dropped.
+   */
+  os_lock_lock(p_video->p_frames_lock);
+  index = p_video->frame_latest;
+  p_video->frame_in_use = index;
+  os_lock_unlock(p_video->p_frames_lock);
+
+  if (index == -1) {
+    return 0;
   }
 
-  render_set_palette(p_video->p_render, index, color);
+  ret = video_render_frame(p_video, &p_video->p_frames[index]);
+
+  os_lock_lock(p_video->p_frames_lock);
+  p_video->frame_in_use = -1;
+  os_lock_unlock(p_video->p_frames_lock);
+
+  return ret;
+}
+
+void
+video_set_frame_hash_enabled(struct video_struct* p_video, int is_enabled) {
+  p_video->is_frame_hash_enabled = is_enabled;
+}
+
+uint64_t
+video_get_frame_hash(struct video_struct* p_video) {
+  /* Hashes what decides the picture, rather than the picture itself: the
+   * registers, palette and the screen bytes the CRTC would fetch. The teletext
+   * flash phase is not included.
+   */
+  struct video_frame_geometry geometry;
+  struct video_frame* p_frame;
+  uint8_t line[256];
+  uint32_t i_rows;
+  uint32_t i_lines;
+  uint32_t i_cols;
+  uint64_t hash;
+
+  if (!p_video->is_frame_hash_enabled || !p_video->externally_clocked) {
+    return 0;
+  }
+  /* Called on the BBC thread, which is the only one that changes
+   * frame_latest, so no need to lock.
+   */
+  if (p_video->frame_latest == -1) {
+    return 0;
+  }
+  p_frame = &p_video->p_frames[p_video->frame_latest];
+  video_get_frame_geometry(&geometry, p_frame);
+
+  hash = util_hash64_init();
+  hash = util_hash64_add(hash, &p_frame->crtc_registers[0], 16);
+  hash = util_hash64_add(hash, &p_frame->video_ula_control, 1);
+  hash = util_hash64_add(hash,
+                         &p_frame->palette[0],
+                         sizeof(p_frame->palette));
+  hash = util_hash64_add(hash,
+                         &p_frame->screen_wrap_add,
+                         sizeof(p_frame->screen_wrap_add));
+
+  for (i_rows = 0; i_rows < geometry.num_rows; ++i_rows) {
+    for (i_lines = 0; i_lines < geometry.num_lines; ++i_lines) {
+      uint32_t crtc_line_address = (geometry.crtc_start_address +
+                                    (i_rows * geometry.num_cols));
+      for (i_cols = 0; i_cols < geometry.num_cols; ++i_cols) {
+        uint32_t address;
+        crtc_line_address &= 0x3FFF;
+        address = video_get_data_address(p_video,
+                                         0,
+                                         crtc_line_address,
+                                         i_lines,
+                                         p_frame->screen_wrap_add);
+        line[i_cols] = p_frame->mem[address];
+        crtc_line_address++;
+      }
+      hash = util_hash64_add(hash, &line[0], geometry.num_cols);
+    }
+  }
+
+  return util_hash64_finish(hash);
+}
+
+static void
+video_update_real_color(struct video_struct* p_video, uint8_t index) {
+  /* For full frame rendering, the palette goes across with each frame. */
+  if (p_video->externally_clocked) {
+    return;
+  }
+
+  render_set_palette(p_video->p_render,
+                     index,
+                     video_get_real_color(p_video, index));
 }
 
 static void
@@ -1763,7 +2817,16 @@ video_framing_changed(struct video_struct* p_video) {
                timing_get_total_timer_ticks(p_video->p_timing));
   }
 
-  video_update_timer(p_video);
+  /* At the start of a scanline, or a vsync edge, the timer may be able to
+   * jump a long way, so it's worth calculating right away.
+   */
+  if ((p_video->horiz_counter == 0) ||
+      video_is_at_vsync_raise(p_video) ||
+      video_is_at_vsync_lower(p_video)) {
+    video_update_timer(p_video);
+  } else {
+    video_mark_timer_stale(p_video);
+  }
 }
 
 static void
@@ -2185,4 +3248,86 @@ video_get_crtc_state(struct video_struct* p_video,
   *p_is_in_dummy_raster = p_video->in_dummy_raster;
 }
 
+void
+video_snapshot(struct video_struct* p_video,
+               struct snapshot_struct* p_snapshot) {
+  int is_load = snapshot_is_load(p_snapshot);
+
+  /* Bring the CRTC up to date so the saved counters match the saved time. */
+  if (!is_load) {
+    video_advance_crtc_timing(p_video);
+  }
+
+  SNAPSHOT_FIELD(p_snapshot, p_video->wall_time);
+  SNAPSHOT_FIELD(p_snapshot, p_video->vsync_next_time);
+  SNAPSHOT_FIELD(p_snapshot, p_video->prev_system_ticks);
+
+  SNAPSHOT_FIELD(p_snapshot, p_video->video_ula_control);
+  SNAPSHOT_FIELD(p_snapshot, p_video->ula_palette);
+  SNAPSHOT_FIELD(p_snapshot, p_video->screen_wrap_add);
+  SNAPSHOT_FIELD(p_snapshot, p_video->clock_tick_multiplier);
+  SNAPSHOT_FIELD(p_snapshot, p_video->is_shadow_displayed);
+
+  SNAPSHOT_FIELD(p_snapshot, p_video->crtc_address_register);
+  SNAPSHOT_FIELD(p_snapshot, p_video->crtc_registers);
+  SNAPSHOT_FIELD(p_snapshot, p_video->is_interlace);
+  SNAPSHOT_FIELD(p_snapshot, p_video->is_interlace_sync_and_video);
+  SNAPSHOT_FIELD(p_snapshot, p_video->scanline_stride);
+  SNAPSHOT_FIELD(p_snapshot, p_video->scanline_mask);
+  SNAPSHOT_FIELD(p_snapshot, p_video->hsync_pulse_width);
+  SNAPSHOT_FIELD(p_snapshot, p_video->vsync_pulse_width);
+  SNAPSHOT_FIELD(p_snapshot, p_video->half_r0);
+  SNAPSHOT_FIELD(p_snapshot, p_video->cursor_disabled);
+  SNAPSHOT_FIELD(p_snapshot, p_video->cursor_flashing);
+  SNAPSHOT_FIELD(p_snapshot, p_video->cursor_flash_mask);
+  SNAPSHOT_FIELD(p_snapshot, p_video->cursor_start_line);
+  SNAPSHOT_FIELD(p_snapshot, p_video->has_sane_framing_parameters);
+  SNAPSHOT_FIELD(p_snapshot, p_video->frame_crtc_ticks);
+  SNAPSHOT_FIELD(p_snapshot, p_video->skew_dispen_index);
+  SNAPSHOT_FIELD(p_snapshot, p_video->cursor_skew);
+
+  SNAPSHOT_FIELD(p_snapshot, p_video->crtc_frames);
+  SNAPSHOT_FIELD(p_snapshot, p_video->is_odd_frame);
+  SNAPSHOT_FIELD(p_snapshot, p_video->horiz_counter);
+  SNAPSHOT_FIELD(p_snapshot, p_video->scanline_counter);
+  SNAPSHOT_FIELD(p_snapshot, p_video->vert_counter);
+  SNAPSHOT_FIELD(p_snapshot, p_video->vert_adjust_counter);
+  SNAPSHOT_FIELD(p_snapshot, p_video->vsync_scanline_counter);
+  SNAPSHOT_FIELD(p_snapshot, p_video->hsync_tick_counter);
+  SNAPSHOT_FIELD(p_snapshot, p_video->address_counter);
+  SNAPSHOT_FIELD(p_snapshot, p_video->address_counter_saved);
+  SNAPSHOT_FIELD(p_snapshot, p_video->is_vert_adjust_pending);
+  SNAPSHOT_FIELD(p_snapshot, p_video->is_in_vert_adjust);
+  SNAPSHOT_FIELD(p_snapshot, p_video->in_vsync);
+  SNAPSHOT_FIELD(p_snapshot, p_video->is_even_vsync);
+  SNAPSHOT_FIELD(p_snapshot, p_video->is_odd_vsync);
+  SNAPSHOT_FIELD(p_snapshot, p_video->in_hsync);
+  SNAPSHOT_FIELD(p_snapshot, p_video->in_dummy_raster);
+  SNAPSHOT_FIELD(p_snapshot, p_video->had_odd_vsync_this_row);
+  SNAPSHOT_FIELD(p_snapshot, p_video->had_even_vsync_this_row);
+  SNAPSHOT_FIELD(p_snapshot, p_video->display_enable_bits);
+  SNAPSHOT_FIELD(p_snapshot, p_video->has_hit_cursor_line_start);
+  SNAPSHOT_FIELD(p_snapshot, p_video->has_hit_cursor_line_end);
+  SNAPSHOT_FIELD(p_snapshot, p_video->is_end_of_main_latched);
+  SNAPSHOT_FIELD(p_snapshot, p_video->is_end_of_vert_adjust_latched);
+  SNAPSHOT_FIELD(p_snapshot, p_video->is_end_of_frame_latched);
+  SNAPSHOT_FIELD(p_snapshot, p_video->start_of_line_state_checks);
+  SNAPSHOT_FIELD(p_snapshot, p_video->is_first_frame_scanline);
+  SNAPSHOT_FIELD(p_snapshot, p_video->last_vsync_raise_ticks);
+  SNAPSHOT_FIELD(p_snapshot, p_video->last_vsync_lower_ticks);
+  SNAPSHOT_FIELD(p_snapshot, p_video->cursor_skew_counter);
+  SNAPSHOT_FIELD(p_snapshot, p_video->dispen_shifts);
+
+  if (!is_load) {
+    return;
+  }
+
+  /* The timer and its fire mode aren't saved. They are derived from the CRTC
+   * state and the current rendering state, so recalculate them.
+   */
+  p_video->is_framing_changed_for_render = 1;
+  video_mode_updated(p_video);
+  video_update_timer(p_video);
+}
+
 #include "test-video.c"
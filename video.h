@@ -8,6 +8,7 @@ struct video_struct;
 
 struct bbc_options;
 struct render_struct;
+struct snapshot_struct;
 struct teletext_struct;
 struct timing_struct;
 struct via_struct;
@@ -42,12 +43,29 @@ uint64_t video_get_num_crtc_advances(struct video_struct* p_video);
 struct render_struct* video_get_render(struct video_struct* p_video);
 
 void video_apply_wall_time_delta(struct video_struct* p_video, uint64_t delta);
+/* For video:frames-skip=auto. Reports how long the host spent running the
+ * last batch of emulation, against the real time it had to do it in.
+ */
+void video_apply_host_load(struct video_struct* p_video,
+                           uint64_t busy_us,
+                           uint64_t budget_us);
+uint32_t video_get_frames_skip(struct video_struct* p_video);
 
 void video_ula_write(struct video_struct* p_video, uint8_t addr, uint8_t val);
 uint8_t video_crtc_read(struct video_struct* p_video, uint8_t addr);
 void video_crtc_write(struct video_struct* p_video, uint8_t addr, uint8_t val);
 
-void video_render_full_frame(struct video_struct* p_video);
+/* Renders the frame most recently captured at paint time. Returns 0, without
+ * touching the buffer, if nothing the frame depends on has changed since it
+ * was last rendered.
+ */
+int video_render_full_frame(struct video_struct* p_video);
+/* For regression runs. A hash of the frame just captured at paint time,
+ * taken on the BBC thread, or 0 if not enabled or not rendering full frames.
+ */
+void video_set_frame_hash_enabled(struct video_struct* p_video,
+                                  int is_enabled);
+uint64_t video_get_frame_hash(struct video_struct* p_video);
 
 uint8_t video_get_ula_control(struct video_struct* p_video);
 void video_set_ula_control(struct video_struct* p_video, uint8_t val);
@@ -74,4 +92,7 @@ void video_get_crtc_state(struct video_struct* p_video,
                           int* p_is_in_vert_adjust,
                           int* p_is_in_dummy_raster);
 
+void video_snapshot(struct video_struct* p_video,
+                    struct snapshot_struct* p_snapshot);
+
 #endif /* BEEBJIT_VIDEO_H */
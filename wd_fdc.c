@@ -4,6 +4,7 @@
 #include "disc_drive.h"
 #include "ibm_disc_format.h"
 #include "log.h"
+#include "snapshot.h"
 #include "state_6502.h"
 #include "timing.h"
 #include "util.h"
@@ -390,6 +391,7 @@ wd_fdc_create(struct state_6502* p_state_6502,
   p_fdc->is_1772 = is_1772;
   p_fdc->p_timing = p_timing;
   p_fdc->timer_id = timing_register_timer(p_timing,
+                                          "wd_fdc",
                                           wd_fdc_timer_fired,
                                           p_fdc);
 
@@ -1578,3 +1580,59 @@ void
 wd_fdc_set_is_opus(struct wd_fdc_struct* p_fdc, int is_opus) {
   p_fdc->is_opus = is_opus;
 }
+
+void
+wd_fdc_snapshot(struct wd_fdc_struct* p_fdc,
+                struct snapshot_struct* p_snapshot) {
+  int32_t current_drive = -1;
+
+  if (p_fdc->p_current_drive == p_fdc->p_drive_0) {
+    current_drive = 0;
+  } else if (p_fdc->p_current_drive == p_fdc->p_drive_1) {
+    current_drive = 1;
+  }
+  SNAPSHOT_FIELD(p_snapshot, current_drive);
+  if (current_drive == 0) {
+    p_fdc->p_current_drive = p_fdc->p_drive_0;
+  } else if (current_drive == 1) {
+    p_fdc->p_current_drive = p_fdc->p_drive_1;
+  } else {
+    p_fdc->p_current_drive = NULL;
+  }
+
+  SNAPSHOT_FIELD(p_snapshot, p_fdc->control_register);
+  SNAPSHOT_FIELD(p_snapshot, p_fdc->status_register);
+  SNAPSHOT_FIELD(p_snapshot, p_fdc->track_register);
+  SNAPSHOT_FIELD(p_snapshot, p_fdc->sector_register);
+  SNAPSHOT_FIELD(p_snapshot, p_fdc->data_register);
+  SNAPSHOT_FIELD(p_snapshot, p_fdc->is_intrq);
+  SNAPSHOT_FIELD(p_snapshot, p_fdc->is_drq);
+  SNAPSHOT_FIELD(p_snapshot, p_fdc->do_raise_intrq);
+  SNAPSHOT_FIELD(p_snapshot, p_fdc->is_index_pulse);
+  SNAPSHOT_FIELD(p_snapshot, p_fdc->is_interrupt_on_index_pulse);
+  SNAPSHOT_FIELD(p_snapshot, p_fdc->is_write_track_crc_second_byte);
+  SNAPSHOT_FIELD(p_snapshot, p_fdc->command);
+  SNAPSHOT_FIELD(p_snapshot, p_fdc->command_type);
+  SNAPSHOT_FIELD(p_snapshot, p_fdc->is_command_settle);
+  SNAPSHOT_FIELD(p_snapshot, p_fdc->is_command_write);
+  SNAPSHOT_FIELD(p_snapshot, p_fdc->is_command_verify);
+  SNAPSHOT_FIELD(p_snapshot, p_fdc->is_command_multi);
+  SNAPSHOT_FIELD(p_snapshot, p_fdc->is_command_deleted);
+  SNAPSHOT_FIELD(p_snapshot, p_fdc->command_step_rate_ms);
+  SNAPSHOT_FIELD(p_snapshot, p_fdc->state);
+  SNAPSHOT_FIELD(p_snapshot, p_fdc->timer_state);
+  SNAPSHOT_FIELD(p_snapshot, p_fdc->state_count);
+  SNAPSHOT_FIELD(p_snapshot, p_fdc->index_pulse_count);
+  SNAPSHOT_FIELD(p_snapshot, p_fdc->mark_detector);
+  SNAPSHOT_FIELD(p_snapshot, p_fdc->data_shifter);
+  SNAPSHOT_FIELD(p_snapshot, p_fdc->data_shift_count);
+  SNAPSHOT_FIELD(p_snapshot, p_fdc->deliver_data);
+  SNAPSHOT_FIELD(p_snapshot, p_fdc->deliver_is_marker);
+  SNAPSHOT_FIELD(p_snapshot, p_fdc->crc);
+  SNAPSHOT_FIELD(p_snapshot, p_fdc->on_disc_track);
+  SNAPSHOT_FIELD(p_snapshot, p_fdc->on_disc_sector);
+  SNAPSHOT_FIELD(p_snapshot, p_fdc->on_disc_length);
+  SNAPSHOT_FIELD(p_snapshot, p_fdc->on_disc_crc);
+  SNAPSHOT_FIELD(p_snapshot, p_fdc->last_mfm_bit);
+  (void) timing_snapshot_timer(p_fdc->p_timing, p_fdc->timer_id, p_snapshot);
+}
@@ -7,6 +7,7 @@ struct wd_fdc_struct;
 
 struct bbc_options;
 struct disc_drive_struct;
+struct snapshot_struct;
 struct state_6502;
 struct timing_struct;
 
@@ -30,4 +31,7 @@ void wd_fdc_break_reset(struct wd_fdc_struct* p_fdc);
 uint8_t wd_fdc_read(struct wd_fdc_struct* p_fdc, uint16_t addr);
 void wd_fdc_write(struct wd_fdc_struct* p_fdc, uint16_t addr, uint8_t val);
 
+void wd_fdc_snapshot(struct wd_fdc_struct* p_fdc,
+                     struct snapshot_struct* p_snapshot);
+
 #endif /* BEEBJIT_WD_FDC_H */